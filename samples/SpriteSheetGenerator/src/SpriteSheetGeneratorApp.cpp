@@ -131,7 +131,13 @@ void SpriteSheetGeneratorApp::saveSpriteSheet( const string &filename )
   if( file )
   {
     mImagePacker.surfaceDescription().write( file );
-    writeImage( output_path / (filename + ".png"), mImagePacker.packedSurface() );
+    // pages are composited in parallel; a single page keeps the plain file name
+    auto pages = mImagePacker.packedSurfaces();
+    for( size_t i = 0; i < pages.size(); ++i )
+    {
+      auto name = pages.size() > 1 ? filename + "-" + to_string( i ) : filename;
+      writeImage( output_path / (name + ".png"), pages[i] );
+    }
   }
 }
 
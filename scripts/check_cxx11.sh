@@ -0,0 +1,27 @@
+# Checks that the Cinder-free headers built by the c++0x and c++11 projects still compile as C++11.
+# Pass a compiler to use something other than c++.
+
+CXX=${1:-c++}
+SRC="$(cd "$(dirname "$0")/../src" && pwd)"
+
+echo "Checking headers as C++11 with $CXX"
+
+$CXX -std=c++11 -fsyntax-only -Wall -I "$SRC" -I "$SRC/pockets" -x c++ - <<'CHECK' || exit 1
+// included by Packing.cpp and ImagePacker.cpp
+#include "pockets/RectPacking.h"
+#include "pockets/Parallel.h"
+#include "pockets/PixelKernels.h"
+// standalone containers, usable from any project
+#include "pockets/AtlasAllocator.h"
+#include "pockets/SlotMap.h"
+// included by LineRenderer.cpp in samples/LineRendering
+#include "pockets/gl/LineGeometry.h"
+#include "pockets/gl/LineSegments.h"
+#include "pockets/gl/LineSimplify.h"
+#include "pockets/gl/PackedLineGeometry.h"
+
+// class templates are only checked once instantiated
+template class pockets::slot_map<int>;
+CHECK
+
+echo "Done"
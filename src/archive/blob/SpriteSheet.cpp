@@ -62,11 +62,8 @@ SpriteSheet::SpriteSheet( const Surface &images, const JsonTree &description, Pa
 {
   gl::Texture::Format format;
   mTexture = gl::Texture( images, format );
-  SpriteDataCollection sprite_info = parse( description );
-  for( auto &pair : sprite_info )
-  {
-    mSpriteData[pair.first] = pair.second;
-  }
+  // built once, so sort all the sprites in one go
+  mSpriteData = flat_map<string, SpriteData>( parse( description ) );
 }
 
 SpriteSheet::~SpriteSheet()
@@ -122,7 +119,7 @@ void SpriteSheet::enableAndBind()
 
 void SpriteSheet::draw(const string &sprite_name, const vec2 &loc)
 {
-  draw( mSpriteData[sprite_name], loc );
+  draw( getSpriteData( sprite_name ), loc );
 }
 void SpriteSheet::draw( const SpriteData &sprite, const vec2 &loc )
 {
@@ -135,7 +132,7 @@ void SpriteSheet::draw( const SpriteData &sprite, const vec2 &loc )
 
 void SpriteSheet::drawScrolled(const string &sprite_name, const vec2 &loc, const vec2 &offsets)
 {
-  drawScrolled( mSpriteData[sprite_name], loc, offsets );
+  drawScrolled( getSpriteData( sprite_name ), loc, offsets );
 }
 
 void SpriteSheet::drawScrolled( const SpriteData &sprite, const vec2 &loc, const vec2 &offsets )
@@ -31,6 +31,7 @@
 #include "cinder/Json.h"
 #include "Pockets.h"
 #include "CollectionUtilities.hpp"
+#include "pockets/FlatMap.h"
 #include "Sprite.h"
 
 /**
@@ -64,7 +65,11 @@ namespace pockets
     //! returns a collection of all the sprites names; not in any order
     std::vector<std::string>  getSpriteNames(){ return map_keys( mSpriteData ); }
     //! get information about the named sprite. Returns a default-constructed sprite if none of that name exists.
-    inline const SpriteData&  getSpriteData( const std::string &sprite_name ) const { return mSpriteData[sprite_name]; }
+    inline const SpriteData&  getSpriteData( const std::string &sprite_name ) const 
+    {
+      auto iter = mSpriteData.find( sprite_name );
+      return iter != mSpriteData.end() ? iter->second : mDefaultSpriteData;
+    }
     //! return a Sprite built from the data with \a sprite_name
     inline Sprite getSprite( const std::string &sprite_name ) const { return Sprite( getSpriteData(sprite_name) ); }
     inline SpriteRef getSpriteRef( const std::string &sprite_name ) const { return SpriteRef( new Sprite( getSpriteData(sprite_name) ) ); }
@@ -94,7 +99,8 @@ namespace pockets
     static SpriteSheetRef  load( const ci::fs::path &base_path );
   private:
     // map name to texture coordinates
-    mutable std::map<std::string, SpriteData>   mSpriteData;
+    flat_map<std::string, SpriteData>   mSpriteData;
+    SpriteData                          mDefaultSpriteData;
     // TODO: create collection of animations from data
     //  std::map<std::string, SpriteAnimation>
     ci::gl::Texture                     mTexture;
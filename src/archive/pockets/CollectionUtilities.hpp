@@ -32,6 +32,8 @@
 */
 
 #include "Pockets.h"
+#include <algorithm>
+#include <functional>
 #include <map>
 
 namespace pockets
@@ -55,11 +57,13 @@ namespace pockets
 	}
 
   //! Return a vector of all the keys in a map
-  template<typename K, typename V>
-  std::vector<K> map_keys( const std::map<K, V> &map )
+  //! Works with any map type that iterates over key-value pairs, e.g. std::map or pockets::flat_map
+  template<typename MAP_TYPE>
+  std::vector<typename MAP_TYPE::key_type> map_keys( const MAP_TYPE &map )
   {
-    std::vector<K> ret;
-    for( auto &pair : map )
+    std::vector<typename MAP_TYPE::key_type> ret;
+    ret.reserve( map.size() );
+    for( const auto &pair : map )
     {
       ret.push_back( pair.first );
     }
@@ -99,6 +103,98 @@ namespace pockets
                , vec->end() );
   }
 
+  //! Remove element at \a index from \a vec by swapping it with the last element.
+  //! Constant time, but does not preserve the order of the remaining elements.
+  template<class ELEMENT_TYPE>
+  void unordered_remove_at( std::vector<ELEMENT_TYPE> *vec, size_t index )
+  {
+    if( index + 1 != vec->size() )
+    {
+      (*vec)[index] = std::move( vec->back() );
+    }
+    vec->pop_back();
+  }
+
+  //! Remove the first copy of \a element from \a vec without preserving order.
+  //! Returns true if an element was removed.
+  template<class ELEMENT_TYPE>
+  bool unordered_remove( std::vector<ELEMENT_TYPE> *vec, const ELEMENT_TYPE &element )
+  {
+    auto iter = std::find( vec->begin(), vec->end(), element );
+    if( iter == vec->end() )
+    {
+      return false;
+    }
+    unordered_remove_at( vec, std::distance( vec->begin(), iter ) );
+    return true;
+  }
+
+  //! Remove every element of \a vec that is in \a elements, in a single pass.
+  //! \a elements may be any container with a count() method, e.g. std::set or std::unordered_set.
+  //! Preserves the order of the remaining elements.
+  template<class ELEMENT_TYPE, class SET_TYPE>
+  void remove_all_of( std::vector<ELEMENT_TYPE> *vec, const SET_TYPE &elements )
+  {
+    if( elements.empty() )
+    {
+      return;
+    }
+    vec->erase( std::remove_if( vec->begin()
+                               , vec->end()
+                               , [&elements](const ELEMENT_TYPE &e){ return elements.count( e ) != 0; } )
+               , vec->end() );
+  }
+
+  //! Remove every element of \a vec that is in \a elements.
+  //! Both collections must be sorted by \a compare; they are walked together in a single merge pass.
+  //! Preserves the order of the remaining elements.
+  template<class ELEMENT_TYPE, class SORTED_TYPE, class COMPARATOR = std::less<ELEMENT_TYPE>>
+  void sorted_remove_all_of( std::vector<ELEMENT_TYPE> *vec, const SORTED_TYPE &elements, COMPARATOR compare = COMPARATOR() )
+  {
+    auto remove = elements.begin();
+    auto write = vec->begin();
+    for( auto read = vec->begin(); read != vec->end(); ++read )
+    {
+      while( remove != elements.end() && compare( *remove, *read ) )
+      {
+        ++remove;
+      }
+      if( remove != elements.end() && ! compare( *read, *remove ) )
+      { // equivalent to an element in the removal set
+        continue;
+      }
+      if( write != read )
+      {
+        *write = std::move( *read );
+      }
+      ++write;
+    }
+    vec->erase( write, vec->end() );
+  }
+
+  //! Sort \a elements, then remove them from the sorted vector \a vec in a single merge pass.
+  template<class ELEMENT_TYPE, class COMPARATOR = std::less<ELEMENT_TYPE>>
+  void sorted_remove_all_of( std::vector<ELEMENT_TYPE> *vec, std::vector<ELEMENT_TYPE> &&elements, COMPARATOR compare = COMPARATOR() )
+  {
+    std::sort( elements.begin(), elements.end(), compare );
+    sorted_remove_all_of( vec, static_cast<const std::vector<ELEMENT_TYPE>&>( elements ), compare );
+  }
+
+  //! Take \a element back out of the pending \a removals queued for \a vec.
+  //! An element removed and re-added before the batch is flushed is still in \a vec,
+  //! so its stale copy is erased there too; the caller can then insert it afresh without drawing it twice.
+  //! Returns true if a removal was pending.
+  template<class ELEMENT_TYPE, class SET_TYPE>
+  bool cancel_removal( std::vector<ELEMENT_TYPE> *vec, SET_TYPE *removals, const ELEMENT_TYPE &element )
+  {
+    if( removals->erase( element ) == 0 )
+    {
+      return false;
+    }
+    vector_remove( vec, element );
+    return true;
+  }
+
   //! Returns true if \a vec contains the element \a compare
   template<class ELEMENT_TYPE>
   bool vector_contains( const std::vector<ELEMENT_TYPE> &vec, const ELEMENT_TYPE &compare )
@@ -26,15 +26,83 @@
  */
 
 #include "ImagePacker.h"
+#include "pockets/StringUtilities.h"
+#include "pockets/Parallel.h"
+#include "pockets/PixelKernels.h"
 #include "cinder/Text.h"
 #include "cinder/ip/Trim.h"
-#include "cinder/ip/Fill.h"
-#include "cinder/ip/Premultiply.h"
+#include <cstring>
+#include <functional>
 
 using namespace ci;
 using namespace std;
 using namespace pockets;
 
+namespace
+{
+  // Glyphs rendered per layout pass. Keeps each batch surface within texture size limits.
+  const size_t GlyphBatchSize = 256;
+
+  // C0 and C1 control codes and DEL have no glyph to draw
+  bool isControl( char32_t c )
+  {
+    return c < 0x20 || ( c >= 0x7F && c <= 0x9F );
+  }
+
+  // Advance width of each of \a glyphs, from one layout for the whole batch. Each glyph is set with a bar after it;
+  // the bar's right edge lands one advance further right than on the final line, where the bar stands alone.
+  // Lines are spaced as in ImagePacker::addGlyphBatch, so ink overshooting a line stays out of the next measurement.
+  vector<int> glyphAdvances( const Font &font, const u32string &glyphs )
+  {
+    TextLayout layout;
+    layout.clear( ColorA( 0, 0, 0, 0 ) );
+    layout.setFont( font );
+    layout.setColor( ColorA::white() );
+    layout.addLine( " " );
+    for( auto glyph : glyphs )
+    {
+      layout.addLine( ( isControl( glyph ) ? string() : utf8_encode( glyph ) ) + "|" );
+      layout.addLine( " " );
+    }
+    layout.addLine( "|" );
+    layout.addLine( " " );
+    Surface sheet = layout.render( true, false );
+
+    const float line_height = (float)sheet.getHeight() / ( 2 * glyphs.size() + 3 );
+    auto bar_right = [&]( size_t line ) {
+      const Area cell( 0, (int)lround( ( line - 0.5f ) * line_height ), sheet.getWidth(), (int)lround( ( line + 1.5f ) * line_height ) );
+      return ip::findNonTransparentArea( sheet, cell ).x2;
+    };
+    const int alone = bar_right( 2 * glyphs.size() + 1 );
+    vector<int> advances( glyphs.size() );
+    for( size_t i = 0; i < glyphs.size(); ++i )
+    {
+      advances[i] = math<int>::max( bar_right( 2 * i + 1 ) - alone, 0 );
+    }
+    return advances;
+  }
+
+  // Copy of \a surface cropped to its non-transparent area. 8-bit surfaces with alpha are scanned with a SIMD kernel.
+  Surface trimmed( const Surface &surface )
+  {
+    Area bounds;
+    if( surface.hasAlpha() && surface.getPixelInc() == 4 )
+    {
+      const auto b = alpha_bounds_rgba8( surface.getData(), surface.getWidth(), surface.getHeight(), surface.getRowBytes(), surface.getChannelOrder().getAlphaOffset() );
+      bounds = Area( b.x1, b.y1, b.x2, b.y2 );
+    }
+    else
+    {
+      bounds = ip::findNonTransparentArea( surface, surface.getBounds() );
+    }
+    assert( bounds.getWidth() <= surface.getWidth() );
+    assert( bounds.getHeight() <= surface.getHeight() );
+    Surface trimmed_copy( bounds.getWidth(), bounds.getHeight(), true, SurfaceChannelOrder::RGBA );
+    trimmed_copy.copyFrom( surface, bounds, -bounds.getUL() );
+    return trimmed_copy;
+  }
+}
+
 ImagePacker::ImagePacker()
 {}
 
@@ -45,23 +113,92 @@ ImagePacker::ImageDataRef ImagePacker::addImage( const std::string &id, ci::Surf
 {
   if( trim_alpha )
   {
-    Area bounds = ip::findNonTransparentArea( surface, surface.getBounds() );
-    assert( bounds.getWidth() <= surface.getWidth() );
-    assert( bounds.getHeight() <= surface.getHeight() );
-    Surface trimmed_copy( bounds.getWidth(), bounds.getHeight(), true, SurfaceChannelOrder::RGBA );
-    trimmed_copy.copyFrom( surface, bounds, -bounds.getUL() );
-    surface = trimmed_copy;
+    surface = trimmed( surface );
   }
   mImages.push_back( make_shared<ImageData>( surface, id ) );
   return mImages.back();
 }
 
+vector<ImagePacker::ImageDataRef> ImagePacker::addImages( const vector<pair<string, Surface>> &images, bool trim_alpha, size_t thread_count )
+{
+  vector<Surface> surfaces( images.size() );
+  // each image is trimmed on its own, so the frames of long animations can be split across threads
+  parallel_for_chunks( images.size(), thread_count, [&]( size_t begin, size_t end, size_t ) {
+    for( size_t i = begin; i < end; ++i )
+    {
+      surfaces[i] = trim_alpha ? trimmed( images[i].second ) : images[i].second;
+    }
+  } );
+
+  vector<ImageDataRef> ret;
+  ret.reserve( images.size() );
+  for( size_t i = 0; i < images.size(); ++i )
+  {
+    ret.push_back( addImage( images[i].first, surfaces[i] ) );
+  }
+  return ret;
+}
+
 vector<ImagePacker::ImageDataRef> ImagePacker::addGlyphs( const ci::Font &font, const string &glyphs, const string &id_prefix, bool trim_alpha )
+{
+  const auto code_points = utf8_decode( glyphs );
+  vector<ImageDataRef> ret;
+  ret.reserve( code_points.size() );
+  for( size_t begin = 0; begin < code_points.size(); begin += GlyphBatchSize )
+  {
+    const auto count = std::min( GlyphBatchSize, code_points.size() - begin );
+    auto batch = addGlyphBatch( font, code_points.substr( begin, count ), id_prefix, trim_alpha );
+    ret.insert( ret.end(), batch.begin(), batch.end() );
+  }
+  return ret;
+}
+
+vector<ImagePacker::ImageDataRef> ImagePacker::addGlyphBatch( const ci::Font &font, const u32string &glyphs, const string &id_prefix, bool trim_alpha )
 {
   vector<ImageDataRef> ret;
-  for( const char glyph : glyphs )
+  if( glyphs.empty() ) {
+    return ret;
+  }
+
+  // A blank line above and below every glyph leaves room for ink that overshoots its line
+  // (accents, combining marks, emoji), so no glyph reaches into its neighbor's cell.
+  TextLayout layout;
+  layout.clear( ColorA( 0, 0, 0, 0 ) );
+  layout.setFont( font );
+  layout.setColor( ColorA::white() );
+  layout.addLine( " " );
+  for( auto glyph : glyphs )
   {
-    ret.push_back( addString( id_prefix + toString<char>(glyph), font, toString<char>(glyph), trim_alpha ));
+    layout.addLine( utf8_encode( glyph ) );
+    layout.addLine( " " );
+  }
+  Surface sheet = layout.render( true, false );
+  const auto advances = trim_alpha ? vector<int>() : glyphAdvances( font, glyphs );
+
+  // Every line shares a font, so lines are evenly spaced down the sheet.
+  // Glyph i sits on line 2i + 1; its cell reaches halfway into the blank lines around it.
+  const float line_height = (float)sheet.getHeight() / ( 2 * glyphs.size() + 1 );
+  for( size_t i = 0; i < glyphs.size(); ++i )
+  {
+    const auto glyph = utf8_encode( glyphs[i] );
+    const Area cell( 0, (int)lround( ( 2 * i + 0.5f ) * line_height ), sheet.getWidth(), (int)lround( ( 2 * i + 2.5f ) * line_height ) );
+    const Area ink = ip::findNonTransparentArea( sheet, cell );
+
+    if( isControl( glyphs[i] ) || ink.getWidth() <= 0 || ink.getHeight() <= 0 )
+    { // control characters and whitespace have no ink to measure, so render them alone
+      ret.push_back( addString( id_prefix + glyph, font, glyph, trim_alpha ) );
+      continue;
+    }
+
+    Area bounds = ink;
+    if( ! trim_alpha )
+    { // match a glyph rendered alone: its own line, as wide as its advance (or its ink, if that runs further)
+      const int right = math<int>::min( math<int>::max( advances[i], ink.x2 ), sheet.getWidth() );
+      bounds = Area( 0, (int)lround( ( 2 * i + 1 ) * line_height ), right, (int)lround( ( 2 * i + 2 ) * line_height ) );
+    }
+    Surface image( bounds.getWidth(), bounds.getHeight(), true, SurfaceChannelOrder::RGBA );
+    image.copyFrom( sheet, bounds, -bounds.getUL() );
+    ret.push_back( addImage( id_prefix + glyph, image ) );
   }
   return ret;
 }
@@ -87,12 +224,23 @@ JsonTree ImagePacker::surfaceDescription()
   metaData.pushBack( JsonTree("created_by", "David Wicks' pockets::ImagePacker") );
   metaData.pushBack( JsonTree("width", mWidth ) );
   metaData.pushBack( JsonTree("height", mHeight ) );
+  JsonTree pages = JsonTree::makeArray("pages");
+  for( uint32_t height : mPageHeights )
+  {
+    JsonTree page;
+    page.pushBack( JsonTree("width", mWidth ) );
+    page.pushBack( JsonTree("height", height ) );
+    pages.pushBack( page );
+  }
+  metaData.pushBack( pages );
   description.pushBack( metaData );
 
   JsonTree sprites = JsonTree::makeArray("sprites");
   for( ImageDataRef sprite : mImages )
   {
-    sprites.pushBack( sprite->toJson() );
+    if( sprite->isPlaced() ) {
+      sprites.pushBack( sprite->toJson() );
+    }
   }
   description.pushBack( sprites );
 
@@ -101,112 +249,109 @@ JsonTree ImagePacker::surfaceDescription()
 
 Surface ImagePacker::packedSurface( bool premultiply )
 {
-  Surface output( mWidth, mHeight, true, SurfaceChannelOrder::RGBA );
-  ip::fill( &output, ColorA( 0, 0, 0, 0 ) );
-  for( ImageDataRef sprite : mImages )
-  {
-    output.copyFrom( sprite->getSurface(), sprite->getBounds(), sprite->getLoc() );
-  }
+  return packedPage( 0, premultiply, 0 );
+}
+
+vector<Surface> ImagePacker::packedSurfaces( bool premultiply, size_t thread_count )
+{
+  vector<Surface> pages( mPageHeights.size() );
+  // with enough pages, build each on its own thread; otherwise share the threads within each page
+  const auto threads = resolve_thread_count( thread_count );
+  const bool page_parallel = pages.size() >= threads;
+  parallel_for_chunks( pages.size(), page_parallel ? threads : 1, [&]( size_t begin, size_t end, size_t ) {
+    for( size_t page = begin; page < end; ++page )
+    {
+      pages[page] = packedPage( page, premultiply, page_parallel ? 1 : threads );
+    }
+  } );
+  return pages;
+}
+
+Surface ImagePacker::packedPage( size_t page, bool premultiply, size_t thread_count )
+{
+  Surface output( mWidth, mPageHeights.at( page ), true, SurfaceChannelOrder::RGBA );
+  const size_t row_bytes = output.getRowBytes();
+  uint8_t *pixels = output.getData();
+  auto for_rows = [&]( const function<void ( size_t begin, size_t end )> &fn ) {
+    parallel_for_chunks( output.getHeight(), thread_count, [&]( size_t begin, size_t end, size_t ) { fn( begin, end ); } );
+  };
+  for_rows( [&]( size_t begin, size_t end ) {
+    memset( pixels + begin * row_bytes, 0, ( end - begin ) * row_bytes );
+  } );
+
+  // sprites placed on a page never overlap, so threads can copy their share of them straight into the output;
+  // unplaced sprites have no page and are left out
+  vector<ImageDataRef> sprites;
+  copy_if( mImages.begin(), mImages.end(), back_inserter( sprites ), [page]( const ImageDataRef &sprite ) { return sprite->isPlaced() && sprite->getPage() == (int)page; } );
+  parallel_for_chunks( sprites.size(), thread_count, [&]( size_t begin, size_t end, size_t ) {
+    for( size_t i = begin; i < end; ++i )
+    {
+      output.copyFrom( sprites[i]->getSurface(), sprites[i]->getBounds(), sprites[i]->getLoc() );
+    }
+  } );
+
   // XCode premultiplies anything going to an iOS device (ignores flag telling it not to)
   // Double-premultiplication makes everything have dark edges
   // So we'll just premultiply on the client side if the graphics aren't already
   if( premultiply )
   {
-    ip::premultiply( &output );
+    for_rows( [&]( size_t begin, size_t end ) {
+      premultiply_rgba8( pixels + begin * row_bytes, output.getWidth(), (int)( end - begin ), row_bytes );
+    } );
+    // as ip::premultiply would, so the surface isn't treated as straight alpha downstream
+    output.setPremultiplied( true );
   }
   return output;
 }
 
 void ImagePacker::calculatePositions( const ci::ivec2 &padding, const int width )
 {
-  //  auto rev_area_compare = []( const ImageData &lhs, const ImageData &rhs )
-  //  {
-  //    return lhs.getBounds().calcArea() > rhs.getBounds().calcArea();
-  //  };
-  auto rev_height_compare = []( const ImageDataRef &lhs, const ImageDataRef &rhs )
-  {
-    return lhs->getBounds().getHeight() > rhs->getBounds().getHeight();
-  };
-  sort( mImages.begin(), mImages.end(), rev_height_compare );
-  ivec2 loc( 0, 0 );
-  int bottom_y = 0;
-  for( ImageDataRef sprite : mImages )
-  {
-    if( loc.x + sprite->getBounds().getWidth() > width )
-    {
-      loc.y = bottom_y + padding.y;
-      loc.x = 0;
-    }
-    sprite->setLoc( loc );
-    loc.x += sprite->getBounds().getWidth() + padding.x;
-    bottom_y = math<int>::max( sprite->getBounds().getHeight() + loc.y, bottom_y );
-  }
-  mWidth = width;
-  mHeight = math<int>::max( bottom_y, width );
+  calculatePositions( padding, width, PackingAlgorithm::Shelf );
 }
 
 void ImagePacker::calculatePositionsScanline( const ivec2 &padding, const int width )
 {
-  // auto rev_area_compare = []( const ImageDataRef &lhs, const ImageDataRef &rhs )
-  // {
-  //   return lhs->getBounds().calcArea() > rhs->getBounds().calcArea();
-  // }
-  auto rev_height_compare = []( const ImageDataRef &lhs, const ImageDataRef &rhs )
+  calculatePositions( padding, width, PackingAlgorithm::MaxRects );
+}
+
+void ImagePacker::calculatePositions( const ci::ivec2 &padding, const int width, PackingAlgorithm algorithm )
+{
+  // pad every image on its right and bottom, and widen the sheet to match, so only gaps between images are padded
+  vector<PackSize> sizes;
+  sizes.reserve( mImages.size() );
+  for( ImageDataRef sprite : mImages )
   {
-    return lhs->getBounds().getHeight() > rhs->getBounds().getHeight();
-  };
-  sort( mImages.begin(), mImages.end(), rev_height_compare );
-  int bottom_y = 0;
-  // place largest image at top-left
-  mImages.at( 0 )->setLoc( padding );
-
-  for( int i = 1; i < mImages.size(); ++i )
-  { // for each following image, start at top-left and look on each
-    // pixel row for a potential free space
-    ivec2 loc{ padding };
-    auto img = mImages.at( i );
-
-    // if we would never fit on the page, we need to issue a warning
-    if( (img->getWidth() + padding.x * 2) > width ) {
-      app::console() << "WARNING: Source image too wide. Omitting " << img->getId() << endl;
+    sizes.push_back( PackSize{ sprite->getWidth() + padding.x, sprite->getHeight() + padding.y } );
+  }
+  const bool paged = mMaxPageHeight > 0;
+  auto placements = paged ? pack_pages( sizes, width + padding.x, mMaxPageHeight + padding.y, algorithm )
+                          : pack_rects( sizes, width + padding.x, UnboundedPackHeight, algorithm );
+
+  vector<int> bottoms( 1, 0 );
+  for( size_t i = 0; i < mImages.size(); ++i )
+  {
+    auto sprite = mImages[i];
+    const auto &placement = placements[i];
+    if( ! placement.placed )
+    { // forget any earlier placement so the image is left out of every page
+      app::console() << "WARNING: Source image too large for a page. Omitting " << sprite->getId() << endl;
+      sprite->setPage( -1 );
       continue;
     }
-
-    bool placed = false;
-    while ( !placed )
-    {
-      for( int j = 0; j < i; ++j )
-      { // check whether we're inside the bounds of any previously placed image (including padding)
-        auto bounds = mImages.at( j )->getPlacedBounds().inflated( padding );
-        if( bounds.contains( loc ) )
-        { // jump to right edge of image
-          loc.x = bounds.getX2();
-        }
-      }
-
-      if( loc.x + img->getWidth() < width - padding.x )
-      { // we fit on the page, though we may still overlap other images
-        // tentatively set the image location here
-        img->setLoc( loc );
-        placed = true;
-        // shrink potential bounds by one, since sharing a vertex counts as Rectf intersecting
-        auto potential_bounds = img->getPlacedBounds().inflated( { -1, -1 } );
-        for( int j = 0; j < i; ++j )
-        { // check that the placed boundaries don't overlap any other placed image
-          auto bounds = mImages.at( j )->getPlacedBounds().inflated( padding );
-          if( potential_bounds.intersects( bounds ) )
-          { // a collision was found, so we'll continue the loop
-            placed = false;
-          }
-        }
-        bottom_y = math<int>::max( img->getBounds().getHeight() + loc.y, bottom_y );
-      }
-      // move to next row of pixels for continued evaluation
-      loc.x = padding.x;
-      loc.y += 1;
+    sprite->setLoc( ivec2( placement.x, placement.y ) );
+    sprite->setPage( placement.page );
+    if( placement.page >= (int)bottoms.size() ) {
+      bottoms.resize( placement.page + 1, 0 );
     }
+    bottoms[placement.page] = math<int>::max( placement.y + sprite->getHeight(), bottoms[placement.page] );
+  }
+
+  // pages are at least square, as a single sheet always was, but never above the limit
+  const int min_height = paged ? math<int>::min( width, mMaxPageHeight ) : width;
+  mPageHeights.clear();
+  for( int bottom : bottoms ) {
+    mPageHeights.push_back( math<int>::max( bottom, min_height ) );
   }
   mWidth = width;
-  mHeight = math<int>::max( bottom_y, width );
+  mHeight = mPageHeights.front();
 }
-
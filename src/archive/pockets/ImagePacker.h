@@ -27,6 +27,7 @@
 
 #pragma once
 #include "Pockets.h"
+#include "pockets/RectPacking.h"
 #include "cinder/Json.h"
 #include "cinder/Surface.h"
 #include "cinder/Rect.h"
@@ -38,7 +39,7 @@ namespace pockets
 /**
  Simple image packing
  Places all elements, largest-first, into a single Surface
- Height expands to fit
+ Height expands to fit, or, with a maximum page height, spills onto further pages
 
  Though spritesheet generation is generally an offline task, it
  could be useful for things like super-8-style-recording and gif-playback
@@ -63,6 +64,10 @@ class ImagePacker
     const ci::Surface&  getSurface() const { return mSurface; }
     ci::ivec2           getLoc() const { return mLoc; }
     void                setLoc( const ci::ivec2 &loc ){ mLoc = loc; }
+    //! index of the packed surface the image is placed on, or -1 until it has been placed
+    int                 getPage() const { return mPage; }
+    void                setPage( int page ){ mPage = page; }
+    bool                isPlaced() const { return mPage >= 0; }
     void                setRegistrationPoint( const ci::ivec2 &reg ){ mRegistrationPoint = reg; }
     ci::ivec2           getRegistrationPoint() const { return mRegistrationPoint; }
     ci::ivec2           getSize() const { return mSurface.getSize(); }
@@ -83,6 +88,7 @@ class ImagePacker
       tree.pushBack( JsonTree( "y2", mLoc.y + getBounds().getHeight() ) );
       tree.pushBack( JsonTree( "rx", mRegistrationPoint.x ) );
       tree.pushBack( JsonTree( "ry", mRegistrationPoint.y ) );
+      tree.pushBack( JsonTree( "page", mPage ) );
       if( mUserData.hasChildren() ) {
         tree.pushBack( mUserData );
       }
@@ -93,6 +99,7 @@ class ImagePacker
     ci::Surface     mSurface;
     ci::ivec2       mLoc;
     ci::ivec2       mRegistrationPoint;
+    int             mPage = -1;
     std::string     mId;
   };
   typedef std::shared_ptr<ImageData> ImageDataRef;
@@ -102,36 +109,66 @@ class ImagePacker
   //! add an image to the sheet. If \a trim_alpha, trims image bounds to non-alpha area
   ImageDataRef              addImage( const std::string &id, ci::Surface surface, bool trim_alpha=false );
 
+  //! add many (id, image) pairs, e.g. the frames of an animation, trimming them in parallel on up to
+  //! \a thread_count threads (zero means one per core). Images are added in order.
+  std::vector<ImageDataRef> addImages( const std::vector<std::pair<std::string, ci::Surface>> &images, bool trim_alpha=false, size_t thread_count=0 );
+
   //! add the specified glyphs from a font; id is equal to the character, e.g. "a"
+  //! \a glyphs is UTF-8 encoded. Glyphs are rasterized in batches, one padded line per glyph,
+  //! and sliced from the rendered batch. Untrimmed glyphs keep their line height and advance width.
   std::vector<ImageDataRef> addGlyphs( const ci::Font &font, const std::string &glyphs, const std::string &id_prefix="", bool trim_alpha=false );
 
   //! add the specified string set in a font
   ImageDataRef              addString( const std::string &id, const ci::Font &font, const std::string &str, bool trim_alpha=false );
 
-  //! assign positions to images
+  //! assign positions to images in rows, tallest first
   void                      calculatePositions( const ci::ivec2 &padding, const int width=1024 );
 
-  //! use a scanline algorithm to calculate positions (slower to run, more compact)
+  //! assign positions to images with \a algorithm; \a padding separates neighboring images.
+  //! Images too large for a page are left unplaced, with a warning, and omitted from the output.
+  void                      calculatePositions( const ci::ivec2 &padding, const int width, PackingAlgorithm algorithm );
+
+  //! calculate positions with MaxRects (slower to run, more compact)
   void                      calculatePositionsScanline( const ci::ivec2 &padding, const int width=1024 );
 
-  //! generates a surface containing all added images in their packed locations
+  //! limit the height of each packed surface, e.g. to the largest texture size; zero means no limit.
+  //! Images that don't fit on one page spill onto the next when positions are calculated.
+  void                      setMaxPageHeight( int height ) { mMaxPageHeight = height; }
+  int                       getMaxPageHeight() const { return mMaxPageHeight; }
+  //! number of packed surfaces from the last position calculation
+  size_t                    pageCount() const { return mPageHeights.size(); }
+
+  //! generates a surface containing all added images in their packed locations on the first page
   //! premultiply unless you are using this spritesheet on iOS, in which case XCode will do that later
   ci::Surface               packedSurface( bool premultiply=false );
+  //! generates the surface for \a page, clearing, compositing and premultiplying on up to \a thread_count threads
+  ci::Surface               packedPage( size_t page, bool premultiply=false, size_t thread_count=0 );
+  //! generates every page's surface on up to \a thread_count threads (zero means one per core),
+  //! one page per thread when there are enough pages to go around
+  std::vector<ci::Surface>  packedSurfaces( bool premultiply=false, size_t thread_count=0 );
 
   //! returns a JSON-formatted description of all images and their packed locations
+  //! meta lists the size of each page; each placed sprite names its page
   ci::JsonTree              surfaceDescription();
 
-  //! remove all images from packer
-  void                      clear() { mImages.clear(); }
+  //! remove all images from packer, leaving a single empty page
+  void                      clear() { mImages.clear(); mPageHeights = { 1 }; mHeight = 1; }
 
   // Collection traversal.
   std::vector<ImageDataRef>::iterator begin(){ return mImages.begin(); }
   std::vector<ImageDataRef>::iterator end(){ return mImages.end(); }
 private:
+  //! render \a glyphs in a single layout pass and add each as a separate image
+  std::vector<ImageDataRef> addGlyphBatch( const ci::Font &font, const std::u32string &glyphs, const std::string &id_prefix, bool trim_alpha );
+
   //! width should be set to maximum desired width
   uint32_t                  mWidth = 1024;
   //! height expands as elements are added
   uint32_t                  mHeight = 1;
+  //! zero for a single page of unlimited height
+  int                       mMaxPageHeight = 0;
+  //! height of each page; the first matches mHeight
+  std::vector<uint32_t>     mPageHeights = { 1 };
   std::vector<ImageDataRef> mImages;
 };
 } // ns pockets
\ No newline at end of file
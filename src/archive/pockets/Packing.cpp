@@ -26,57 +26,51 @@
  */
 
 #include "Packing.h"
+#include <cmath>
+#include <stdexcept>
 
 using namespace std;
 using namespace cinder;
 using namespace pockets;
 
 size_t ScanlinePacker::pushRect( Rectf rect )
-{	// TODO: better error handling
-	assert( rect.getWidth() < mConstraints.x );
-	if( rect.getUpperLeft() != vec2( 0 ) )
-	{
-		rect -= rect.getUpperLeft();
+{
+	if( mRectangles.empty() )
+	{	// keep a padding's width clear along every edge of the atlas
+		const int width = (int)( mConstraints.x - mPadding.x );
+		const int height = mConstraints.y == eUnconstrained ? UnboundedPackHeight : (int)( mConstraints.y - mPadding.y );
+		mSkyline = SkylinePacker( std::max( width, 0 ), std::max( height, 0 ) );
 	}
 
-	vec2 loc( mPadding );
-	bool placed = false;
-	while( !placed )
+	rect -= rect.getUpperLeft();
+	// each rectangle carries the padding above and to its left
+	const auto placement = mSkyline.insert( (int)ceil( rect.getWidth() + mPadding.x ), (int)ceil( rect.getHeight() + mPadding.y ) );
+	if( ! placement.placed )
 	{
-		for( const Rectf &r : mRectangles )
-		{
-			Rectf bounds = r.inflated( mPadding );
-			if( bounds.contains( loc ) )
-			{	// move to the outside edge of bounds
-				loc.x = bounds.getX2();
-			}
-		}
-		if( loc.x + rect.getWidth() < mConstraints.x - mPadding.x )
-		{	// probably placed, let's check our boundaries
-			placed = true;
-			Rectf potentialBounds = (rect + loc).inflated( vec2( -1.0f, -1.0f ) );
-			for( const Rectf &r : mRectangles )
-			{
-				Rectf bounds = r.inflated( mPadding );
-				if( potentialBounds.intersects( bounds ) )
-				{
-					placed = false;
-				}
-			}
-		}
-		if( !placed )
-		{	// move to next row for continued evaluation
-			loc.x = mPadding.x;
-			loc.y += mPadding.y;	// could vary this step to optimize for grid
-		}
-		else
-		{
-			rect += loc;
-			mRectangles.push_back( rect );
-		}
+		throw std::length_error( "ScanlinePacker: rectangle doesn't fit within the packing constraints." );
 	}
+
+	rect += vec2( placement.x, placement.y ) + mPadding;
+	mRectangles.push_back( rect );
 	return mRectangles.size() - 1;
 }
 
+vector<Rectf> pockets::placeRects( const vector<Rectf> &rectangles, float containerWidth, PackingAlgorithm algorithm )
+{
+	vector<PackSize> sizes;
+	sizes.reserve( rectangles.size() );
+	for( const Rectf &r : rectangles )
+	{
+		sizes.push_back( PackSize{ (int)ceil( r.getWidth() ), (int)ceil( r.getHeight() ) } );
+	}
+	auto placements = pack_rects( sizes, (int)containerWidth, UnboundedPackHeight, algorithm );
 
-
+	vector<Rectf> located;
+	located.reserve( rectangles.size() );
+	for( size_t i = 0; i < rectangles.size(); ++i )
+	{
+		const Rectf &r = rectangles[i];
+		located.push_back( r - r.getUpperLeft() + vec2( placements[i].x, placements[i].y ) );
+	}
+	return located;
+}
@@ -28,6 +28,7 @@
 #pragma once
 
 #include "Pockets.h"
+#include "pockets/RectPacking.h"
 #include "cinder/Rect.h"
 
 namespace pockets
@@ -57,7 +58,9 @@ namespace pockets
 
 	 An online rectangle packer.
 	 Pushing a rectangle into the collection adds it.
-	 Need some kind of id system before allowing removal of objects.
+	 Placement rests each rectangle on a skyline of those already packed (see pockets::SkylinePacker),
+	 so insertion cost depends on the atlas width, not on how many rectangles it holds.
+	 Rectangles can't be removed; for atlases that free space again, use pockets::AtlasAllocator.
 	 */
 	class ScanlinePacker
 	{
@@ -71,10 +74,11 @@ namespace pockets
 		mPadding( 8.0f, 8.0f )
 		{}
 		//! adds a new \a rect to the packing and returns its index
+		//! throws std::length_error if it doesn't fit within the constraints
 		size_t		pushRect( ci::Rectf rect );
 		//! returns the packed rectangle at \a index
 		ci::Rectf	getRect ( size_t index ) const { return mRectangles.at( index ); }
-		//! set the padding between rectangles
+		//! set the padding between rectangles and along the edges; the edge margin is fixed by the first push after a clear()
 		void		setPadding( float gap ) { mPadding = ci::vec2( gap, gap ); }
 		void		clear() { mRectangles.clear(); }
 		//! iterators for traversal through rectangles
@@ -82,11 +86,14 @@ namespace pockets
 		std::vector<ci::Rectf>::const_iterator end() const { return mRectangles.end(); }
 	private:
 		std::vector<ci::Rectf>	mRectangles;
+		//! reset on the first push after construction or clear(), once the padding is settled
+		SkylinePacker			mSkyline = SkylinePacker( 0 );
 		size_t					mLastPackedRect;
 		ci::vec2				mConstraints;
 		ci::vec2				mPadding;
 	};
 	//! from a list of rectangles, get a list of located rectangles such that
-	//! all fit in a space \a containerWidth wide
-	std::vector<ci::Rectf> placeRects( const std::vector<ci::Rectf> &rectangles, float containerWidth );
+	//! all fit in a space \a containerWidth wide. Sizes are rounded up to whole pixels.
+	//! Rectangles wider than the container are returned at the origin.
+	std::vector<ci::Rectf> placeRects( const std::vector<ci::Rectf> &rectangles, float containerWidth, PackingAlgorithm algorithm = PackingAlgorithm::Skyline );
 }
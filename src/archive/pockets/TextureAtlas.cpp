@@ -60,6 +60,8 @@ void TextureAtlas::parseDescription( const ci::JsonTree &description )
   JsonTree meta = description["meta"];
   ivec2 bitmap_size( meta["width"].getValue<int>(), meta["height"].getValue<int>() );
 
+  vector<pair<string, SpriteData>> data;
+  data.reserve( sprites.getNumChildren() );
   for( const auto &child : sprites )
   {
     Rectf bounds( child["x1"].getValue<int>(), child["y1"].getValue<int>(),
@@ -69,10 +71,12 @@ void TextureAtlas::parseDescription( const ci::JsonTree &description )
 
     string id = child["id"].getValue();
 
-    mData[ id ] = SpriteData{ { bounds.getUpperLeft() / vec2(bitmap_size), bounds.getLowerRight() / vec2(bitmap_size) },
+    data.emplace_back( id, SpriteData{ { bounds.getUpperLeft() / vec2(bitmap_size), bounds.getLowerRight() / vec2(bitmap_size) },
       bounds.getSize(),
-      registration_point };
+      registration_point } );
   }
+  // the atlas is read-only after loading, so sort all the sprites in one go
+  mData = flat_map<string, SpriteData>( std::move( data ) );
 }
 
 TextureAtlasUniqueRef TextureAtlas::create( const ci::Surface &images, const ci::JsonTree &description )
@@ -28,6 +28,7 @@
 #pragma once
 
 #include "pockets/Pockets.h"
+#include "pockets/FlatMap.h"
 #include "cinder/Surface.h"
 #include "cinder/gl/Texture.h"
 
@@ -90,9 +91,7 @@ namespace pockets
     //! returns SpriteData for the Nth texture in our map. Not guaranteed to match the order in json description.
     inline const SpriteData& get( size_t index ) const
     {
-      auto iter = mData.begin();
-      std::advance( iter, index % mData.size() );
-      return iter->second;
+      return mData.values()[index % mData.size()].second;
     }
 
     //! returns the texture where sprites are stored on GPU
@@ -104,7 +103,7 @@ namespace pockets
     //! create a new texture atlas from a surface and json description
     static TextureAtlasUniqueRef create( const ci::Surface &images, const ci::JsonTree &description );
   private:
-    std::map<std::string, SpriteData>   mData;
+    flat_map<std::string, SpriteData>   mData;
     ci::gl::TextureRef                  mTexture;
     SpriteData                          mErrorData;
 
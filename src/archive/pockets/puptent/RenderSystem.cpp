@@ -66,6 +66,10 @@ void RenderSystem::receive(const ComponentAddedEvent<RenderData> &event)
 {
   auto data = event.component;
   const RenderPass pass = data->pass;
+  for( int p = 0; p < NUM_RENDER_PASSES; ++p )
+  { // a pending removal means the stale entry is still listed; drop it before inserting at its current layer
+    cancel_removal( &mGeometry[p], &mRemovals[p], data );
+  }
   if( pass == PREMULTIPLIED )
   { // put element in correct sorted position
     int target_layer = data->render_layer;
@@ -110,7 +114,7 @@ void RenderSystem::checkOrdering() const
 void RenderSystem::receive(const ComponentRemovedEvent<RenderData> &event)
 {
   auto render_data = event.component;
-  vector_remove( &mGeometry[render_data->pass], render_data );
+  mRemovals[render_data->pass].insert( render_data );
 }
 
 void RenderSystem::receive(const EntityDestroyedEvent &event)
@@ -118,8 +122,8 @@ void RenderSystem::receive(const EntityDestroyedEvent &event)
   auto entity = event.entity;
   auto render_data = entity.component<RenderData>();
   if( render_data )
-  { // remove render component from our list
-    vector_remove( &mGeometry[render_data->pass], render_data );
+  { // remove render component from our list on next update
+    mRemovals[render_data->pass].insert( render_data );
   }
 }
 
@@ -127,8 +131,18 @@ namespace {
   const array<RenderPass, NUM_RENDER_PASSES> passes = { PREMULTIPLIED, ADD, MULTIPLY };
 } // anon::
 
+void RenderSystem::flushRemovals()
+{ // single pass per render pass regardless of how many entities were destroyed
+  for( const auto &pass : passes )
+  {
+    remove_all_of( &mGeometry[pass], mRemovals[pass] );
+    mRemovals[pass].clear();
+  }
+}
+
 void RenderSystem::update( EntityManagerRef es, EventManagerRef events, double dt )
 { // assemble vertices for each pass
+  flushRemovals();
   for( const auto &pass : passes )
   {
     auto &v = mVertices[pass];
@@ -32,6 +32,7 @@
 #include "pockets/puptent/RenderMeshComponent.h"
 #include "cinder/gl/VboMesh.h"
 #include "cinder/gl/Vbo.h"
+#include <unordered_set>
 
 namespace pockets
 { namespace puptent
@@ -124,7 +125,11 @@ namespace pockets
       inline void sort()
       { stable_sort( mGeometry[PREMULTIPLIED].begin(), mGeometry[PREMULTIPLIED].end(), &RenderSystem::layerSort ); }
     private:
+      //! remove all render data queued for removal since the last update
+      void        flushRemovals();
       std::array<std::vector<RenderDataRef>, NUM_RENDER_PASSES> mGeometry;
+      //! render data removed since the last update; erased from mGeometry in one pass
+      std::array<std::unordered_set<RenderDataRef>, NUM_RENDER_PASSES> mRemovals;
       std::array<std::vector<Vertex>, NUM_RENDER_PASSES>        mVertices;
       ci::gl::VboRef                            mVbo;
       ci::gl::VaoRef                            mAttributes;
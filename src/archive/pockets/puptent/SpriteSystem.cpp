@@ -44,6 +44,7 @@ _atlas( atlas )
 {
   try
   {
+    vector<pair<string, AnimationId>> ids;
     for( auto &anim : animations )
     {
       vector<Drawing> drawings;
@@ -55,8 +56,9 @@ _atlas( atlas )
         drawings.emplace_back( _atlas->get(child[0].getValue()), child[1].getValue<float>() );
       }
       _animations.emplace_back( Animation{ key, drawings, frame_duration } );
-      _animation_ids[key] = _animations.size() - 1;
+      ids.emplace_back( key, _animations.size() - 1 );
     }
+    _animation_ids = flat_map<string, AnimationId>( std::move( ids ) );
   }
   catch( JsonTree::Exception &exc )
   {
@@ -72,7 +74,7 @@ void SpriteAnimationSystem::configure( EventManagerRef events )
 void SpriteAnimationSystem::addAnimation(const string &name, const Animation &animation)
 {
   _animations.emplace_back( animation );
-  _animation_ids[name] = _animations.size() - 1;
+  _animation_ids.insert_or_assign( name, _animations.size() - 1 );
 }
 
 AnimationId SpriteAnimationSystem::getAnimationId( const string &name ) const
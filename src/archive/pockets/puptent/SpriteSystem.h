@@ -29,6 +29,7 @@
 #include "pockets/puptent/PupTent.h"
 #include "pockets/TextureAtlas.h"
 #include "pockets/CollectionUtilities.hpp"
+#include "pockets/FlatMap.h"
 
 namespace cinder
 {
@@ -106,7 +107,7 @@ namespace pockets
   private:
     TextureAtlasRef                     _atlas;
     // name : index into mAnimations
-    std::map<std::string, AnimationId>  _animation_ids;
+    flat_map<std::string, AnimationId>  _animation_ids;
     std::vector<Animation>              _animations;
   };
 
@@ -56,7 +56,7 @@ void ParticleSystem::receive( const ComponentAddedEvent<Particle> &event )
 
 void ParticleSystem::receive( const ComponentRemovedEvent<Particle> &event )
 {
-  vector_remove( &mParticles, event.entity );
+  unordered_remove( &mParticles, event.entity );
 }
 
 void ParticleSystem::receive( const ComponentAddedEvent<ParticleEmitter> &event )
@@ -66,7 +66,7 @@ void ParticleSystem::receive( const ComponentAddedEvent<ParticleEmitter> &event
 
 void ParticleSystem::receive( const ComponentRemovedEvent<ParticleEmitter> &event )
 {
-  vector_remove( &mEmitters, event.entity );
+  unordered_remove( &mEmitters, event.entity );
 }
 
 void ParticleSystem::receive( const EntityDestroyedEvent &event )
@@ -74,11 +74,11 @@ void ParticleSystem::receive( const EntityDestroyedEvent &event )
   auto entity = event.entity;
   if( entity.component<ParticleEmitter>() )
   {
-    vector_remove( &mEmitters, entity );
+    unordered_remove( &mEmitters, entity );
   }
   if( entity.component<Particle>() )
   {
-    vector_remove( &mParticles, entity );
+    unordered_remove( &mParticles, entity );
   }
 }
 
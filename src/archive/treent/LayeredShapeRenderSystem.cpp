@@ -107,6 +107,8 @@ void LayeredShapeRenderSystem::configure( EventManagerRef event_manager )
 void LayeredShapeRenderSystem::receive(const ComponentAddedEvent<LayeredShapeRenderData> &event)
 {
   auto data = event.component;
+  // a pending removal means the stale entry is still listed; drop it before inserting at its current layer
+  cancel_removal( &mGeometry, &mRemovals, data );
 
   { // put element in correct sorted position
     int target_layer = data->render_layer;
@@ -146,7 +148,7 @@ void LayeredShapeRenderSystem::checkOrdering() const
 void LayeredShapeRenderSystem::receive(const ComponentRemovedEvent<LayeredShapeRenderData> &event)
 {
   auto render_data = event.component;
-  vector_remove( &mGeometry, render_data );
+  mRemovals.insert( render_data );
 }
 
 void LayeredShapeRenderSystem::receive(const EntityDestroyedEvent &event)
@@ -154,13 +156,20 @@ void LayeredShapeRenderSystem::receive(const EntityDestroyedEvent &event)
   auto entity = event.entity;
   auto render_data = entity.component<LayeredShapeRenderData>();
   if( render_data )
-  { // remove render component from our list
-    vector_remove( &mGeometry, render_data );
+  { // remove render component from our list on next update
+    mRemovals.insert( render_data );
   }
 }
 
+void LayeredShapeRenderSystem::flushRemovals()
+{ // single pass regardless of how many entities were destroyed
+  remove_all_of( &mGeometry, mRemovals );
+  mRemovals.clear();
+}
+
 void LayeredShapeRenderSystem::update( EntityManagerRef es, EventManagerRef events, double dt )
 { // assemble vertices for each pass
+  flushRemovals();
   auto &v = mVertices;
   v.clear();
   for( const auto &pair : mGeometry )
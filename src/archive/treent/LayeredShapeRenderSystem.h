@@ -32,6 +32,7 @@
 #include "cinder/gl/Texture.h"
 #include "cinder/gl/VboMesh.h"
 #include "cinder/gl/Vbo.h"
+#include <unordered_set>
 
 namespace treent
 {
@@ -105,7 +106,11 @@ public:
   inline void sort()
   { stable_sort( mGeometry.begin(), mGeometry.end(), &LayeredShapeRenderSystem::layerSort ); }
 private:
+  //! remove all render data queued for removal since the last update
+  void                          flushRemovals();
   std::vector<LayeredShapeRenderDataRef>    mGeometry;
+  //! render data removed since the last update; erased from mGeometry in one pass
+  std::unordered_set<LayeredShapeRenderDataRef> mRemovals;
   std::vector<Vertex2D>         mVertices;
   ci::gl::VboRef                mVbo;
   ci::gl::VaoRef                mAttributes;
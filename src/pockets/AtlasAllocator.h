@@ -0,0 +1,378 @@
+/*
+ * Copyright (c) 2015 David Wicks, sansumbrella.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#pragma once
+#include "Pockets.h"
+#include "SlotMap.h"
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+namespace pockets {
+
+struct AtlasRect
+{
+  AtlasRect() = default;
+  AtlasRect(int x, int y, int width, int height)
+  : x(x),
+    y(y),
+    width(width),
+    height(height)
+  {}
+
+  int x = 0;
+  int y = 0;
+  int width = 0;
+  int height = 0;
+
+  int64_t area() const { return int64_t(width) * height; }
+};
+
+/// Identifies an allocation in an AtlasAllocator; stays valid when the allocation is moved.
+using AtlasId = slot_handle;
+
+/// Copy the pixels of allocation \a id from \a from to \a to. The two never overlap.
+struct AtlasMove
+{
+  AtlasId   id;
+  AtlasRect from;
+  AtlasRect to;
+};
+
+///
+/// Allocates rectangles in a fixed-size atlas, and frees them again, for caches of glyphs or thumbnails
+/// that stay warm for a whole session instead of being repacked when they fill up.
+///
+/// Space is kept as a guillotine tree: each allocation cuts a free rectangle in two, then cuts the
+/// piece it landed in again, and freeing a rectangle joins it back to its sibling once both are free.
+/// Free space therefore merges back to exactly what it was before the allocations that split it.
+///
+/// Free space that was never one rectangle doesn't merge, so a long churn of mixed sizes leaves gaps.
+/// defragment() closes them a few moves at a time, so the copying can be spread across frames:
+///
+/// auto glyph = atlas.allocate(12, 20);
+/// ...
+/// atlas.free(glyph);
+/// for (auto &move: atlas.defragment(8)) { copy(move.from, move.to); }
+///
+class AtlasAllocator
+{
+public:
+  AtlasAllocator(int width, int height);
+
+  ///
+  /// Reserve a \a width by \a height rectangle, in the free rectangle it leaves the least space around.
+  /// Returns an id that contains() rejects if no free rectangle is large enough.
+  ///
+  AtlasId   allocate(int width, int height);
+  /// Return an allocation's space to the atlas. Returns false if \a id is stale.
+  bool      free(AtlasId id);
+  bool      contains(AtlasId id) const { return _allocations.contains(id); }
+  /// Where allocation \a id sits, or an empty rectangle if \a id is stale.
+  AtlasRect rect(AtlasId id) const;
+
+  ///
+  /// Move up to \a max_moves allocations into free space nearer the top-left corner, bottom-most first,
+  /// so the space they leave merges with its neighbors. Returns the moves in the order to apply them:
+  /// a later move may write into space an earlier move read from, but no move reads what an earlier one wrote.
+  /// Apply them one after another; applying a later move first can overwrite pixels an earlier move has yet to copy.
+  /// Returns nothing once no allocation can move closer.
+  ///
+  std::vector<AtlasMove> defragment(size_t max_moves);
+
+  void      clear();
+  int       width() const { return _width; }
+  int       height() const { return _height; }
+  size_t    allocationCount() const { return _allocations.size(); }
+  int64_t   freeArea() const { return _free_area; }
+  size_t    freeRectCount() const { return _free_leaves.size(); }
+  /// Largest free rectangle by area; any allocation that fits inside it will succeed.
+  AtlasRect largestFreeRect() const;
+
+private:
+  static const uint32_t NoNode = std::numeric_limits<uint32_t>::max();
+
+  enum class NodeState : uint8_t { Free, Used, Split, Unused };
+
+  struct Node
+  {
+    AtlasRect rect;
+    uint32_t  parent = NoNode;
+    uint32_t  children[2] = { NoNode, NoNode };
+    NodeState state = NodeState::Unused;
+    AtlasId   id;
+  };
+
+  uint32_t  makeNode(const AtlasRect &rect, uint32_t parent);
+  /// Split a free node into \a kept and \a rest, and return the child holding \a kept.
+  uint32_t  split(uint32_t node, const AtlasRect &kept, const AtlasRect &rest);
+  /// Free leaf for a \a width by \a height rectangle: the tightest fit, or the top-most with \a top_first.
+  uint32_t  findFree(int width, int height, bool top_first) const;
+  /// Carve a \a width by \a height rectangle from the top-left of free leaf \a node and return its node.
+  uint32_t  place(uint32_t node, int width, int height);
+  void      release(uint32_t node);
+
+  int                   _width;
+  int                   _height;
+  int64_t               _free_area = 0;
+  std::vector<Node>     _nodes;
+  std::vector<uint32_t> _unused_nodes;
+  sparse_set            _free_leaves;
+  slot_map<uint32_t>    _allocations;
+};
+
+// ===================================
+// AtlasAllocator Implementation
+// ===================================
+
+inline AtlasAllocator::AtlasAllocator(int width, int height)
+: _width(width),
+  _height(height)
+{
+  if (width <= 0 || height <= 0) {
+    throw std::invalid_argument("AtlasAllocator needs a positive size.");
+  }
+  clear();
+}
+
+inline void AtlasAllocator::clear()
+{
+  _nodes.clear();
+  _unused_nodes.clear();
+  _free_leaves.clear();
+  _allocations.clear();
+  makeNode(AtlasRect{ 0, 0, _width, _height }, NoNode);
+  _free_area = int64_t(_width) * _height;
+}
+
+inline uint32_t AtlasAllocator::makeNode(const AtlasRect &rect, uint32_t parent)
+{
+  auto index = static_cast<uint32_t>(_nodes.size());
+  if (! _unused_nodes.empty())
+  {
+    index = _unused_nodes.back();
+    _unused_nodes.pop_back();
+  }
+  else {
+    _nodes.emplace_back();
+  }
+
+  auto &node = _nodes[index];
+  node = Node();
+  node.rect = rect;
+  node.parent = parent;
+  node.state = NodeState::Free;
+  _free_leaves.insert(index);
+  return index;
+}
+
+inline uint32_t AtlasAllocator::split(uint32_t node, const AtlasRect &kept, const AtlasRect &rest)
+{
+  _free_leaves.erase(node);
+  _nodes[node].state = NodeState::Split;
+  const auto first = makeNode(kept, node);
+  const auto second = makeNode(rest, node);
+  _nodes[node].children[0] = first;
+  _nodes[node].children[1] = second;
+  return first;
+}
+
+inline uint32_t AtlasAllocator::findFree(int width, int height, bool top_first) const
+{
+  auto best = NoNode;
+  auto best_primary = std::numeric_limits<int>::max();
+  auto best_secondary = std::numeric_limits<int>::max();
+  for (auto index: _free_leaves)
+  {
+    const auto &r = _nodes[index].rect;
+    if (r.width < width || r.height < height) {
+      continue;
+    }
+    const auto leftover_x = r.width - width;
+    const auto leftover_y = r.height - height;
+    const auto primary = top_first ? r.y : std::min(leftover_x, leftover_y);
+    const auto secondary = top_first ? r.x : std::max(leftover_x, leftover_y);
+    if (primary < best_primary || (primary == best_primary && secondary < best_secondary))
+    {
+      best = index;
+      best_primary = primary;
+      best_secondary = secondary;
+    }
+  }
+  return best;
+}
+
+inline uint32_t AtlasAllocator::place(uint32_t node, int width, int height)
+{
+  const auto r = _nodes[node].rect;
+  const auto leftover_x = r.width - width;
+  const auto leftover_y = r.height - height;
+  // cut across the larger leftover first, so the biggest remaining piece spans the whole free rectangle
+  if (leftover_x > leftover_y)
+  {
+    if (leftover_x > 0) {
+      node = split(node, AtlasRect{ r.x, r.y, width, r.height }, AtlasRect{ r.x + width, r.y, leftover_x, r.height });
+    }
+    if (leftover_y > 0) {
+      node = split(node, AtlasRect{ r.x, r.y, width, height }, AtlasRect{ r.x, r.y + height, width, leftover_y });
+    }
+  }
+  else
+  {
+    if (leftover_y > 0) {
+      node = split(node, AtlasRect{ r.x, r.y, r.width, height }, AtlasRect{ r.x, r.y + height, r.width, leftover_y });
+    }
+    if (leftover_x > 0) {
+      node = split(node, AtlasRect{ r.x, r.y, width, height }, AtlasRect{ r.x + width, r.y, leftover_x, height });
+    }
+  }
+
+  _free_leaves.erase(node);
+  _nodes[node].state = NodeState::Used;
+  _free_area -= int64_t(width) * height;
+  return node;
+}
+
+inline void AtlasAllocator::release(uint32_t node)
+{
+  _free_area += _nodes[node].rect.area();
+  _nodes[node].state = NodeState::Free;
+  _free_leaves.insert(node);
+
+  // join free siblings back into their parent, as far up as they go
+  auto parent = _nodes[node].parent;
+  while (parent != NoNode)
+  {
+    auto &p = _nodes[parent];
+    const auto a = p.children[0];
+    const auto b = p.children[1];
+    if (_nodes[a].state != NodeState::Free || _nodes[b].state != NodeState::Free) {
+      break;
+    }
+    for (auto child: { a, b })
+    {
+      _free_leaves.erase(child);
+      _nodes[child].state = NodeState::Unused;
+      _unused_nodes.push_back(child);
+    }
+    p.children[0] = p.children[1] = NoNode;
+    p.state = NodeState::Free;
+    _free_leaves.insert(parent);
+    parent = p.parent;
+  }
+}
+
+inline AtlasId AtlasAllocator::allocate(int width, int height)
+{
+  if (width <= 0 || height <= 0) {
+    throw std::invalid_argument("Atlas allocations need a positive size.");
+  }
+  const auto leaf = findFree(width, height, false);
+  if (leaf == NoNode) {
+    return AtlasId();
+  }
+
+  const auto node = place(leaf, width, height);
+  const auto id = _allocations.insert(node);
+  _nodes[node].id = id;
+  return id;
+}
+
+inline bool AtlasAllocator::free(AtlasId id)
+{
+  const auto *node = _allocations.get(id);
+  if (! node) {
+    return false;
+  }
+  release(*node);
+  _allocations.erase(id);
+  return true;
+}
+
+inline AtlasRect AtlasAllocator::rect(AtlasId id) const
+{
+  const auto *node = _allocations.get(id);
+  return node ? _nodes[*node].rect : AtlasRect();
+}
+
+inline AtlasRect AtlasAllocator::largestFreeRect() const
+{
+  auto largest = AtlasRect();
+  for (auto index: _free_leaves)
+  {
+    if (_nodes[index].rect.area() > largest.area()) {
+      largest = _nodes[index].rect;
+    }
+  }
+  return largest;
+}
+
+inline std::vector<AtlasMove> AtlasAllocator::defragment(size_t max_moves)
+{
+  auto moves = std::vector<AtlasMove>();
+  if (max_moves == 0) {
+    return moves;
+  }
+
+  // bottom-most first, since space freed low in the atlas is what lets the top stay dense
+  auto order = std::vector<uint32_t>(_allocations.begin(), _allocations.end());
+  std::sort(order.begin(), order.end(), [this] (uint32_t a, uint32_t b) {
+    const auto &ra = _nodes[a].rect;
+    const auto &rb = _nodes[b].rect;
+    return ra.y != rb.y ? ra.y > rb.y : ra.x > rb.x;
+  });
+
+  for (auto node: order)
+  {
+    const auto from = _nodes[node].rect;
+    const auto leaf = findFree(from.width, from.height, true);
+    if (leaf == NoNode) {
+      continue;
+    }
+    const auto &target = _nodes[leaf].rect;
+    if (target.y > from.y || (target.y == from.y && target.x >= from.x)) {
+      continue;
+    }
+
+    // take the new space before giving up the old, so the copy never overlaps itself
+    const auto id = _nodes[node].id;
+    const auto moved = place(leaf, from.width, from.height);
+    _nodes[moved].id = id;
+    _allocations[id] = moved;
+    release(node);
+    moves.push_back(AtlasMove{ id, from, _nodes[moved].rect });
+    if (moves.size() == max_moves) {
+      break;
+    }
+  }
+  return moves;
+}
+
+} // namespace pockets
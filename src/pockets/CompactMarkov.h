@@ -0,0 +1,264 @@
+/*
+ * Copyright (c) 2015 David Wicks, sansumbrella.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+#include "Pockets.h"
+#include "Parallel.h"
+#include "WeightedSampling.h"
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <unordered_map>
+
+namespace pockets {
+
+namespace detail {
+
+///
+/// Samples the exit of CSR row \a row at normalized position t.
+/// \a cumulative holds each row's normalized running totals. Returns \a row if it has no exits.
+///
+inline uint32_t sample_csr_row(const uint64_t *offsets, const uint32_t *targets, const float *cumulative, uint32_t row, float t)
+{
+  const auto begin = cumulative + offsets[row];
+  const auto end = cumulative + offsets[row + 1];
+  if (begin == end) {
+    return row;
+  }
+
+  // first exit whose running total passes t; t == 1 lands on the last exit
+  auto iter = std::upper_bound(begin, end, t);
+  if (iter == end) {
+    iter = end - 1;
+  }
+  return targets[offsets[row] + (iter - begin)];
+}
+
+///
+/// Runs one walk of \a length steps from each of \a count starts into \a out, in parallel.
+/// Step s of walk i samples at counter_uniform(seed, i, s), so the result is independent of thread_count.
+///
+template <typename NextFn>
+void generate_csr_walks(const uint32_t *starts, size_t count, size_t length, uint64_t seed, size_t thread_count, uint32_t *out, const NextFn &next)
+{
+  if (length == 0) {
+    return;
+  }
+
+  parallel_for_chunks(count, thread_count, [&] (size_t begin, size_t end, size_t) {
+    for (auto walk = begin; walk < end; walk += 1)
+    {
+      auto *steps = out + walk * length;
+      steps[0] = starts[walk];
+      for (size_t step = 1; step < length; step += 1) {
+        steps[step] = next(steps[step - 1], counter_uniform(seed, walk, step));
+      }
+    }
+  });
+}
+
+} // namespace detail
+
+///
+/// Read-only markov graph in compressed sparse row (CSR) form.
+/// Nodes are interned to dense ids. The exits of node i are the edges
+/// [offsets[i], offsets[i + 1]) of three parallel arrays, so a walk reads
+/// each row as one contiguous run of memory.
+///
+/// Build one with MarkovGraph::freeze(), or directly from a list of pathways.
+///
+template <typename T>
+class CompactMarkovGraph
+{
+public:
+  using NodeId = uint32_t;
+  static const NodeId InvalidNode = std::numeric_limits<NodeId>::max();
+
+  struct Pathway
+  {
+    T     from;
+    T     to;
+    float weight = 0.0f;
+  };
+
+  CompactMarkovGraph() = default;
+  /// Build from a list of weighted pathways. Pathways without positive weight are dropped.
+  explicit CompactMarkovGraph(const std::vector<Pathway> &pathways);
+
+  /// Returns the dense id of \a value, or InvalidNode if it isn't in the graph.
+  NodeId    nodeId(const T &value) const
+  {
+    auto iter = _ids.find(value);
+    return iter != _ids.end() ? iter->second : InvalidNode;
+  }
+  const T&  value(NodeId id) const { return _values[id]; }
+
+  ///
+  /// Return the next node in the graph at normalized position t.
+  /// If there is no next node in the graph, returns start_node.
+  ///
+  NodeId    nextNode(NodeId start_node, float t) const;
+  const T&  nextNode(const T &start_node, float t) const
+  {
+    auto id = nodeId(start_node);
+    return id == InvalidNode ? start_node : _values[nextNode(id, t)];
+  }
+
+  ///
+  /// Run one random walk of \a length nodes from each of \a starts, in parallel.
+  /// Walk i occupies [i * length, (i + 1) * length) of the returned buffer and begins with starts[i].
+  /// Step s of walk i draws counter_uniform(seed, i, s), so the output depends only on
+  /// the seed and the starts, never on \a thread_count (zero means one thread per core).
+  ///
+  std::vector<NodeId> generateWalks(const std::vector<NodeId> &starts, size_t length, uint64_t seed, size_t thread_count = 0) const;
+
+  size_t    nodeCount() const { return _values.size(); }
+  size_t    edgeCount() const { return _targets.size(); }
+
+  /// Approximate heap footprint in bytes, including the value-to-id table.
+  /// Does not count memory owned by the values themselves (e.g. string contents).
+  size_t    memoryUsage() const;
+
+  /// Raw CSR arrays. Row i spans [offsets()[i], offsets()[i + 1]).
+  const std::vector<uint64_t>&  offsets() const { return _offsets; }
+  const std::vector<NodeId>&    targets() const { return _targets; }
+  /// Running totals of each row's weights, normalized so that every non-empty row ends at 1.
+  const std::vector<float>&     cumulativeWeights() const { return _cumulative; }
+  const std::vector<T>&         values() const { return _values; }
+
+private:
+  std::vector<T>                  _values;
+  std::unordered_map<T, NodeId>   _ids;
+  std::vector<uint64_t>           _offsets;
+  std::vector<NodeId>             _targets;
+  std::vector<float>              _cumulative;
+};
+
+// ===================================
+// CompactMarkovGraph Template Implementation
+// ===================================
+
+template <typename T>
+const typename CompactMarkovGraph<T>::NodeId CompactMarkovGraph<T>::InvalidNode;
+
+template <typename T>
+CompactMarkovGraph<T>::CompactMarkovGraph(const std::vector<Pathway> &pathways)
+{
+  auto intern = [this] (const T &value) {
+    auto result = _ids.emplace(value, static_cast<NodeId>(_values.size()));
+    if (result.second) {
+      _values.push_back(value);
+    }
+    return result.first->second;
+  };
+
+  // intern every node and count each row's exits
+  auto sources = std::vector<NodeId>();
+  auto destinations = std::vector<NodeId>();
+  sources.reserve(pathways.size());
+  destinations.reserve(pathways.size());
+  for (auto &p: pathways)
+  {
+    sources.push_back(intern(p.from));
+    destinations.push_back(intern(p.to));
+  }
+
+  _offsets.assign(_values.size() + 1, 0);
+  for (size_t i = 0; i < pathways.size(); i += 1)
+  {
+    if (pathways[i].weight > 0.0f) {
+      _offsets[sources[i] + 1] += 1;
+    }
+  }
+  for (size_t i = 1; i < _offsets.size(); i += 1) {
+    _offsets[i] += _offsets[i - 1];
+  }
+
+  // scatter edges into their rows
+  _targets.resize(_offsets.back());
+  _cumulative.resize(_offsets.back());
+  auto cursor = std::vector<uint64_t>(_offsets.begin(), _offsets.end() - 1);
+  for (size_t i = 0; i < pathways.size(); i += 1)
+  {
+    if (pathways[i].weight > 0.0f)
+    {
+      auto position = cursor[sources[i]]++;
+      _targets[position] = destinations[i];
+      _cumulative[position] = pathways[i].weight;
+    }
+  }
+
+  // turn weights into normalized running totals
+  for (size_t row = 0; row + 1 < _offsets.size(); row += 1)
+  {
+    const auto begin = _offsets[row];
+    const auto end = _offsets[row + 1];
+    auto total = 0.0;
+    for (auto i = begin; i < end; i += 1) {
+      total += _cumulative[i];
+    }
+    auto running = 0.0;
+    for (auto i = begin; i < end; i += 1)
+    {
+      running += _cumulative[i];
+      _cumulative[i] = static_cast<float>(running / total);
+    }
+    if (end > begin) {
+      _cumulative[end - 1] = 1.0f;
+    }
+  }
+}
+
+template <typename T>
+auto CompactMarkovGraph<T>::nextNode(NodeId start_node, float t) const -> NodeId
+{
+  return detail::sample_csr_row(_offsets.data(), _targets.data(), _cumulative.data(), start_node, t);
+}
+
+template <typename T>
+auto CompactMarkovGraph<T>::generateWalks(const std::vector<NodeId> &starts, size_t length, uint64_t seed, size_t thread_count) const -> std::vector<NodeId>
+{
+  auto walks = std::vector<NodeId>(starts.size() * length);
+  detail::generate_csr_walks(starts.data(), starts.size(), length, seed, thread_count, walks.data(), [this] (NodeId node, float t) {
+    return nextNode(node, t);
+  });
+  return walks;
+}
+
+template <typename T>
+size_t CompactMarkovGraph<T>::memoryUsage() const
+{
+  // unordered_map: one bucket pointer per bucket plus one heap node per entry (value, id, next pointer, cached hash)
+  const auto id_table = _ids.bucket_count() * sizeof(void*) + _ids.size() * (sizeof(std::pair<const T, NodeId>) + 2 * sizeof(void*));
+  return _values.capacity() * sizeof(T)
+    + _offsets.capacity() * sizeof(uint64_t)
+    + _targets.capacity() * sizeof(NodeId)
+    + _cumulative.capacity() * sizeof(float)
+    + id_table;
+}
+
+} // namespace pockets
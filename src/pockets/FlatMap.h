@@ -0,0 +1,438 @@
+/*
+ * Copyright (c) 2015 David Wicks, sansumbrella.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+#include "Pockets.h"
+#include <algorithm>
+#include <functional>
+#include <initializer_list>
+#include <iterator>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace pockets {
+
+///
+/// Associative container stored as a sorted vector of key-value pairs.
+/// Intended for tables that are built once and then mostly read.
+/// Lookup is a binary search over contiguous memory; insertion and erasure are linear.
+///
+/// Build in bulk where possible, since that sorts only once:
+/// auto table = flat_map<string, int>(std::move(pairs));
+///
+/// use_eytzinger_layout() keeps a copy of the keys in breadth-first (Eytzinger) order
+/// and prefetches down the tree while searching. It costs a copy of the keys plus an index
+/// and only pays off for small, cheaply compared keys on some hardware, so measure before enabling it.
+///
+/// Iterators yield a reference proxy whose key is const, so the sort order can't be broken from outside.
+/// Since dereferencing returns the proxy by value rather than a reference, they are input iterators
+/// as far as the standard library is concerned, though they support +, -, [] and comparisons directly.
+/// Bind elements with `const auto &`, `auto &&` or `auto` (not `auto &`); `second` still refers to the stored value.
+/// For algorithms that need real references, use values(), which exposes the sorted pairs read-only.
+///
+template <typename Key, typename Value, typename Compare = std::less<Key>>
+class flat_map
+{
+public:
+  using key_type = Key;
+  using mapped_type = Value;
+  using value_type = std::pair<Key, Value>;
+  using container_type = std::vector<value_type>;
+
+  /// An element seen through an iterator: a const key and a reference to its value. Copying it copies the references.
+  template <typename Mapped>
+  struct reference_proxy
+  {
+    const Key &first;
+    Mapped    &second;
+
+    operator value_type() const { return value_type(first, second); }
+    /// Lets iterator::operator-> return a proxy.
+    const reference_proxy* operator->() const { return this; }
+  };
+
+  template <typename Base, typename Mapped>
+  class basic_iterator
+  {
+  public:
+    /// Forward and stronger categories require operator* to return a true reference, which the proxy is not.
+    using iterator_category = std::input_iterator_tag;
+    using value_type = typename flat_map::value_type;
+    using difference_type = std::ptrdiff_t;
+    using reference = reference_proxy<Mapped>;
+    using pointer = reference_proxy<Mapped>;
+
+    basic_iterator() = default;
+    explicit basic_iterator(Base base)
+    : _base(base)
+    {}
+    /// Mutable iterators convert to const ones.
+    template <typename OtherBase, typename OtherMapped>
+    basic_iterator(const basic_iterator<OtherBase, OtherMapped> &other)
+    : _base(other.base())
+    {}
+
+    reference operator*() const { return reference{ _base->first, _base->second }; }
+    pointer   operator->() const { return **this; }
+    reference operator[](difference_type n) const { return *(*this + n); }
+
+    basic_iterator& operator++() { ++_base; return *this; }
+    basic_iterator  operator++(int) { auto copy = *this; ++_base; return copy; }
+    basic_iterator& operator--() { --_base; return *this; }
+    basic_iterator  operator--(int) { auto copy = *this; --_base; return copy; }
+    basic_iterator& operator+=(difference_type n) { _base += n; return *this; }
+    basic_iterator& operator-=(difference_type n) { _base -= n; return *this; }
+    basic_iterator  operator+(difference_type n) const { return basic_iterator(_base + n); }
+    basic_iterator  operator-(difference_type n) const { return basic_iterator(_base - n); }
+    friend basic_iterator operator+(difference_type n, const basic_iterator &iter) { return iter + n; }
+
+    template <typename B, typename M> difference_type operator-(const basic_iterator<B, M> &other) const { return _base - other.base(); }
+    template <typename B, typename M> bool operator==(const basic_iterator<B, M> &other) const { return _base == other.base(); }
+    template <typename B, typename M> bool operator!=(const basic_iterator<B, M> &other) const { return _base != other.base(); }
+    template <typename B, typename M> bool operator<(const basic_iterator<B, M> &other) const { return _base < other.base(); }
+    template <typename B, typename M> bool operator>(const basic_iterator<B, M> &other) const { return _base > other.base(); }
+    template <typename B, typename M> bool operator<=(const basic_iterator<B, M> &other) const { return _base <= other.base(); }
+    template <typename B, typename M> bool operator>=(const basic_iterator<B, M> &other) const { return _base >= other.base(); }
+
+    const Base& base() const { return _base; }
+
+  private:
+    Base _base;
+  };
+
+  using iterator = basic_iterator<typename container_type::iterator, Value>;
+  using const_iterator = basic_iterator<typename container_type::const_iterator, const Value>;
+  using reference = reference_proxy<Value>;
+  using const_reference = reference_proxy<const Value>;
+
+  flat_map() = default;
+
+  /// Builds from unsorted \a values, sorting once. Later duplicates replace earlier ones, as with repeated operator[] assignment.
+  explicit flat_map(container_type values, const Compare &compare = Compare());
+  flat_map(std::initializer_list<value_type> values, const Compare &compare = Compare())
+  : flat_map(container_type(values), compare)
+  {}
+  template <typename InputIterator>
+  flat_map(InputIterator begin, InputIterator end, const Compare &compare = Compare())
+  : flat_map(container_type(begin, end), compare)
+  {}
+
+  iterator        find(const Key &key);
+  const_iterator  find(const Key &key) const;
+  size_t          count(const Key &key) const { return find(key) != end(); }
+
+  /// Returns the value stored at \a key. Throws std::out_of_range if there is none.
+  Value&          at(const Key &key);
+  const Value&    at(const Key &key) const;
+
+  /// Returns the value stored at \a key, inserting a default value if there is none.
+  Value&          operator[](const Key &key);
+
+  /// Inserts \a value if its key is not already present.
+  std::pair<iterator, bool> insert(const value_type &value);
+  /// Inserts or replaces the value at \a key.
+  std::pair<iterator, bool> insert_or_assign(const Key &key, Value value);
+
+  size_t          erase(const Key &key);
+  iterator        erase(const_iterator position);
+
+  void            clear() { _values.clear(); rebuild_search_index(); }
+  void            reserve(size_t size) { _values.reserve(size); }
+  size_t          size() const { return _values.size(); }
+  bool            empty() const { return _values.empty(); }
+
+  /// Enables or disables the Eytzinger search index. Costs one copy of the keys.
+  void            use_eytzinger_layout(bool enabled = true) { _eytzinger = enabled; rebuild_search_index(); }
+  bool            uses_eytzinger_layout() const { return _eytzinger; }
+
+  iterator        begin() { return iterator(_values.begin()); }
+  iterator        end() { return iterator(_values.end()); }
+  const_iterator  begin() const { return const_iterator(_values.begin()); }
+  const_iterator  end() const { return const_iterator(_values.end()); }
+  const_iterator  cbegin() const { return const_iterator(_values.cbegin()); }
+  const_iterator  cend() const { return const_iterator(_values.cend()); }
+
+  /// Read-only access to the sorted storage.
+  const container_type& values() const { return _values; }
+
+private:
+  /// Index of the first element not less than \a key.
+  size_t lower_bound_index(const Key &key) const;
+  bool   matches(size_t index, const Key &key) const { return index < _values.size() && ! _compare(key, _values[index].first); }
+  void   rebuild_search_index();
+  size_t fill_search_index(size_t slot, size_t sorted_index);
+
+  container_type      _values;
+  Compare             _compare;
+  bool                _eytzinger = false;
+  /// Keys in breadth-first order, 1-based so the children of slot k are 2k and 2k + 1.
+  std::vector<Key>    _search_keys;
+  /// Position in _values of each key in _search_keys.
+  std::vector<size_t> _search_indices;
+};
+
+///
+/// Set stored as a sorted vector of keys.
+/// Shares the build-once, read-mostly intent of flat_map.
+///
+template <typename Key, typename Compare = std::less<Key>>
+class flat_set
+{
+public:
+  using key_type = Key;
+  using value_type = Key;
+  using container_type = std::vector<Key>;
+  using const_iterator = typename container_type::const_iterator;
+  using iterator = const_iterator;
+
+  flat_set() = default;
+
+  /// Builds from unsorted \a keys, sorting once and dropping duplicates.
+  explicit flat_set(container_type keys, const Compare &compare = Compare())
+  : _keys(std::move(keys)),
+    _compare(compare)
+  {
+    std::sort(_keys.begin(), _keys.end(), _compare);
+    auto equivalent = [this] (const Key &lhs, const Key &rhs) { return ! _compare(lhs, rhs) && ! _compare(rhs, lhs); };
+    _keys.erase(std::unique(_keys.begin(), _keys.end(), equivalent), _keys.end());
+  }
+  flat_set(std::initializer_list<Key> keys, const Compare &compare = Compare())
+  : flat_set(container_type(keys), compare)
+  {}
+
+  const_iterator find(const Key &key) const
+  {
+    auto iter = std::lower_bound(_keys.begin(), _keys.end(), key, _compare);
+    return (iter != _keys.end() && ! _compare(key, *iter)) ? iter : _keys.end();
+  }
+  size_t count(const Key &key) const { return find(key) != end(); }
+
+  std::pair<const_iterator, bool> insert(const Key &key)
+  {
+    auto iter = std::lower_bound(_keys.begin(), _keys.end(), key, _compare);
+    if (iter != _keys.end() && ! _compare(key, *iter)) {
+      return std::make_pair(const_iterator(iter), false);
+    }
+    return std::make_pair(const_iterator(_keys.insert(iter, key)), true);
+  }
+
+  size_t erase(const Key &key)
+  {
+    auto iter = find(key);
+    if (iter == end()) {
+      return 0;
+    }
+    _keys.erase(iter);
+    return 1;
+  }
+
+  void    clear() { _keys.clear(); }
+  void    reserve(size_t size) { _keys.reserve(size); }
+  size_t  size() const { return _keys.size(); }
+  bool    empty() const { return _keys.empty(); }
+
+  const_iterator begin() const { return _keys.begin(); }
+  const_iterator end() const { return _keys.end(); }
+
+private:
+  container_type _keys;
+  Compare        _compare;
+};
+
+// ===================================
+// flat_map Template Implementation
+// ===================================
+
+template <typename Key, typename Value, typename Compare>
+flat_map<Key, Value, Compare>::flat_map(container_type values, const Compare &compare)
+: _values(std::move(values)),
+  _compare(compare)
+{
+  auto key_compare = [this] (const value_type &lhs, const value_type &rhs) { return _compare(lhs.first, rhs.first); };
+  std::stable_sort(_values.begin(), _values.end(), key_compare);
+
+  // keep the last of each run of equivalent keys
+  auto write = _values.begin();
+  for (auto read = _values.begin(); read != _values.end(); ++read)
+  {
+    auto next = std::next(read);
+    if (next != _values.end() && ! key_compare(*read, *next)) {
+      continue;
+    }
+    if (write != read) {
+      *write = std::move(*read);
+    }
+    ++write;
+  }
+  _values.erase(write, _values.end());
+}
+
+template <typename Key, typename Value, typename Compare>
+size_t flat_map<Key, Value, Compare>::lower_bound_index(const Key &key) const
+{
+  if (! _eytzinger)
+  {
+    auto iter = std::lower_bound(_values.begin(), _values.end(), key, [this] (const value_type &lhs, const Key &rhs) {
+      return _compare(lhs.first, rhs);
+    });
+    return std::distance(_values.begin(), iter);
+  }
+
+  // Descend the implicit tree; every step goes left or right without a data-dependent branch.
+  const auto n = _values.size();
+  auto slot = size_t(1);
+  const auto prefetch_distance = std::max<size_t>(1, 64 / sizeof(Key));
+  while (slot <= n) {
+#if defined(__GNUC__)
+    // descendants four levels down share a cache line when keys are small
+    __builtin_prefetch(_search_keys.data() + std::min(slot * prefetch_distance, n));
+#endif
+    slot = 2 * slot + _compare(_search_keys[slot], key);
+  }
+  // Undo the trailing right turns (and the final left turn) to find the last node where we went left.
+  while (slot & 1) {
+    slot >>= 1;
+  }
+  slot >>= 1;
+
+  return slot == 0 ? n : _search_indices[slot];
+}
+
+template <typename Key, typename Value, typename Compare>
+auto flat_map<Key, Value, Compare>::find(const Key &key) -> iterator
+{
+  auto index = lower_bound_index(key);
+  return matches(index, key) ? begin() + index : end();
+}
+
+template <typename Key, typename Value, typename Compare>
+auto flat_map<Key, Value, Compare>::find(const Key &key) const -> const_iterator
+{
+  auto index = lower_bound_index(key);
+  return matches(index, key) ? begin() + index : end();
+}
+
+template <typename Key, typename Value, typename Compare>
+Value& flat_map<Key, Value, Compare>::at(const Key &key)
+{
+  auto iter = find(key);
+  if (iter == end()) {
+    throw std::out_of_range("pockets::flat_map::at: key not found");
+  }
+  return iter->second;
+}
+
+template <typename Key, typename Value, typename Compare>
+const Value& flat_map<Key, Value, Compare>::at(const Key &key) const
+{
+  auto iter = find(key);
+  if (iter == end()) {
+    throw std::out_of_range("pockets::flat_map::at: key not found");
+  }
+  return iter->second;
+}
+
+template <typename Key, typename Value, typename Compare>
+Value& flat_map<Key, Value, Compare>::operator[](const Key &key)
+{
+  return insert(value_type(key, Value())).first->second;
+}
+
+template <typename Key, typename Value, typename Compare>
+auto flat_map<Key, Value, Compare>::insert(const value_type &value) -> std::pair<iterator, bool>
+{
+  auto index = lower_bound_index(value.first);
+  if (matches(index, value.first)) {
+    return std::make_pair(begin() + index, false);
+  }
+  _values.insert(std::next(_values.begin(), index), value);
+  rebuild_search_index();
+  return std::make_pair(begin() + index, true);
+}
+
+template <typename Key, typename Value, typename Compare>
+auto flat_map<Key, Value, Compare>::insert_or_assign(const Key &key, Value value) -> std::pair<iterator, bool>
+{
+  auto index = lower_bound_index(key);
+  if (matches(index, key)) {
+    _values[index].second = std::move(value);
+    return std::make_pair(begin() + index, false);
+  }
+  _values.insert(std::next(_values.begin(), index), value_type(key, std::move(value)));
+  rebuild_search_index();
+  return std::make_pair(begin() + index, true);
+}
+
+template <typename Key, typename Value, typename Compare>
+size_t flat_map<Key, Value, Compare>::erase(const Key &key)
+{
+  auto iter = find(key);
+  if (iter == end()) {
+    return 0;
+  }
+  erase(iter);
+  return 1;
+}
+
+template <typename Key, typename Value, typename Compare>
+auto flat_map<Key, Value, Compare>::erase(const_iterator position) -> iterator
+{
+  auto index = std::distance(_values.cbegin(), position.base());
+  _values.erase(std::next(_values.begin(), index));
+  rebuild_search_index();
+  return begin() + index;
+}
+
+template <typename Key, typename Value, typename Compare>
+void flat_map<Key, Value, Compare>::rebuild_search_index()
+{
+  _search_keys.clear();
+  _search_indices.clear();
+  if (! _eytzinger) {
+    return;
+  }
+
+  _search_keys.resize(_values.size() + 1);
+  _search_indices.resize(_values.size() + 1);
+  fill_search_index(1, 0);
+}
+
+template <typename Key, typename Value, typename Compare>
+size_t flat_map<Key, Value, Compare>::fill_search_index(size_t slot, size_t sorted_index)
+{ // in-order traversal of the implicit tree visits slots in sorted order
+  if (slot <= _values.size())
+  {
+    sorted_index = fill_search_index(2 * slot, sorted_index);
+    _search_keys[slot] = _values[sorted_index].first;
+    _search_indices[slot] = sorted_index;
+    sorted_index = fill_search_index(2 * slot + 1, sorted_index + 1);
+  }
+  return sorted_index;
+}
+
+} // namespace pockets
@@ -0,0 +1,102 @@
+/*
+ * Copyright (c) 2015 David Wicks, sansumbrella.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#pragma once
+#include "Pockets.h"
+#include <cstdint>
+#include <cstring>
+
+namespace pockets {
+
+/// Largest finite half float.
+const float HalfMax = 65504.0f;
+
+///
+/// Converts a float to IEEE 754 half precision, rounding to nearest even.
+/// Values beyond the half range (+-65504) become infinity; NaN stays NaN.
+/// Half precision keeps 11 significant bits, so the relative error is at most 2^-11.
+///
+inline uint16_t float_to_half(float value)
+{
+  auto bits = uint32_t(0);
+  std::memcpy(&bits, &value, sizeof(bits));
+  const auto sign = static_cast<uint16_t>((bits >> 16) & 0x8000u);
+  bits &= 0x7FFFFFFFu;
+
+  // 2^16 and up overflows the half exponent
+  if (bits >= (143u << 23)) {
+    return sign | (bits > 0x7F800000u ? 0x7E00u : 0x7C00u);
+  }
+
+  // below the smallest normal half (2^-14) the result is subnormal or zero;
+  // adding a magic number lines the mantissa up so the FPU does the rounding
+  if (bits < (113u << 23))
+  {
+    const auto magic_bits = uint32_t(126u << 23);
+    auto magic = 0.0f;
+    std::memcpy(&magic, &magic_bits, sizeof(magic));
+    auto shifted = 0.0f;
+    std::memcpy(&shifted, &bits, sizeof(shifted));
+    shifted += magic;
+    std::memcpy(&bits, &shifted, sizeof(bits));
+    return sign | static_cast<uint16_t>(bits - magic_bits);
+  }
+
+  // rebias the exponent and round the 13 dropped mantissa bits to nearest even
+  const auto odd = (bits >> 13) & 1u;
+  bits += (uint32_t(15 - 127) << 23) + 0xFFFu + odd;
+  return sign | static_cast<uint16_t>(bits >> 13);
+}
+
+/// Converts an IEEE 754 half to float. Exact for every half value.
+inline float half_to_float(uint16_t half)
+{
+  const auto exponent_mask = uint32_t(0x7C00u) << 13;
+  auto bits = uint32_t(half & 0x7FFFu) << 13;
+  const auto exponent = bits & exponent_mask;
+  bits += uint32_t(127 - 15) << 23;
+
+  auto result = 0.0f;
+  if (exponent == exponent_mask) {
+    // infinity or NaN
+    bits += uint32_t(128 - 16) << 23;
+    std::memcpy(&result, &bits, sizeof(result));
+  }
+  else if (exponent == 0) {
+    // zero or subnormal; renormalize through the FPU
+    bits += 1u << 23;
+    std::memcpy(&result, &bits, sizeof(result));
+    result -= 6.103515625e-05f; // 2^-14
+  }
+  else {
+    std::memcpy(&result, &bits, sizeof(result));
+  }
+  return (half & 0x8000u) ? -result : result;
+}
+
+} // namespace pockets
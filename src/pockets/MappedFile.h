@@ -0,0 +1,184 @@
+/*
+ * Copyright (c) 2015 David Wicks, sansumbrella.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+#include "Pockets.h"
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#if defined(_WIN32)
+  #ifndef WIN32_LEAN_AND_MEAN
+    #define WIN32_LEAN_AND_MEAN
+  #endif
+  #ifndef NOMINMAX
+    #define NOMINMAX
+  #endif
+  #include <windows.h>
+#else
+  #include <fcntl.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <unistd.h>
+#endif
+
+namespace pockets {
+
+///
+/// Read-only memory mapping of a whole file.
+/// Pages are loaded on first touch and shared with every other process that maps the same file.
+/// Throws std::runtime_error if the file can't be opened or mapped.
+///
+class MappedFile
+{
+public:
+  MappedFile() = default;
+  explicit MappedFile(const std::string &path);
+  ~MappedFile() { close(); }
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile& operator = (const MappedFile &) = delete;
+  MappedFile(MappedFile &&other) noexcept { swap(other); }
+  MappedFile& operator = (MappedFile &&other) noexcept { close(); swap(other); return *this; }
+
+  const void* data() const { return _data; }
+  size_t      size() const { return _size; }
+  bool        empty() const { return _size == 0; }
+
+  /// Unmap the file. Pointers into the mapping are invalid afterward.
+  void        close();
+
+private:
+  void swap(MappedFile &other) noexcept
+  {
+    std::swap(_data, other._data);
+    std::swap(_size, other._size);
+#if defined(_WIN32)
+    std::swap(_file, other._file);
+    std::swap(_mapping, other._mapping);
+#endif
+  }
+
+  const void* _data = nullptr;
+  size_t      _size = 0;
+#if defined(_WIN32)
+  HANDLE      _file = INVALID_HANDLE_VALUE;
+  HANDLE      _mapping = nullptr;
+#endif
+};
+
+#if defined(_WIN32)
+
+inline MappedFile::MappedFile(const std::string &path)
+{
+  _file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (_file == INVALID_HANDLE_VALUE) {
+    throw std::runtime_error("pockets::MappedFile: unable to open " + path);
+  }
+
+  LARGE_INTEGER size;
+  if (! GetFileSizeEx(_file, &size))
+  {
+    close();
+    throw std::runtime_error("pockets::MappedFile: unable to read the size of " + path);
+  }
+  _size = static_cast<size_t>(size.QuadPart);
+  if (_size == 0) {
+    return;
+  }
+
+  _mapping = CreateFileMappingA(_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  _data = _mapping ? MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+  if (! _data)
+  {
+    close();
+    throw std::runtime_error("pockets::MappedFile: unable to map " + path);
+  }
+}
+
+inline void MappedFile::close()
+{
+  if (_data) {
+    UnmapViewOfFile(_data);
+  }
+  if (_mapping) {
+    CloseHandle(_mapping);
+  }
+  if (_file != INVALID_HANDLE_VALUE) {
+    CloseHandle(_file);
+  }
+  _data = nullptr;
+  _size = 0;
+  _mapping = nullptr;
+  _file = INVALID_HANDLE_VALUE;
+}
+
+#else
+
+inline MappedFile::MappedFile(const std::string &path)
+{
+  const auto fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw std::runtime_error("pockets::MappedFile: unable to open " + path);
+  }
+
+  struct stat info;
+  if (::fstat(fd, &info) != 0)
+  {
+    ::close(fd);
+    throw std::runtime_error("pockets::MappedFile: unable to read the size of " + path);
+  }
+  _size = static_cast<size_t>(info.st_size);
+  if (_size == 0)
+  {
+    ::close(fd);
+    return;
+  }
+
+  // the mapping keeps its own reference to the file, so the descriptor can go right away
+  auto *data = ::mmap(nullptr, _size, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (data == MAP_FAILED)
+  {
+    _size = 0;
+    throw std::runtime_error("pockets::MappedFile: unable to map " + path);
+  }
+  _data = data;
+}
+
+inline void MappedFile::close()
+{
+  if (_data) {
+    ::munmap(const_cast<void*>(_data), _size);
+  }
+  _data = nullptr;
+  _size = 0;
+}
+
+#endif
+
+} // namespace pockets
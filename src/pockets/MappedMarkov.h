@@ -0,0 +1,440 @@
+/*
+ * Copyright (c) 2015 David Wicks, sansumbrella.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+#include "Pockets.h"
+#include "CompactMarkov.h"
+#include "MappedFile.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <numeric>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+namespace pockets {
+
+///
+/// Binary layout of a saved CompactMarkovGraph.
+///
+/// The file starts with this header, followed by these sections, each beginning on an 8-byte boundary:
+///   offsets     uint64_t[node_count + 1]  CSR row starts
+///   targets     uint32_t[edge_count]      exit node ids
+///   cumulative  float[edge_count]         normalized running totals; each row ends at 1
+///   sorted ids  uint32_t[node_count]      node ids ordered by value, for lookup by value
+///   values      value_bytes               see MarkovValueCodec
+///
+/// Numbers are stored in the writer's native byte order; readers reject files whose byte order differs.
+/// Bump MarkovFileHeader::CurrentVersion whenever the layout changes.
+///
+struct MarkovFileHeader
+{
+  static const uint32_t CurrentVersion = 1;
+  static const uint32_t ByteOrderMark = 0x01020304;
+
+  char      magic[8] = { 'P', 'K', 'M', 'A', 'R', 'K', 'O', 'V' };
+  uint32_t  version = CurrentVersion;
+  uint32_t  byte_order = ByteOrderMark;
+  /// How values are stored; see MarkovValueCodec::Kind.
+  uint32_t  value_kind = 0;
+  /// sizeof(T) for trivially copyable values, 0 for strings.
+  uint32_t  value_size = 0;
+  uint64_t  node_count = 0;
+  uint64_t  edge_count = 0;
+  uint64_t  value_bytes = 0;
+  uint64_t  file_bytes = 0;
+  uint64_t  reserved = 0;
+};
+
+static_assert(sizeof(MarkovFileHeader) == 64, "MarkovFileHeader is part of the file format; keep it 64 bytes.");
+
+namespace detail {
+
+inline uint64_t align_markov_section(uint64_t position) { return (position + 7) & ~uint64_t(7); }
+
+/// Byte offsets of each section, derived from the header.
+struct MarkovFileLayout
+{
+  uint64_t offsets, targets, cumulative, sorted_ids, values, end;
+
+  explicit MarkovFileLayout(const MarkovFileHeader &header)
+  {
+    offsets = sizeof(MarkovFileHeader);
+    targets = align_markov_section(offsets + (header.node_count + 1) * sizeof(uint64_t));
+    cumulative = align_markov_section(targets + header.edge_count * sizeof(uint32_t));
+    sorted_ids = align_markov_section(cumulative + header.edge_count * sizeof(float));
+    values = align_markov_section(sorted_ids + header.node_count * sizeof(uint32_t));
+    end = values + header.value_bytes;
+  }
+};
+
+inline void write_markov_padding(std::ostream &stream, uint64_t from)
+{
+  static const char zeros[8] = {};
+  stream.write(zeros, align_markov_section(from) - from);
+}
+
+} // namespace detail
+
+///
+/// How node values are stored in the values section of a markov file.
+/// Trivially copyable values are stored as an array; std::string has its own specialization.
+/// Specialize for other types to save graphs of them, providing the same static members.
+///
+template <typename T>
+struct MarkovValueCodec
+{
+  static_assert(std::is_trivially_copyable<T>::value, "Saved markov graph values must be trivially copyable, or have a MarkovValueCodec specialization.");
+
+  /// 1 for strings; trivially copyable values are 2 for floating point, 3 for signed and 4 for unsigned integers,
+  /// and 0 for anything else, which is only told apart by size.
+  static const uint32_t Kind = std::is_floating_point<T>::value ? 2 : ! std::is_integral<T>::value ? 0 : std::is_signed<T>::value ? 3 : 4;
+  static const uint32_t Size = sizeof(T);
+
+  static uint64_t bytes(const std::vector<T> &values) { return values.size() * sizeof(T); }
+  static void     write(std::ostream &stream, const std::vector<T> &values)
+  {
+    stream.write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+  }
+
+  /// Returns true if a values section of \a bytes can hold \a node_count values.
+  static bool     valid(const char * /*section*/, uint64_t node_count, uint64_t bytes) { return bytes == node_count * sizeof(T); }
+
+  static T        read(const char *section, uint64_t /*node_count*/, uint32_t id)
+  {
+    T value;
+    std::memcpy(&value, section + uint64_t(id) * sizeof(T), sizeof(T));
+    return value;
+  }
+
+  /// Returns true if the value of node \a id orders before \a value.
+  static bool     less(const char *section, uint64_t node_count, uint32_t id, const T &value) { return read(section, node_count, id) < value; }
+  static bool     equal(const char *section, uint64_t node_count, uint32_t id, const T &value) { return read(section, node_count, id) == value; }
+};
+
+/// Strings are stored as uint64_t[node_count + 1] character offsets followed by the characters.
+template <>
+struct MarkovValueCodec<std::string>
+{
+  static const uint32_t Kind = 1;
+  static const uint32_t Size = 0;
+
+  static uint64_t bytes(const std::vector<std::string> &values)
+  {
+    auto characters = uint64_t(0);
+    for (auto &v: values) {
+      characters += v.size();
+    }
+    return (values.size() + 1) * sizeof(uint64_t) + characters;
+  }
+
+  static void     write(std::ostream &stream, const std::vector<std::string> &values)
+  {
+    auto offset = uint64_t(0);
+    stream.write(reinterpret_cast<const char*>(&offset), sizeof(offset));
+    for (auto &v: values)
+    {
+      offset += v.size();
+      stream.write(reinterpret_cast<const char*>(&offset), sizeof(offset));
+    }
+    for (auto &v: values) {
+      stream.write(v.data(), v.size());
+    }
+  }
+
+  /// Returns true if the offsets fit in the section, start at zero, and never decrease, so every read stays in bounds.
+  static bool     valid(const char *section, uint64_t node_count, uint64_t bytes)
+  {
+    const auto offset_bytes = (node_count + 1) * sizeof(uint64_t);
+    if (bytes < offset_bytes) {
+      return false;
+    }
+    const auto characters = bytes - offset_bytes;
+    auto previous = uint64_t(0);
+    for (uint64_t i = 0; i <= node_count; i += 1)
+    {
+      uint64_t offset;
+      std::memcpy(&offset, section + i * sizeof(uint64_t), sizeof(offset));
+      if (offset < previous || offset > characters || (i == 0 && offset != 0)) {
+        return false;
+      }
+      previous = offset;
+    }
+    return true;
+  }
+
+  static std::string read(const char *section, uint64_t node_count, uint32_t id)
+  {
+    const auto range = characters(section, node_count, id);
+    return std::string(range.first, range.second);
+  }
+
+  static bool     less(const char *section, uint64_t node_count, uint32_t id, const std::string &value)
+  {
+    // compare as std::string::operator< does, through char_traits (unsigned bytes), so UTF-8 keys are found
+    const auto range = characters(section, node_count, id);
+    const auto length = static_cast<size_t>(range.second - range.first);
+    const auto order = std::char_traits<char>::compare(range.first, value.data(), std::min(length, value.size()));
+    return order < 0 || (order == 0 && length < value.size());
+  }
+
+  static bool     equal(const char *section, uint64_t node_count, uint32_t id, const std::string &value)
+  {
+    const auto range = characters(section, node_count, id);
+    return static_cast<size_t>(range.second - range.first) == value.size() && std::equal(range.first, range.second, value.begin());
+  }
+
+private:
+  static std::pair<const char*, const char*> characters(const char *section, uint64_t node_count, uint32_t id)
+  {
+    uint64_t bounds[2];
+    std::memcpy(bounds, section + uint64_t(id) * sizeof(uint64_t), sizeof(bounds));
+    const auto *text = section + (node_count + 1) * sizeof(uint64_t);
+    return std::make_pair(text + bounds[0], text + bounds[1]);
+  }
+};
+
+///
+/// Write \a graph to \a stream in the markov file format.
+/// Values must be ordered by operator< so that the saved graph can look nodes up by value.
+///
+template <typename T>
+void writeMarkovGraph(const CompactMarkovGraph<T> &graph, std::ostream &stream)
+{
+  using Codec = MarkovValueCodec<T>;
+  auto header = MarkovFileHeader();
+  header.value_kind = Codec::Kind;
+  header.value_size = Codec::Size;
+  header.node_count = graph.nodeCount();
+  header.edge_count = graph.edgeCount();
+  header.value_bytes = Codec::bytes(graph.values());
+  const auto layout = detail::MarkovFileLayout(header);
+  header.file_bytes = layout.end;
+
+  auto &values = graph.values();
+  auto sorted = std::vector<uint32_t>(values.size());
+  std::iota(sorted.begin(), sorted.end(), 0);
+  std::sort(sorted.begin(), sorted.end(), [&values] (uint32_t a, uint32_t b) { return values[a] < values[b]; });
+
+  auto write_section = [&stream] (const void *data, uint64_t bytes, uint64_t start) {
+    stream.write(static_cast<const char*>(data), bytes);
+    detail::write_markov_padding(stream, start + bytes);
+  };
+
+  stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  write_section(graph.offsets().data(), graph.offsets().size() * sizeof(uint64_t), layout.offsets);
+  write_section(graph.targets().data(), graph.edgeCount() * sizeof(uint32_t), layout.targets);
+  write_section(graph.cumulativeWeights().data(), graph.edgeCount() * sizeof(float), layout.cumulative);
+  write_section(sorted.data(), sorted.size() * sizeof(uint32_t), layout.sorted_ids);
+  Codec::write(stream, values);
+}
+
+/// Save \a graph to the file at \a path. Throws std::runtime_error if the file can't be written.
+template <typename T>
+void saveMarkovGraph(const CompactMarkovGraph<T> &graph, const std::string &path)
+{
+  std::ofstream stream(path, std::ios::binary | std::ios::trunc);
+  if (! stream) {
+    throw std::runtime_error("pockets::saveMarkovGraph: unable to open " + path);
+  }
+  writeMarkovGraph(graph, stream);
+  stream.flush();
+  if (! stream) {
+    throw std::runtime_error("pockets::saveMarkovGraph: unable to write " + path);
+  }
+}
+
+///
+/// A saved CompactMarkovGraph, sampled in place.
+/// Opening a file maps it and checks its structure in one pass, without copying anything,
+/// and processes that map the same file share its pages.
+///
+/// saveMarkovGraph(graph.freeze(), "words.pkmarkov");
+/// ...
+/// MappedMarkovGraph<std::string> words("words.pkmarkov");
+/// auto next = words.nextNode(words.nodeId("hello"), randFloat());
+///
+/// Throws std::runtime_error if the data isn't a markov file of this version and value type,
+/// or if any offset, node id, or string would reach outside the data.
+///
+template <typename T>
+class MappedMarkovGraph
+{
+public:
+  using NodeId = uint32_t;
+  static const NodeId InvalidNode = CompactMarkovGraph<T>::InvalidNode;
+
+  /// Map the file at \a path.
+  explicit MappedMarkovGraph(const std::string &path)
+  : _file(path)
+  {
+    attach(_file.data(), _file.size());
+  }
+
+  /// Read a markov file already in memory, without copying it. \a data must be 8-byte aligned and outlive the graph.
+  MappedMarkovGraph(const void *data, size_t size) { attach(data, size); }
+
+  MappedMarkovGraph(MappedMarkovGraph &&) = default;
+  MappedMarkovGraph& operator = (MappedMarkovGraph &&) = default;
+
+  /// Returns the id of the node with \a value, or InvalidNode. O(log n).
+  NodeId    nodeId(const T &value) const;
+  T         value(NodeId id) const { return MarkovValueCodec<T>::read(_values, _node_count, id); }
+
+  /// Return the next node in the graph at normalized position t. Returns start_node if it has no exits.
+  NodeId    nextNode(NodeId start_node, float t) const { return detail::sample_csr_row(_offsets, _targets, _cumulative, start_node, t); }
+
+  /// Run one random walk per start, exactly as CompactMarkovGraph::generateWalks does.
+  std::vector<NodeId> generateWalks(const std::vector<NodeId> &starts, size_t length, uint64_t seed, size_t thread_count = 0) const
+  {
+    auto walks = std::vector<NodeId>(starts.size() * length);
+    detail::generate_csr_walks(starts.data(), starts.size(), length, seed, thread_count, walks.data(), [this] (NodeId node, float t) {
+      return nextNode(node, t);
+    });
+    return walks;
+  }
+
+  size_t    nodeCount() const { return _node_count; }
+  size_t    edgeCount() const { return _edge_count; }
+
+  const uint64_t* offsets() const { return _offsets; }
+  const NodeId*   targets() const { return _targets; }
+  const float*    cumulativeWeights() const { return _cumulative; }
+
+private:
+  void      attach(const void *data, size_t size);
+
+  MappedFile      _file;
+  uint64_t        _node_count = 0;
+  uint64_t        _edge_count = 0;
+  const uint64_t* _offsets = nullptr;
+  const NodeId*   _targets = nullptr;
+  const float*    _cumulative = nullptr;
+  const NodeId*   _sorted_ids = nullptr;
+  const char*     _values = nullptr;
+};
+
+// ===================================
+// MappedMarkovGraph Template Implementation
+// ===================================
+
+template <typename T>
+const typename MappedMarkovGraph<T>::NodeId MappedMarkovGraph<T>::InvalidNode;
+
+template <typename T>
+void MappedMarkovGraph<T>::attach(const void *data, size_t size)
+{
+  auto fail = [] (const std::string &reason) {
+    throw std::runtime_error("pockets::MappedMarkovGraph: " + reason);
+  };
+
+  auto header = MarkovFileHeader();
+  const auto expected = header;
+  if (size < sizeof(header)) {
+    fail("data is too small to be a markov file");
+  }
+  if (reinterpret_cast<uintptr_t>(data) % 8 != 0) {
+    fail("data must be 8-byte aligned");
+  }
+  std::memcpy(&header, data, sizeof(header));
+
+  if (std::memcmp(header.magic, expected.magic, sizeof(header.magic)) != 0) {
+    fail("data is not a markov file");
+  }
+  if (header.byte_order != MarkovFileHeader::ByteOrderMark) {
+    fail("file was written with a different byte order");
+  }
+  if (header.version != MarkovFileHeader::CurrentVersion) {
+    fail("unsupported version " + std::to_string(header.version));
+  }
+  if (header.value_kind != MarkovValueCodec<T>::Kind || header.value_size != MarkovValueCodec<T>::Size) {
+    fail("file holds a different value type");
+  }
+  // bound every count by the data size before computing the layout, so a corrupt header can't overflow the section math
+  const auto length = static_cast<uint64_t>(size);
+  if (header.node_count >= InvalidNode || header.edge_count > length / sizeof(uint32_t) || header.value_bytes > length
+      || length > std::numeric_limits<uint64_t>::max() / 8) {
+    fail("file is truncated or corrupt");
+  }
+  const auto layout = detail::MarkovFileLayout(header);
+  if (layout.end != header.file_bytes || layout.end > length) {
+    fail("file is truncated or corrupt");
+  }
+
+  const auto *bytes = static_cast<const char*>(data);
+  _node_count = header.node_count;
+  _edge_count = header.edge_count;
+  _offsets = reinterpret_cast<const uint64_t*>(bytes + layout.offsets);
+  _targets = reinterpret_cast<const NodeId*>(bytes + layout.targets);
+  _cumulative = reinterpret_cast<const float*>(bytes + layout.cumulative);
+  _sorted_ids = reinterpret_cast<const NodeId*>(bytes + layout.sorted_ids);
+  _values = bytes + layout.values;
+
+  // every row must lie within the edge sections, and every id must name a node, or sampling reads out of bounds
+  if (_offsets[0] != 0 || _offsets[_node_count] != _edge_count) {
+    fail("file is truncated or corrupt");
+  }
+  for (uint64_t i = 0; i < _node_count; i += 1)
+  {
+    if (_offsets[i] > _offsets[i + 1]) {
+      fail("file is truncated or corrupt");
+    }
+  }
+  for (uint64_t i = 0; i < _edge_count; i += 1)
+  {
+    if (_targets[i] >= _node_count) {
+      fail("file is truncated or corrupt");
+    }
+  }
+  for (uint64_t i = 0; i < _node_count; i += 1)
+  {
+    if (_sorted_ids[i] >= _node_count) {
+      fail("file is truncated or corrupt");
+    }
+  }
+  if (! MarkovValueCodec<T>::valid(_values, _node_count, header.value_bytes)) {
+    fail("file is truncated or corrupt");
+  }
+}
+
+template <typename T>
+auto MappedMarkovGraph<T>::nodeId(const T &value) const -> NodeId
+{
+  using Codec = MarkovValueCodec<T>;
+  auto iter = std::lower_bound(_sorted_ids, _sorted_ids + _node_count, value, [this] (NodeId id, const T &v) {
+    return Codec::less(_values, _node_count, id, v);
+  });
+  if (iter != _sorted_ids + _node_count && Codec::equal(_values, _node_count, *iter, value)) {
+    return *iter;
+  }
+  return InvalidNode;
+}
+
+} // namespace pockets
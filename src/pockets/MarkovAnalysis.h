@@ -0,0 +1,279 @@
+/*
+ * Copyright (c) 2015 David Wicks, sansumbrella.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+#include "Pockets.h"
+#include "Parallel.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+namespace pockets {
+
+namespace detail {
+
+template <typename V>
+const V* csr_data(const std::vector<V> &values) { return values.data(); }
+template <typename V>
+const V* csr_data(const V *values) { return values; }
+
+} // namespace detail
+
+///
+/// Transition probabilities of a compiled markov graph, arranged for computing how
+/// a probability distribution over nodes evolves as the chain runs.
+///
+/// Stores the transposed CSR matrix: row j lists every (i, P[i][j]), so one step
+/// x'[j] = sum_i x[i] P[i][j] computes each output independently and splits across threads without locking.
+/// Nodes without exits stay where they are, as in CompactMarkovGraph::nextNode.
+///
+/// MarkovTransitionMatrix matrix(graph.freeze());
+/// auto visits = matrix.stationaryDistribution().probabilities;
+///
+class MarkovTransitionMatrix
+{
+public:
+  struct Stationary
+  {
+    std::vector<double> probabilities;
+    size_t              iterations = 0;
+    /// L1 change over the final iteration.
+    double              residual = 0.0;
+    bool                converged = false;
+  };
+
+  MarkovTransitionMatrix() = default;
+  /// Build from raw CSR arrays in the CompactMarkovGraph layout: normalized cumulative weights per row.
+  MarkovTransitionMatrix(size_t node_count, const uint64_t *offsets, const uint32_t *targets, const float *cumulative);
+  /// Build from a CompactMarkovGraph or MappedMarkovGraph.
+  template <typename Graph>
+  explicit MarkovTransitionMatrix(const Graph &graph)
+  : MarkovTransitionMatrix(graph.nodeCount(), detail::csr_data(graph.offsets()), detail::csr_data(graph.targets()), detail::csr_data(graph.cumulativeWeights()))
+  {}
+
+  /// Advance \a distribution by one step of the chain into \a result. Both hold size() probabilities.
+  void    step(const double *distribution, double *result, size_t thread_count = 0) const;
+
+  /// Returns \a distribution after \a steps steps of the chain.
+  std::vector<double> distributionAfter(std::vector<double> distribution, size_t steps, size_t thread_count = 0) const;
+
+  /// Returns the probability of being at each node \a steps steps after starting at node \a from.
+  std::vector<double> transitionsFrom(uint32_t from, size_t steps, size_t thread_count = 0) const
+  {
+    auto start = std::vector<double>(size(), 0.0);
+    start[from] = 1.0;
+    return distributionAfter(std::move(start), steps, thread_count);
+  }
+
+  ///
+  /// Long-run fraction of time the chain spends at each node, by power iteration from the uniform distribution.
+  /// Iterates the lazy chain (x + xP) / 2, which has the same stationary distribution but also converges
+  /// for periodic chains. Stops once the L1 change in an iteration falls below \a tolerance.
+  /// For chains with several closed classes, the result is the limit reached from the uniform start.
+  ///
+  Stationary stationaryDistribution(double tolerance = 1e-10, size_t max_iterations = 10000, size_t thread_count = 0) const;
+
+  size_t  size() const { return _node_count; }
+  size_t  entryCount() const { return _sources.size(); }
+
+private:
+  /// Threads worth using per step; small matrices aren't worth the thread startup or the synchronization.
+  size_t  stepThreads(size_t thread_count) const
+  {
+    return std::min({ resolve_thread_count(thread_count), _sources.size() / (64 * 1024) + 1, std::max<size_t>(_node_count, 1) });
+  }
+
+  /// First row of \a chunk when rows are split into \a chunks contiguous ranges.
+  size_t  chunkStart(size_t chunk, size_t chunks) const { return _node_count * chunk / chunks; }
+
+  /// Compute rows [begin, end) of one step of \a distribution into \a result.
+  void    stepRows(const double *distribution, double *result, size_t begin, size_t end) const
+  {
+    for (auto j = begin; j < end; j += 1)
+    {
+      auto sum = 0.0;
+      for (auto e = _offsets[j]; e < _offsets[j + 1]; e += 1) {
+        sum += distribution[_sources[e]] * _probabilities[e];
+      }
+      result[j] = sum;
+    }
+  }
+
+  size_t                _node_count = 0;
+  std::vector<uint64_t> _offsets;
+  std::vector<uint32_t> _sources;
+  std::vector<double>   _probabilities;
+};
+
+inline MarkovTransitionMatrix::MarkovTransitionMatrix(size_t node_count, const uint64_t *offsets, const uint32_t *targets, const float *cumulative)
+: _node_count(node_count),
+  _offsets(node_count + 1, 0)
+{
+  // count entries per destination; nodes without exits keep a self loop
+  for (size_t i = 0; i < node_count; i += 1)
+  {
+    if (offsets[i] == offsets[i + 1]) {
+      _offsets[i + 1] += 1;
+    }
+    for (auto e = offsets[i]; e < offsets[i + 1]; e += 1) {
+      _offsets[targets[e] + 1] += 1;
+    }
+  }
+  for (size_t j = 1; j <= node_count; j += 1) {
+    _offsets[j] += _offsets[j - 1];
+  }
+
+  // scatter in source order, so each row's sources ascend and reads of the distribution stay local
+  _sources.resize(_offsets.back());
+  _probabilities.resize(_offsets.back());
+  auto cursor = std::vector<uint64_t>(_offsets.begin(), _offsets.end() - 1);
+  for (size_t i = 0; i < node_count; i += 1)
+  {
+    if (offsets[i] == offsets[i + 1])
+    {
+      const auto position = cursor[i]++;
+      _sources[position] = static_cast<uint32_t>(i);
+      _probabilities[position] = 1.0;
+    }
+    auto previous = 0.0f;
+    for (auto e = offsets[i]; e < offsets[i + 1]; e += 1)
+    {
+      const auto position = cursor[targets[e]]++;
+      _sources[position] = static_cast<uint32_t>(i);
+      _probabilities[position] = static_cast<double>(cumulative[e]) - previous;
+      previous = cumulative[e];
+    }
+  }
+}
+
+inline void MarkovTransitionMatrix::step(const double *distribution, double *result, size_t thread_count) const
+{
+  parallel_for_chunks(_node_count, stepThreads(thread_count), [&] (size_t begin, size_t end, size_t) {
+    stepRows(distribution, result, begin, end);
+  });
+}
+
+inline std::vector<double> MarkovTransitionMatrix::distributionAfter(std::vector<double> distribution, size_t steps, size_t thread_count) const
+{
+  // start the threads once and step in lockstep, rather than starting them again every step
+  auto next = std::vector<double>(distribution.size());
+  double *buffers[2] = { distribution.data(), next.data() };
+  const auto chunks = stepThreads(thread_count);
+  thread_barrier barrier(chunks);
+  parallel_for_chunks(chunks, chunks, [&] (size_t, size_t, size_t chunk) {
+    const auto begin = chunkStart(chunk, chunks);
+    const auto end = chunkStart(chunk + 1, chunks);
+    for (size_t s = 0; s < steps; s += 1)
+    {
+      stepRows(buffers[s % 2], buffers[(s + 1) % 2], begin, end);
+      barrier.wait();
+    }
+  });
+  if (steps % 2 == 1) {
+    std::swap(distribution, next);
+  }
+  return distribution;
+}
+
+inline auto MarkovTransitionMatrix::stationaryDistribution(double tolerance, size_t max_iterations, size_t thread_count) const -> Stationary
+{
+  auto result = Stationary();
+  if (_node_count == 0)
+  {
+    result.converged = true;
+    return result;
+  }
+
+  const auto n = _node_count;
+  auto x = std::vector<double>(n, 1.0 / n);
+  auto next = std::vector<double>(n);
+  double *buffers[2] = { x.data(), next.data() };
+
+  // Threads start once and iterate in lockstep. Each owns a range of rows and publishes partial sums;
+  // every thread adds the partials in the same order, so all of them agree on the scale and when to stop.
+  const auto chunks = stepThreads(thread_count);
+  auto totals = std::vector<double>(chunks);
+  auto residuals = std::vector<double>(chunks);
+  thread_barrier barrier(chunks);
+  parallel_for_chunks(chunks, chunks, [&] (size_t, size_t, size_t chunk) {
+    const auto begin = chunkStart(chunk, chunks);
+    const auto end = chunkStart(chunk + 1, chunks);
+    for (size_t iteration = 0; iteration < max_iterations; iteration += 1)
+    {
+      const auto *current = buffers[iteration % 2];
+      auto *following = buffers[(iteration + 1) % 2];
+      stepRows(current, following, begin, end);
+
+      // lazy mix, renormalize against drift, and measure the change; plain loops over contiguous arrays vectorize
+      auto total = 0.0;
+      for (auto j = begin; j < end; j += 1)
+      {
+        following[j] = 0.5 * (current[j] + following[j]);
+        total += following[j];
+      }
+      totals[chunk] = total;
+      barrier.wait();
+
+      total = 0.0;
+      for (auto t: totals) {
+        total += t;
+      }
+      const auto scale = 1.0 / total;
+      auto residual = 0.0;
+      for (auto j = begin; j < end; j += 1)
+      {
+        following[j] *= scale;
+        residual += std::abs(following[j] - current[j]);
+      }
+      residuals[chunk] = residual;
+      barrier.wait();
+
+      residual = 0.0;
+      for (auto r: residuals) {
+        residual += r;
+      }
+      if (chunk == 0)
+      {
+        result.iterations = iteration + 1;
+        result.residual = residual;
+        result.converged = residual < tolerance;
+      }
+      if (residual < tolerance) {
+        break;
+      }
+    }
+  });
+
+  if (result.iterations % 2 == 1) {
+    std::swap(x, next);
+  }
+  result.probabilities = std::move(x);
+  return result;
+}
+
+} // namespace pockets
@@ -0,0 +1,540 @@
+/*
+ * Copyright (c) 2015 David Wicks, sansumbrella.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+#include "Pockets.h"
+#include "Parallel.h"
+#include "WeightedSampling.h"
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+namespace pockets {
+
+namespace detail {
+
+/// Hash of the \a order tokens starting at \a first. Used to key order-k contexts.
+template <typename T, typename Hash>
+uint64_t hash_markov_context(const T *first, size_t order, const Hash &hash)
+{
+  auto h = mix_bits(order);
+  for (size_t i = 0; i < order; i += 1) {
+    h = mix_bits(h ^ (static_cast<uint64_t>(hash(first[i])) + 0x9E3779B97F4A7C15ull));
+  }
+  return h;
+}
+
+} // namespace detail
+
+template <typename T, typename Hash>
+class MarkovTrainer;
+
+///
+/// Order-k markov chain over sequences of tokens, as built by MarkovTrainer.
+/// The next token depends on the previous order() tokens. Contexts are identified
+/// by a 64-bit hash of their tokens; each context's exits are stored in compressed
+/// sparse rows, like CompactMarkovGraph.
+///
+template <typename T, typename Hash = std::hash<T>>
+class MarkovChain
+{
+public:
+  MarkovChain() = default;
+
+  size_t    order() const { return _order; }
+
+  ///
+  /// Return the token that follows the order() tokens starting at \a context, sampled at normalized position t.
+  /// Returns nullptr if the context never appeared in training.
+  ///
+  const T*  nextToken(const T *context, float t) const;
+
+  /// Returns the trained probability of \a next following the order() tokens starting at \a context.
+  float     probability(const T *context, const T &next) const;
+
+  ///
+  /// Extend \a prefix to \a length tokens by sampling the chain.
+  /// Stops early if the prefix is shorter than order() or the walk reaches an unseen context.
+  /// Step s draws counter_uniform(seed, 0, s), so the output is reproducible.
+  ///
+  std::vector<T> generate(std::vector<T> prefix, size_t length, uint64_t seed) const;
+
+  size_t    contextCount() const { return _rows.size(); }
+  size_t    transitionCount() const { return _tokens.size(); }
+
+  /// Approximate heap footprint in bytes. Does not count memory owned by the tokens themselves.
+  size_t    memoryUsage() const;
+
+private:
+  friend class MarkovTrainer<T, Hash>;
+
+  /// Returns the row of the context starting at \a context, or _offsets.size() if it is unknown.
+  size_t    findRow(const T *context) const
+  {
+    auto iter = _rows.find(detail::hash_markov_context(context, _order, _hash));
+    return iter != _rows.end() ? iter->second : _offsets.size();
+  }
+
+  size_t                                  _order = 0;
+  Hash                                    _hash;
+  std::unordered_map<uint64_t, uint32_t>  _rows;
+  std::vector<uint64_t>                   _offsets;
+  std::vector<T>                          _tokens;
+  /// Running totals of each row's probabilities; every row ends at exactly 1.
+  std::vector<float>                      _cumulative;
+};
+
+///
+/// Counts order-k transitions in token sequences and builds a MarkovChain from them.
+///
+/// Sequences are split across threads. Each thread counts into its own open-addressing staging table,
+/// which is merged into a sharded global table whenever it fills its share of the
+/// staging budget, and once more at the end. Staging memory is therefore bounded no matter
+/// how much text is added; the global table grows with the number of distinct
+/// (context, next token) pairs, which is the size of the model itself.
+///
+/// To stream one long sequence in blocks, overlap consecutive blocks by order() tokens
+/// so that no transition is lost or counted twice.
+///
+/// MarkovTrainer<std::string> trainer(2);
+/// trainer.addSequences(sentences);
+/// auto chain = trainer.build();
+///
+/// Adding sequences is not safe to call from several threads at once; it is parallel internally.
+///
+template <typename T, typename Hash = std::hash<T>>
+class MarkovTrainer
+{
+public:
+  /// Train contexts of \a order tokens, staging up to \a staging_bytes of counts across all threads between merges.
+  explicit MarkovTrainer(size_t order, size_t staging_bytes = 64 * 1024 * 1024)
+  : _order(order),
+    _staging_bytes(staging_bytes)
+  {}
+
+  MarkovTrainer(const MarkovTrainer &) = delete;
+  MarkovTrainer& operator = (const MarkovTrainer &) = delete;
+
+  /// Count every transition in one sequence, splitting its positions across threads.
+  void    addSequence(const T *tokens, size_t count, size_t thread_count = 0);
+  void    addSequence(const std::vector<T> &tokens, size_t thread_count = 0) { addSequence(tokens.data(), tokens.size(), thread_count); }
+  /// Count every transition in each sequence, splitting the sequences across threads. No context spans two sequences.
+  void    addSequences(const std::vector<std::vector<T>> &sequences, size_t thread_count = 0);
+
+  /// Build a sampleable chain from the counts so far. Training may continue afterward.
+  MarkovChain<T, Hash> build() const;
+
+  size_t  order() const { return _order; }
+  /// Number of distinct (context, next token) pairs counted so far.
+  size_t  pairCount() const;
+  void    clear();
+
+private:
+  struct Key
+  {
+    uint64_t  context = 0;
+    T         next = T();
+
+    bool operator == (const Key &rhs) const { return context == rhs.context && next == rhs.next; }
+  };
+
+  ///
+  /// Open-addressing table of counts with linear probing. A slot with zero count is empty.
+  /// Keys carry their full hash, so growing never rehashes tokens; the top bits pick a shard
+  /// and the low bits a slot.
+  ///
+  class CountTable
+  {
+  public:
+    struct Slot
+    {
+      uint64_t  hash = 0;
+      uint64_t  count = 0;
+      Key       key;
+    };
+
+    /// Adds \a count to the entry for \a key. Returns true if the entry is new.
+    bool    add(const Key &key, uint64_t hash, uint64_t count);
+    /// Allocates room for \a entries without growing.
+    void    reserve(size_t entries);
+    /// Empties the table, keeping its capacity.
+    void    clear();
+
+    size_t  size() const { return _size; }
+    const std::vector<Slot>& slots() const { return _slots; }
+
+  private:
+    std::vector<Slot> _slots;
+    size_t            _size = 0;
+  };
+
+  static const size_t ShardBits = 6;
+  static const size_t ShardCount = size_t(1) << ShardBits;
+
+  struct Shard
+  {
+    std::mutex  mutex;
+    CountTable  counts;
+  };
+
+  /// One thread's counts, merged into the shards whenever it holds \a limit entries.
+  struct Staging
+  {
+    CountTable            counts;
+    size_t                limit = 0;
+    /// Slot indices grouped by shard, reused across merges.
+    std::vector<uint32_t> order;
+  };
+
+  static size_t shardOf(uint64_t hash) { return static_cast<size_t>(hash >> (64 - ShardBits)); }
+
+  void    prepare(Staging &staging, size_t thread_count) const;
+  void    countTransition(const T *context, const T &next, Staging &staging);
+  void    merge(Staging &staging);
+
+  size_t                        _order;
+  size_t                        _staging_bytes;
+  Hash                          _hash;
+  std::array<Shard, ShardCount> _shards;
+};
+
+// ===================================
+// MarkovChain Template Implementation
+// ===================================
+
+template <typename T, typename Hash>
+const T* MarkovChain<T, Hash>::nextToken(const T *context, float t) const
+{
+  const auto row = findRow(context);
+  if (row >= _offsets.size()) {
+    return nullptr;
+  }
+
+  const auto begin = _cumulative.begin() + _offsets[row];
+  const auto end = _cumulative.begin() + _offsets[row + 1];
+  auto iter = std::upper_bound(begin, end, t);
+  if (iter == end) {
+    iter = end - 1;
+  }
+  return &_tokens[_offsets[row] + std::distance(begin, iter)];
+}
+
+template <typename T, typename Hash>
+float MarkovChain<T, Hash>::probability(const T *context, const T &next) const
+{
+  const auto row = findRow(context);
+  if (row >= _offsets.size()) {
+    return 0.0f;
+  }
+
+  auto previous = 0.0f;
+  for (auto i = _offsets[row]; i < _offsets[row + 1]; i += 1)
+  {
+    if (_tokens[i] == next) {
+      return _cumulative[i] - previous;
+    }
+    previous = _cumulative[i];
+  }
+  return 0.0f;
+}
+
+template <typename T, typename Hash>
+std::vector<T> MarkovChain<T, Hash>::generate(std::vector<T> prefix, size_t length, uint64_t seed) const
+{
+  if (prefix.size() < _order) {
+    return prefix;
+  }
+
+  prefix.reserve(length);
+  for (auto step = prefix.size(); step < length; step += 1)
+  {
+    auto next = nextToken(prefix.data() + prefix.size() - _order, counter_uniform(seed, 0, step));
+    if (! next) {
+      break;
+    }
+    prefix.push_back(*next);
+  }
+  return prefix;
+}
+
+template <typename T, typename Hash>
+size_t MarkovChain<T, Hash>::memoryUsage() const
+{
+  const auto row_table = _rows.bucket_count() * sizeof(void*) + _rows.size() * (sizeof(std::pair<const uint64_t, uint32_t>) + 2 * sizeof(void*));
+  return row_table
+    + _offsets.capacity() * sizeof(uint64_t)
+    + _tokens.capacity() * sizeof(T)
+    + _cumulative.capacity() * sizeof(float);
+}
+
+// ===================================
+// MarkovTrainer Template Implementation
+// ===================================
+
+template <typename T, typename Hash>
+bool MarkovTrainer<T, Hash>::CountTable::add(const Key &key, uint64_t hash, uint64_t count)
+{
+  if ((_size + 1) * 2 > _slots.size()) {
+    reserve(std::max<size_t>(16, _slots.size()));
+  }
+
+  const auto mask = _slots.size() - 1;
+  for (auto i = static_cast<size_t>(hash) & mask;; i = (i + 1) & mask)
+  {
+    auto &slot = _slots[i];
+    if (slot.count == 0)
+    {
+      slot.hash = hash;
+      slot.count = count;
+      slot.key = key;
+      _size += 1;
+      return true;
+    }
+    if (slot.hash == hash && slot.key == key)
+    {
+      slot.count += count;
+      return false;
+    }
+  }
+}
+
+template <typename T, typename Hash>
+void MarkovTrainer<T, Hash>::CountTable::reserve(size_t entries)
+{
+  // stay at most half full so probes are short
+  auto capacity = size_t(16);
+  while (capacity < entries * 2) {
+    capacity *= 2;
+  }
+  if (capacity <= _slots.size()) {
+    return;
+  }
+
+  auto previous = std::vector<Slot>(capacity);
+  std::swap(previous, _slots);
+  const auto mask = _slots.size() - 1;
+  for (auto &slot: previous)
+  {
+    if (slot.count == 0) {
+      continue;
+    }
+    auto i = static_cast<size_t>(slot.hash) & mask;
+    while (_slots[i].count != 0) {
+      i = (i + 1) & mask;
+    }
+    _slots[i] = std::move(slot);
+  }
+}
+
+template <typename T, typename Hash>
+void MarkovTrainer<T, Hash>::CountTable::clear()
+{
+  for (auto &slot: _slots) {
+    slot.count = 0;
+  }
+  _size = 0;
+}
+
+template <typename T, typename Hash>
+void MarkovTrainer<T, Hash>::prepare(Staging &staging, size_t thread_count) const
+{
+  // each thread gets an equal share of the budget; the table is kept at most half full
+  const auto slot_bytes = sizeof(typename CountTable::Slot);
+  const auto entries = _staging_bytes / std::max<size_t>(1, thread_count) / (2 * slot_bytes);
+  staging.limit = std::max<size_t>(1024, entries);
+  staging.counts.reserve(staging.limit);
+}
+
+template <typename T, typename Hash>
+void MarkovTrainer<T, Hash>::countTransition(const T *context, const T &next, Staging &staging)
+{
+  const auto key = Key{ detail::hash_markov_context(context, _order, _hash), next };
+  staging.counts.add(key, mix_bits(key.context ^ static_cast<uint64_t>(_hash(next))), 1);
+  if (staging.counts.size() >= staging.limit) {
+    merge(staging);
+  }
+}
+
+template <typename T, typename Hash>
+void MarkovTrainer<T, Hash>::merge(Staging &staging)
+{
+  // counting sort of the occupied slots by shard, so each shard is locked once
+  auto &slots = staging.counts.slots();
+  auto starts = std::array<size_t, ShardCount + 1>();
+  starts.fill(0);
+  for (auto &slot: slots)
+  {
+    if (slot.count != 0) {
+      starts[shardOf(slot.hash) + 1] += 1;
+    }
+  }
+  for (size_t s = 1; s <= ShardCount; s += 1) {
+    starts[s] += starts[s - 1];
+  }
+
+  staging.order.resize(staging.counts.size());
+  auto cursor = starts;
+  for (size_t i = 0; i < slots.size(); i += 1)
+  {
+    if (slots[i].count != 0) {
+      staging.order[cursor[shardOf(slots[i].hash)]++] = static_cast<uint32_t>(i);
+    }
+  }
+
+  for (size_t s = 0; s < ShardCount; s += 1)
+  {
+    if (starts[s] == starts[s + 1]) {
+      continue;
+    }
+
+    auto &shard = _shards[s];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    for (auto i = starts[s]; i < starts[s + 1]; i += 1)
+    {
+      auto &slot = slots[staging.order[i]];
+      shard.counts.add(slot.key, slot.hash, slot.count);
+    }
+  }
+  staging.counts.clear();
+}
+
+template <typename T, typename Hash>
+void MarkovTrainer<T, Hash>::addSequence(const T *tokens, size_t count, size_t thread_count)
+{
+  if (count <= _order) {
+    return;
+  }
+
+  const auto transitions = count - _order;
+  const auto threads = std::min(resolve_thread_count(thread_count), transitions);
+  parallel_for_chunks(transitions, threads, [&] (size_t begin, size_t end, size_t) {
+    auto staging = std::unique_ptr<Staging>(new Staging);
+    prepare(*staging, threads);
+    for (auto i = begin; i < end; i += 1) {
+      countTransition(tokens + i, tokens[i + _order], *staging);
+    }
+    merge(*staging);
+  });
+}
+
+template <typename T, typename Hash>
+void MarkovTrainer<T, Hash>::addSequences(const std::vector<std::vector<T>> &sequences, size_t thread_count)
+{
+  const auto threads = std::min(resolve_thread_count(thread_count), sequences.size());
+  parallel_for_chunks(sequences.size(), threads, [&] (size_t begin, size_t end, size_t) {
+    auto staging = std::unique_ptr<Staging>(new Staging);
+    prepare(*staging, threads);
+    for (auto s = begin; s < end; s += 1)
+    {
+      auto &tokens = sequences[s];
+      for (size_t i = 0; i + _order < tokens.size(); i += 1) {
+        countTransition(tokens.data() + i, tokens[i + _order], *staging);
+      }
+    }
+    merge(*staging);
+  });
+}
+
+template <typename T, typename Hash>
+MarkovChain<T, Hash> MarkovTrainer<T, Hash>::build() const
+{
+  using Entry = const typename CountTable::Slot*;
+  auto entries = std::vector<Entry>();
+  entries.reserve(pairCount());
+  for (auto &shard: _shards)
+  {
+    for (auto &slot: shard.counts.slots())
+    {
+      if (slot.count != 0) {
+        entries.push_back(&slot);
+      }
+    }
+  }
+
+  // group by context; order within a row by hash so the result doesn't depend on thread scheduling
+  std::sort(entries.begin(), entries.end(), [] (Entry a, Entry b) {
+    if (a->key.context != b->key.context) {
+      return a->key.context < b->key.context;
+    }
+    return a->hash < b->hash;
+  });
+
+  auto chain = MarkovChain<T, Hash>();
+  chain._order = _order;
+  chain._tokens.reserve(entries.size());
+  chain._cumulative.reserve(entries.size());
+
+  for (size_t begin = 0; begin < entries.size();)
+  {
+    const auto context = entries[begin]->key.context;
+    auto end = begin;
+    auto total = 0.0;
+    while (end < entries.size() && entries[end]->key.context == context)
+    {
+      total += static_cast<double>(entries[end]->count);
+      end += 1;
+    }
+
+    chain._rows[context] = static_cast<uint32_t>(chain._offsets.size());
+    chain._offsets.push_back(chain._tokens.size());
+    auto running = 0.0;
+    for (auto i = begin; i < end; i += 1)
+    {
+      running += static_cast<double>(entries[i]->count);
+      chain._tokens.push_back(entries[i]->key.next);
+      chain._cumulative.push_back(static_cast<float>(running / total));
+    }
+    chain._cumulative.back() = 1.0f;
+    begin = end;
+  }
+  chain._offsets.push_back(chain._tokens.size());
+
+  return chain;
+}
+
+template <typename T, typename Hash>
+size_t MarkovTrainer<T, Hash>::pairCount() const
+{
+  auto total = size_t(0);
+  for (auto &shard: _shards) {
+    total += shard.counts.size();
+  }
+  return total;
+}
+
+template <typename T, typename Hash>
+void MarkovTrainer<T, Hash>::clear()
+{
+  for (auto &shard: _shards) {
+    shard.counts.clear();
+  }
+}
+
+} // namespace pockets
@@ -0,0 +1,129 @@
+/*
+ * Copyright (c) 2015 David Wicks, sansumbrella.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+#include "Pockets.h"
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace pockets {
+
+/// Returns \a requested, or the number of hardware threads if \a requested is zero.
+inline size_t resolve_thread_count(size_t requested)
+{
+  if (requested > 0) {
+    return requested;
+  }
+  return std::max<size_t>(1, std::thread::hardware_concurrency());
+}
+
+///
+/// Splits [0, count) into contiguous chunks and calls fn(begin, end, chunk_index) for each on its own thread.
+/// Uses at most \a thread_count threads (zero means one per hardware thread) and never more than \a count.
+/// The calling thread runs the first chunk. Returns once every chunk is done.
+///
+/// parallel_for_chunks(items.size(), 0, [&] (size_t begin, size_t end, size_t) {
+///   for (auto i = begin; i < end; i += 1) { process(items[i]); }
+/// });
+///
+template <typename Fn>
+void parallel_for_chunks(size_t count, size_t thread_count, Fn &&fn)
+{
+  const auto chunks = std::min(resolve_thread_count(thread_count), count);
+  if (chunks <= 1)
+  {
+    fn(size_t(0), count, size_t(0));
+    return;
+  }
+
+  const auto chunk_size = (count + chunks - 1) / chunks;
+  auto threads = std::vector<std::thread>();
+  threads.reserve(chunks - 1);
+  for (size_t chunk = 1; chunk < chunks; chunk += 1)
+  {
+    const auto begin = std::min(count, chunk * chunk_size);
+    const auto end = std::min(count, begin + chunk_size);
+    threads.emplace_back([&fn, begin, end, chunk] { fn(begin, end, chunk); });
+  }
+  fn(size_t(0), std::min(count, chunk_size), size_t(0));
+
+  for (auto &t: threads) {
+    t.join();
+  }
+}
+
+///
+/// Holds each of \a count threads at wait() until all of them have arrived, then releases them together.
+/// Reusable, so threads started once by parallel_for_chunks can run many dependent rounds of work.
+///
+/// thread_barrier barrier(chunks);
+/// parallel_for_chunks(chunks, chunks, [&] (size_t, size_t, size_t chunk) {
+///   for (auto round = 0; round < rounds; round += 1) { work(chunk); barrier.wait(); }
+/// });
+///
+class thread_barrier
+{
+public:
+  explicit thread_barrier(size_t count)
+  : _count(count)
+  {}
+
+  thread_barrier(const thread_barrier &) = delete;
+  thread_barrier& operator = (const thread_barrier &) = delete;
+
+  void wait()
+  {
+    if (_count <= 1) {
+      return;
+    }
+    std::unique_lock<std::mutex> lock(_mutex);
+    const auto generation = _generation;
+    _arrived += 1;
+    if (_arrived == _count)
+    {
+      _arrived = 0;
+      _generation += 1;
+      _released.notify_all();
+    }
+    else
+    {
+      _released.wait(lock, [this, generation] { return _generation != generation; });
+    }
+  }
+
+private:
+  std::mutex              _mutex;
+  std::condition_variable _released;
+  size_t                  _count;
+  size_t                  _arrived = 0;
+  size_t                  _generation = 0;
+};
+
+} // namespace pockets
@@ -0,0 +1,211 @@
+/*
+ * Copyright (c) 2015 David Wicks, sansumbrella.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#pragma once
+
+#include "Pockets.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+  #include <emmintrin.h>
+  #define POCKETS_SSE2 1
+#endif
+
+namespace pockets
+{
+
+/// Pixel rectangle [x1, x2) x [y1, y2).
+struct PixelBounds
+{
+  PixelBounds() = default;
+  PixelBounds(int x1, int y1, int x2, int y2)
+  : x1(x1),
+    y1(y1),
+    x2(x2),
+    y2(y2)
+  {}
+
+  int x1 = 0;
+  int y1 = 0;
+  int x2 = 0;
+  int y2 = 0;
+
+  bool  empty() const { return x2 <= x1 || y2 <= y1; }
+  int   width() const { return x2 - x1; }
+  int   height() const { return y2 - y1; }
+};
+
+namespace detail
+{
+
+/// Exact round(value / 255) for value in [0, 255 * 255].
+inline uint32_t div255(uint32_t value)
+{
+  value += 128;
+  return (value + (value >> 8)) >> 8;
+}
+
+/// Alpha bits of a 4-byte pixel read as a little-endian word, with alpha at byte \a alpha_offset.
+inline uint32_t alpha_mask(int alpha_offset)
+{
+  return 0xFFu << (8 * alpha_offset);
+}
+
+/// Index of the first pixel in [begin, end) of \a row with nonzero alpha, or \a end if there is none.
+inline int first_opaque(const uint8_t *row, int begin, int end, int alpha_offset)
+{
+  auto x = begin;
+#if defined(POCKETS_SSE2)
+  const auto mask = _mm_set1_epi32(static_cast<int>(alpha_mask(alpha_offset)));
+  const auto zero = _mm_setzero_si128();
+  for (; end - x >= 4; x += 4)
+  {
+    const auto pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x * 4));
+    // one bit per pixel, set where alpha is zero
+    const auto clear = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(pixels, mask), zero)));
+    if (clear != 0xF) {
+      break;
+    }
+  }
+#endif
+  for (; x < end; x += 1)
+  {
+    if (row[x * 4 + alpha_offset] != 0) {
+      return x;
+    }
+  }
+  return end;
+}
+
+/// One past the last pixel in [begin, end) of \a row with nonzero alpha, or \a begin if there is none.
+inline int last_opaque(const uint8_t *row, int begin, int end, int alpha_offset)
+{
+  auto x = end;
+#if defined(POCKETS_SSE2)
+  const auto mask = _mm_set1_epi32(static_cast<int>(alpha_mask(alpha_offset)));
+  const auto zero = _mm_setzero_si128();
+  for (; x - begin >= 4; x -= 4)
+  {
+    const auto pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + (x - 4) * 4));
+    const auto clear = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(pixels, mask), zero)));
+    if (clear != 0xF) {
+      break;
+    }
+  }
+#endif
+  for (; x > begin; x -= 1)
+  {
+    if (row[(x - 1) * 4 + alpha_offset] != 0) {
+      return x;
+    }
+  }
+  return begin;
+}
+
+} // namespace detail
+
+///
+/// Smallest rectangle holding every pixel with nonzero alpha in a 4-byte-per-pixel image,
+/// or empty bounds if every pixel is transparent. \a alpha_offset is the alpha byte's index in a pixel.
+/// Rows are tested four pixels at a time with SSE2 where available. Only the top and bottom rows are
+/// scanned in full; rows between them are searched only outside the bounds found so far.
+///
+inline PixelBounds alpha_bounds_rgba8(const uint8_t *pixels, int width, int height, ptrdiff_t row_bytes, int alpha_offset = 3)
+{
+  auto row = [=] (int y) { return pixels + y * row_bytes; };
+  auto top = 0;
+  auto left = width;
+  while (top < height && (left = detail::first_opaque(row(top), 0, width, alpha_offset)) == width) {
+    top += 1;
+  }
+  if (top == height) {
+    return PixelBounds();
+  }
+
+  auto bottom = height;
+  auto right = 0;
+  while ((right = detail::last_opaque(row(bottom - 1), 0, width, alpha_offset)) == 0) {
+    bottom -= 1;
+  }
+  right = std::max(right, detail::last_opaque(row(top), 0, width, alpha_offset));
+  left = std::min(left, detail::first_opaque(row(bottom - 1), 0, width, alpha_offset));
+
+  for (auto y = top + 1; y < bottom - 1 && (left > 0 || right < width); y += 1)
+  {
+    left = detail::first_opaque(row(y), 0, left, alpha_offset);
+    right = detail::last_opaque(row(y), right, width, alpha_offset);
+  }
+  return PixelBounds{ left, top, right, bottom };
+}
+
+///
+/// Multiply the color channels of 4-byte pixels with alpha last (RGBA or BGRA) by their alpha, in place.
+/// Rounds exactly: each channel becomes round(c * a / 255). Runs four pixels at a time with SSE2 where available.
+///
+inline void premultiply_rgba8(uint8_t *pixels, int width, int height, ptrdiff_t row_bytes)
+{
+  for (auto y = 0; y < height; y += 1)
+  {
+    auto *p = pixels + y * row_bytes;
+    auto x = 0;
+#if defined(POCKETS_SSE2)
+    const auto zero = _mm_setzero_si128();
+    // keeps the color lanes of the broadcast alphas, and multiplies alpha by 255 so it rounds back to itself
+    const auto color_lanes = _mm_set_epi16(0, -1, -1, -1, 0, -1, -1, -1);
+    const auto alpha_255 = _mm_set_epi16(255, 0, 0, 0, 255, 0, 0, 0);
+    const auto bias = _mm_set1_epi16(128);
+    auto scale = [&] (__m128i channels) {
+      auto alphas = _mm_shufflehi_epi16(_mm_shufflelo_epi16(channels, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+      alphas = _mm_or_si128(_mm_and_si128(alphas, color_lanes), alpha_255);
+      const auto product = _mm_add_epi16(_mm_mullo_epi16(channels, alphas), bias);
+      return _mm_srli_epi16(_mm_add_epi16(product, _mm_srli_epi16(product, 8)), 8);
+    };
+    for (; width - x >= 4; x += 4)
+    {
+      auto *block = reinterpret_cast<__m128i*>(p + x * 4);
+      const auto quad = _mm_loadu_si128(block);
+      const auto low = scale(_mm_unpacklo_epi8(quad, zero));
+      const auto high = scale(_mm_unpackhi_epi8(quad, zero));
+      _mm_storeu_si128(block, _mm_packus_epi16(low, high));
+    }
+#endif
+    for (; x < width; x += 1)
+    {
+      auto *pixel = p + static_cast<ptrdiff_t>(x) * 4;
+      const auto a = pixel[3];
+      pixel[0] = static_cast<uint8_t>(detail::div255(pixel[0] * a));
+      pixel[1] = static_cast<uint8_t>(detail::div255(pixel[1] * a));
+      pixel[2] = static_cast<uint8_t>(detail::div255(pixel[2] * a));
+    }
+  }
+}
+
+} // namespace pockets
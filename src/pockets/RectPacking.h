@@ -0,0 +1,517 @@
+/*
+ * Copyright (c) 2015 David Wicks, sansumbrella.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#pragma once
+#include "Pockets.h"
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+#include <vector>
+
+namespace pockets {
+
+/// Passed as a packer's height to let it grow downward without limit.
+const int UnboundedPackHeight = std::numeric_limits<int>::max() / 2;
+
+struct PackSize
+{
+  PackSize() = default;
+  PackSize(int width, int height)
+  : width(width),
+    height(height)
+  {}
+
+  int width = 0;
+  int height = 0;
+};
+
+/// Top-left corner of a packed rectangle, and the page it is on. \a placed is false if it didn't fit.
+struct PackPlacement
+{
+  PackPlacement() = default;
+  PackPlacement(int x, int y, bool placed, int page = 0)
+  : x(x),
+    y(y),
+    placed(placed),
+    page(page)
+  {}
+
+  int   x = 0;
+  int   y = 0;
+  bool  placed = false;
+  int   page = 0;
+};
+
+enum class PackingAlgorithm
+{
+  /// Rows of rectangles, each as tall as its tallest. Fastest, and loosest.
+  Shelf,
+  /// Rests each rectangle on the outline of those below it. Fast, and tight for similar sizes.
+  Skyline,
+  /// Tracks every maximal free rectangle. Slowest, and tightest for mixed sizes.
+  MaxRects
+};
+
+///
+/// Online shelf packer: fills a row left to right, then starts a new row below the tallest rectangle in it.
+/// Inserting is O(1). Matches the row layout of ImagePacker::calculatePositions.
+///
+class ShelfPacker
+{
+public:
+  explicit ShelfPacker(int width, int height = UnboundedPackHeight);
+
+  PackPlacement insert(int width, int height);
+  /// Bottom of the lowest rectangle placed so far.
+  int           usedHeight() const { return _shelf_y + _shelf_height; }
+  void          clear() { _x = _shelf_y = _shelf_height = 0; }
+
+private:
+  int _width;
+  int _height;
+  int _x = 0;
+  int _shelf_y = 0;
+  int _shelf_height = 0;
+};
+
+///
+/// Online skyline packer. Keeps the outline of the packed rectangles' tops as a list of horizontal
+/// segments and rests each new rectangle where its top lands lowest, preferring the narrowest segment on ties.
+/// Inserting is one pass over the segments, whose count is bounded by the packer's width rather than
+/// by the number of rectangles, so it costs the same for the hundred-thousandth rectangle as for the first.
+///
+class SkylinePacker
+{
+public:
+  /// One horizontal run of the outline, from x to x + width at height y.
+  struct Segment
+  {
+    int x;
+    int y;
+    int width;
+  };
+
+  explicit SkylinePacker(int width, int height = UnboundedPackHeight);
+
+  PackPlacement insert(int width, int height);
+  int           usedHeight() const { return _used_height; }
+  const std::vector<Segment>& skyline() const { return _skyline; }
+  void          clear();
+
+private:
+  void          place(size_t i, int y, int width, int height);
+
+  int                   _width;
+  int                   _height;
+  int                   _used_height = 0;
+  std::vector<Segment>  _skyline;
+  std::vector<size_t>   _window;
+};
+
+///
+/// MaxRects packer. Keeps every maximal free rectangle, so no space is lost to the order of insertion.
+/// Bounded packers use the best short side fit, which suits filling fixed pages;
+/// unbounded ones place the lowest bottom edge first, which keeps a growing sheet short.
+/// Inserting is linear in the number of free rectangles, plus pruning of the ones it splits.
+///
+class MaxRectsPacker
+{
+public:
+  struct Rect
+  {
+    int x;
+    int y;
+    int width;
+    int height;
+
+    int   right() const { return x + width; }
+    int   bottom() const { return y + height; }
+    bool  contains(const Rect &r) const { return r.x >= x && r.y >= y && r.right() <= right() && r.bottom() <= bottom(); }
+    bool  intersects(const Rect &r) const { return r.x < right() && r.right() > x && r.y < bottom() && r.bottom() > y; }
+  };
+
+  explicit MaxRectsPacker(int width, int height = UnboundedPackHeight);
+
+  PackPlacement insert(int width, int height);
+  int           usedHeight() const { return _used_height; }
+  const std::vector<Rect>& freeRects() const { return _free; }
+  void          clear();
+
+private:
+  /// Cut \a used out of every free rectangle it overlaps, then drop the pieces that other free rectangles contain.
+  void          splitFreeRects(const Rect &used);
+
+  int               _width;
+  int               _height;
+  int               _used_height = 0;
+  std::vector<Rect> _free;
+  std::vector<Rect> _pieces;
+};
+
+///
+/// Place \a sizes within \a width by \a height using \a algorithm. Returns placements in the order of \a sizes.
+/// Rectangles are inserted in the order each algorithm packs best: tallest first for shelves and skylines,
+/// longest side first for maxrects.
+/// Add any padding to the sizes; a rectangle that can't fit is left unplaced.
+///
+std::vector<PackPlacement> pack_rects(const std::vector<PackSize> &sizes, int width, int height = UnboundedPackHeight, PackingAlgorithm algorithm = PackingAlgorithm::MaxRects);
+
+///
+/// As pack_rects, but spills into as many \a width by \a height pages as it takes, so no page outgrows
+/// a texture size limit. Each rectangle goes on the first page with room for it; each placement's page says which.
+/// Only rectangles larger than a page are left unplaced.
+///
+std::vector<PackPlacement> pack_pages(const std::vector<PackSize> &sizes, int width, int height, PackingAlgorithm algorithm = PackingAlgorithm::MaxRects);
+
+// ===================================
+// Implementation
+// ===================================
+
+namespace detail {
+
+inline void check_pack_size(int width, int height)
+{
+  if (width < 0 || height < 0) {
+    throw std::invalid_argument("Packed rectangles can't have a negative size.");
+  }
+}
+
+} // namespace detail
+
+inline ShelfPacker::ShelfPacker(int width, int height)
+: _width(width),
+  _height(height)
+{
+  detail::check_pack_size(width, height);
+}
+
+inline PackPlacement ShelfPacker::insert(int width, int height)
+{
+  detail::check_pack_size(width, height);
+  if (width > _width) {
+    return PackPlacement();
+  }
+  // start a new shelf if this one is full, but only keep it if the rectangle fits there
+  const auto new_shelf = _x + width > _width;
+  const auto shelf_y = new_shelf ? _shelf_y + _shelf_height : _shelf_y;
+  if (height > _height - shelf_y) {
+    return PackPlacement();
+  }
+  if (new_shelf)
+  {
+    _shelf_y = shelf_y;
+    _shelf_height = 0;
+    _x = 0;
+  }
+
+  auto placement = PackPlacement{ _x, _shelf_y, true };
+  _x += width;
+  _shelf_height = std::max(_shelf_height, height);
+  return placement;
+}
+
+inline SkylinePacker::SkylinePacker(int width, int height)
+: _width(width),
+  _height(height)
+{
+  detail::check_pack_size(width, height);
+  clear();
+}
+
+inline void SkylinePacker::clear()
+{
+  _skyline.assign(1, Segment{ 0, 0, _width });
+  _used_height = 0;
+}
+
+inline PackPlacement SkylinePacker::insert(int width, int height)
+{
+  detail::check_pack_size(width, height);
+  if (width == 0 || height == 0) {
+    return PackPlacement{ 0, 0, true };
+  }
+
+  // A rectangle starting at segment i rests on the highest segment beneath it. Both ends of that
+  // window only move right as i does, so a queue of the window's segments in decreasing height
+  // gives every resting height in a single pass.
+  auto best = _skyline.size();
+  auto best_y = std::numeric_limits<int>::max();
+  auto best_width = std::numeric_limits<int>::max();
+  _window.clear();
+  auto front = size_t(0);
+  auto end = size_t(0);
+  for (size_t i = 0; i < _skyline.size() && _skyline[i].x + width <= _width; i += 1)
+  {
+    const auto right = _skyline[i].x + width;
+    for (; end < _skyline.size() && _skyline[end].x < right; end += 1)
+    {
+      while (_window.size() > front && _skyline[_window.back()].y <= _skyline[end].y) {
+        _window.pop_back();
+      }
+      _window.push_back(end);
+    }
+    while (_window[front] < i) {
+      front += 1;
+    }
+
+    const auto y = _skyline[_window[front]].y;
+    if (y <= _height - height && (y < best_y || (y == best_y && _skyline[i].width < best_width)))
+    {
+      best = i;
+      best_y = y;
+      best_width = _skyline[i].width;
+    }
+  }
+  if (best == _skyline.size()) {
+    return PackPlacement();
+  }
+
+  const auto x = _skyline[best].x;
+  place(best, best_y, width, height);
+  return PackPlacement{ x, best_y, true };
+}
+
+inline void SkylinePacker::place(size_t i, int y, int width, int height)
+{
+  const auto top = Segment{ _skyline[i].x, y + height, width };
+  _skyline.insert(_skyline.begin() + i, top);
+  _used_height = std::max(_used_height, top.y);
+
+  // trim the segments the new one covers
+  const auto right = top.x + top.width;
+  auto end = i + 1;
+  while (end < _skyline.size() && _skyline[end].x + _skyline[end].width <= right) {
+    end += 1;
+  }
+  if (end < _skyline.size() && _skyline[end].x < right)
+  {
+    _skyline[end].width -= right - _skyline[end].x;
+    _skyline[end].x = right;
+  }
+  _skyline.erase(_skyline.begin() + i + 1, _skyline.begin() + end);
+
+  // join neighbors of equal height, so the outline stays as short as possible
+  auto merge = [this] (size_t j) {
+    if (j + 1 < _skyline.size() && _skyline[j].y == _skyline[j + 1].y)
+    {
+      _skyline[j].width += _skyline[j + 1].width;
+      _skyline.erase(_skyline.begin() + j + 1);
+    }
+  };
+  merge(i);
+  if (i > 0) {
+    merge(i - 1);
+  }
+}
+
+inline MaxRectsPacker::MaxRectsPacker(int width, int height)
+: _width(width),
+  _height(height)
+{
+  detail::check_pack_size(width, height);
+  clear();
+}
+
+inline void MaxRectsPacker::clear()
+{
+  _free.assign(1, Rect{ 0, 0, _width, _height });
+  _used_height = 0;
+}
+
+inline PackPlacement MaxRectsPacker::insert(int width, int height)
+{
+  detail::check_pack_size(width, height);
+  if (width == 0 || height == 0) {
+    return PackPlacement{ 0, 0, true };
+  }
+
+  const auto bounded = _height < UnboundedPackHeight;
+  auto best = _free.size();
+  auto best_primary = std::numeric_limits<int>::max();
+  auto best_secondary = std::numeric_limits<int>::max();
+  for (size_t i = 0; i < _free.size(); i += 1)
+  {
+    const auto &f = _free[i];
+    if (f.width < width || f.height < height) {
+      continue;
+    }
+    const auto leftover_x = f.width - width;
+    const auto leftover_y = f.height - height;
+    const auto short_side = std::min(leftover_x, leftover_y);
+    const auto primary = bounded ? short_side : f.y + height;
+    const auto secondary = bounded ? std::max(leftover_x, leftover_y) : short_side;
+    if (primary < best_primary || (primary == best_primary && secondary < best_secondary))
+    {
+      best = i;
+      best_primary = primary;
+      best_secondary = secondary;
+    }
+  }
+  if (best == _free.size()) {
+    return PackPlacement();
+  }
+
+  const auto used = Rect{ _free[best].x, _free[best].y, width, height };
+  splitFreeRects(used);
+  _used_height = std::max(_used_height, used.bottom());
+  return PackPlacement{ used.x, used.y, true };
+}
+
+inline void MaxRectsPacker::splitFreeRects(const Rect &used)
+{
+  _pieces.clear();
+  auto kept = size_t(0);
+  for (size_t i = 0; i < _free.size(); i += 1)
+  {
+    const auto f = _free[i];
+    if (! f.intersects(used))
+    {
+      _free[kept++] = f;
+      continue;
+    }
+    if (used.x > f.x) {
+      _pieces.push_back(Rect{ f.x, f.y, used.x - f.x, f.height });
+    }
+    if (used.right() < f.right()) {
+      _pieces.push_back(Rect{ used.right(), f.y, f.right() - used.right(), f.height });
+    }
+    if (used.y > f.y) {
+      _pieces.push_back(Rect{ f.x, f.y, f.width, used.y - f.y });
+    }
+    if (used.bottom() < f.bottom()) {
+      _pieces.push_back(Rect{ f.x, used.bottom(), f.width, f.bottom() - used.bottom() });
+    }
+  }
+  _free.resize(kept);
+
+  // untouched free rectangles can't contain each other, so only pairs involving a new piece need testing
+  auto contained_in_free = [this] (const Rect &r) {
+    return std::any_of(_free.begin(), _free.end(), [&r] (const Rect &f) { return f.contains(r); });
+  };
+  auto redundant = std::vector<uint8_t>(_pieces.size(), 0);
+  for (size_t i = 0; i < _pieces.size(); i += 1)
+  {
+    for (size_t j = 0; j < _pieces.size() && ! redundant[i]; j += 1)
+    {
+      // of two equal pieces, keep the first
+      if (j != i && _pieces[j].contains(_pieces[i]) && (j < i || ! _pieces[i].contains(_pieces[j]))) {
+        redundant[i] = 1;
+      }
+    }
+    if (! redundant[i] && contained_in_free(_pieces[i])) {
+      redundant[i] = 1;
+    }
+  }
+  auto unique = size_t(0);
+  for (size_t i = 0; i < _pieces.size(); i += 1)
+  {
+    if (! redundant[i]) {
+      _pieces[unique++] = _pieces[i];
+    }
+  }
+  _pieces.resize(unique);
+  _free.erase(std::remove_if(_free.begin(), _free.end(), [this] (const Rect &f) {
+    return std::any_of(_pieces.begin(), _pieces.end(), [&f] (const Rect &p) { return p.contains(f); });
+  }), _free.end());
+  _free.insert(_free.end(), _pieces.begin(), _pieces.end());
+}
+
+namespace detail {
+
+template <typename Packer>
+std::vector<PackPlacement> pack_in_order(const std::vector<PackSize> &sizes, const std::vector<size_t> &order, int width, int height, bool paged)
+{
+  auto placements = std::vector<PackPlacement>(sizes.size());
+  auto pages = std::vector<Packer>();
+  pages.emplace_back(width, height);
+  for (auto i: order)
+  {
+    const auto &size = sizes[i];
+    auto &placement = placements[i];
+    for (size_t page = 0; page < pages.size() && ! placement.placed; page += 1)
+    {
+      placement = pages[page].insert(size.width, size.height);
+      placement.page = static_cast<int>(page);
+    }
+    if (! placement.placed && paged && size.width <= width && size.height <= height)
+    {
+      pages.emplace_back(width, height);
+      placement = pages.back().insert(size.width, size.height);
+      placement.page = static_cast<int>(pages.size() - 1);
+    }
+    if (! placement.placed) {
+      placement.page = 0;
+    }
+  }
+  return placements;
+}
+
+inline std::vector<PackPlacement> pack(const std::vector<PackSize> &sizes, int width, int height, PackingAlgorithm algorithm, bool paged)
+{
+  auto order = std::vector<size_t>(sizes.size());
+  std::iota(order.begin(), order.end(), size_t(0));
+  // rows and skylines stay level when the tallest go first; maxrects does best with the longest side first
+  const auto by_height = algorithm != PackingAlgorithm::MaxRects;
+  std::stable_sort(order.begin(), order.end(), [&sizes, by_height] (size_t a, size_t b) {
+    const auto &lhs = sizes[a];
+    const auto &rhs = sizes[b];
+    if (by_height) {
+      return lhs.height > rhs.height;
+    }
+    const auto lhs_long = std::max(lhs.width, lhs.height);
+    const auto rhs_long = std::max(rhs.width, rhs.height);
+    return lhs_long != rhs_long ? lhs_long > rhs_long : std::min(lhs.width, lhs.height) > std::min(rhs.width, rhs.height);
+  });
+
+  switch (algorithm)
+  {
+    case PackingAlgorithm::Shelf:
+      return pack_in_order<ShelfPacker>(sizes, order, width, height, paged);
+    case PackingAlgorithm::Skyline:
+      return pack_in_order<SkylinePacker>(sizes, order, width, height, paged);
+    case PackingAlgorithm::MaxRects:
+    default:
+      return pack_in_order<MaxRectsPacker>(sizes, order, width, height, paged);
+  }
+}
+
+} // namespace detail
+
+inline std::vector<PackPlacement> pack_rects(const std::vector<PackSize> &sizes, int width, int height, PackingAlgorithm algorithm)
+{
+  return detail::pack(sizes, width, height, algorithm, false);
+}
+
+inline std::vector<PackPlacement> pack_pages(const std::vector<PackSize> &sizes, int width, int height, PackingAlgorithm algorithm)
+{
+  return detail::pack(sizes, width, height, algorithm, true);
+}
+
+} // namespace pockets
@@ -27,6 +27,10 @@
 
 #pragma once
 #include "Pockets.h"
+#include "WeightedSampling.h"
+#include "CompactMarkov.h"
+#include <algorithm>
+#include <limits>
 #include <unordered_map>
 
 namespace pockets {
@@ -35,6 +39,7 @@ namespace pockets {
 /// A Simple Markov Node.
 /// Stores a shared_ptr to some meaningful node-y type.
 /// Based on my previous javascript implementation.
+/// Exits hold shared_ptrs, so nodes in a cycle never free each other; see MarkovArena for large or cyclic graphs.
 ///
 template <typename T>
 struct MarkovNode
@@ -46,40 +51,71 @@ struct MarkovNode
   : thing(thing)
   {}
 
+  // copies must bind exits to their own list, not the source's
+  MarkovNode(const MarkovNode &other)
+  : thing(other.thing),
+    _exits(other._exits),
+    _weights(other._weights)
+  {}
+
+  MarkovNode& operator = (const MarkovNode &other)
+  {
+    thing = other.thing;
+    _exits = other._exits;
+    _weights = other._weights;
+    return *this;
+  }
+
   struct Exit
   {
     MarkovRef  exit;
     float     weight = 1.0f;
   };
 
+  /// Add an exit. Negative weights count as zero, as in AliasTable; they would break the sampling tree's running totals.
   void addExit(const MarkovRef &t, float weight)
   {
-    exits.push_back({t, weight});
+    weight = std::max(weight, 0.0f);
+    _exits.push_back({t, weight});
+    _weights.push_back(weight);
   }
 
-  /// Return the exit at normalized position t.
-  MarkovRef findExit(float t)
+  /// Change the weight of the exit at \a index. Negative weights count as zero.
+  void setWeight(size_t index, float weight)
   {
-    auto possibilities = 0.0f;
-    for (auto &e: exits)
-    {
-      possibilities += e.weight;
-    }
-    auto value = t * possibilities;
+    weight = std::max(weight, 0.0f);
+    _exits[index].weight = weight;
+    _weights.set(index, weight);
+  }
+
+  /// Remove every exit, e.g. to break cycles before letting go of a graph.
+  void clearExits()
+  {
+    _exits.clear();
+    _weights.clear();
+  }
 
-    for (auto &e: exits)
+  /// Return the exit at normalized position t. O(log k) in the number of exits.
+  MarkovRef findExit(float t) const
+  {
+    auto index = _weights.sample(t);
+    if (index < _exits.size())
     {
-      value -= e.weight;
-      if (value <= 0.0f)
-      {
-        return e.exit;
-      }
+      return _exits[index].exit;
     }
     return nullptr;
   }
 
-  std::vector<Exit>    exits;
   std::shared_ptr<T>   thing;
+
+private:
+  std::vector<Exit>    _exits;
+  FenwickTree          _weights;
+
+public:
+  /// Exits in the order they were added; reads through node->exits work as before.
+  /// It is read-only: change exits through addExit, setWeight, and clearExits, so that the sampling tree stays in sync.
+  const std::vector<Exit> &exits = _exits;
 };
 
 ///
@@ -92,11 +128,177 @@ std::shared_ptr<MarkovNode<T>> createNode(const std::shared_ptr<T> &thing)
   return std::make_shared<MarkovNode<T>>(thing);
 }
 
+///
+/// Arena of markov nodes that refer to each other by index.
+/// Nodes live in one contiguous array and each node's exits in one contiguous run of a shared exit array,
+/// so findExit reads a single block of memory and never touches a reference count.
+/// Cycles are fine: the whole graph is released at once by clear() or the arena's destructor.
+///
+/// MarkovArena<Thing> arena;
+/// auto a = arena.createNode(Thing("a"));
+/// auto b = arena.createNode(Thing("b"));
+/// arena.addExit(a, b, 1.0f);
+/// arena.addExit(b, a, 1.0f);
+/// auto next = arena.findExit(a, randFloat());
+///
+template <typename T>
+class MarkovArena
+{
+public:
+  using NodeIndex = uint32_t;
+  static const NodeIndex InvalidNode = std::numeric_limits<NodeIndex>::max();
+
+  struct Exit
+  {
+    NodeIndex node;
+    float     weight;
+  };
+
+  NodeIndex createNode(T thing)
+  {
+    _things.push_back(std::move(thing));
+    _nodes.emplace_back();
+    return static_cast<NodeIndex>(_nodes.size() - 1);
+  }
+
+  /// Add an exit from \a from to \a to. Negative weights count as zero, so node totals match what findExit samples.
+  void addExit(NodeIndex from, NodeIndex to, float weight);
+
+  /// Change the weight of the exit at \a index of node \a from. Negative weights count as zero.
+  void setExitWeight(NodeIndex from, size_t index, float weight)
+  {
+    weight = std::max(weight, 0.0f);
+    auto &node = _nodes[from];
+    auto &exit = _exits[node.first + index];
+    node.total += weight - exit.weight;
+    exit.weight = weight;
+  }
+
+  /// Return the exit at normalized position t, or InvalidNode if the node has no exits. O(k) over contiguous exits.
+  NodeIndex findExit(NodeIndex from, float t) const;
+
+  T&        thing(NodeIndex node) { return _things[node]; }
+  const T&  thing(NodeIndex node) const { return _things[node]; }
+
+  /// The exits of \a node, as a contiguous range.
+  const Exit* exitsBegin(NodeIndex node) const { return _exits.data() + _nodes[node].first; }
+  const Exit* exitsEnd(NodeIndex node) const { return exitsBegin(node) + _nodes[node].count; }
+  size_t      exitCount(NodeIndex node) const { return _nodes[node].count; }
+
+  size_t    nodeCount() const { return _nodes.size(); }
+  void      reserve(size_t nodes, size_t exits) { _things.reserve(nodes); _nodes.reserve(nodes); _exits.reserve(exits); }
+
+  /// Repack every node's exits in node order, reclaiming space left behind as exit blocks grew.
+  void      compact();
+  /// Release every node and exit at once.
+  void      clear() { _things.clear(); _nodes.clear(); _exits.clear(); }
+
+  /// Approximate heap footprint in bytes. Does not count memory owned by the things themselves.
+  size_t    memoryUsage() const { return _things.capacity() * sizeof(T) + _nodes.capacity() * sizeof(Node) + _exits.capacity() * sizeof(Exit); }
+
+private:
+  struct Node
+  {
+    /// This node's exits are _exits[first, first + count); the block has room for capacity exits.
+    uint32_t  first = 0;
+    uint32_t  count = 0;
+    uint32_t  capacity = 0;
+    float     total = 0.0f;
+  };
+
+  std::vector<T>    _things;
+  std::vector<Node> _nodes;
+  std::vector<Exit> _exits;
+};
+
+template <typename T>
+const typename MarkovArena<T>::NodeIndex MarkovArena<T>::InvalidNode;
+
+template <typename T>
+void MarkovArena<T>::addExit(NodeIndex from, NodeIndex to, float weight)
+{
+  weight = std::max(weight, 0.0f);
+  auto &node = _nodes[from];
+  if (node.count == node.capacity)
+  {
+    if (node.first + node.capacity == _exits.size())
+    { // the block is at the end of the arena, so it can grow in place
+      const auto grow = std::max<uint32_t>(2, node.capacity);
+      _exits.resize(_exits.size() + grow);
+      node.capacity += grow;
+    }
+    else
+    { // move to a new block twice the size; the old block is reclaimed by compact()
+      const auto capacity = std::max<uint32_t>(2, node.capacity * 2);
+      const auto first = static_cast<uint32_t>(_exits.size());
+      _exits.resize(_exits.size() + capacity);
+      std::copy(_exits.begin() + node.first, _exits.begin() + node.first + node.count, _exits.begin() + first);
+      node.first = first;
+      node.capacity = capacity;
+    }
+  }
+
+  _exits[node.first + node.count] = Exit{ to, weight };
+  node.count += 1;
+  node.total += weight;
+}
+
+template <typename T>
+auto MarkovArena<T>::findExit(NodeIndex from, float t) const -> NodeIndex
+{
+  const auto &node = _nodes[from];
+  if (node.total <= 0.0f) {
+    return InvalidNode;
+  }
+
+  auto value = t * node.total;
+  auto last = InvalidNode;
+  const auto *exit = _exits.data() + node.first;
+  const auto *end = exit + node.count;
+  for (; exit != end; ++exit)
+  {
+    if (exit->weight <= 0.0f) {
+      continue;
+    }
+    value -= exit->weight;
+    if (value <= 0.0f) {
+      return exit->node;
+    }
+    last = exit->node;
+  }
+  // rounding can leave a sliver past the last exit
+  return last;
+}
+
+template <typename T>
+void MarkovArena<T>::compact()
+{
+  auto exits = std::vector<Exit>();
+  auto total = size_t(0);
+  for (auto &node: _nodes) {
+    total += node.count;
+  }
+  exits.reserve(total);
+  for (auto &node: _nodes)
+  {
+    const auto first = static_cast<uint32_t>(exits.size());
+    exits.insert(exits.end(), _exits.begin() + node.first, _exits.begin() + node.first + node.count);
+    node.first = first;
+    node.capacity = node.count;
+  }
+  std::swap(exits, _exits);
+}
+
 ///
 /// Markov graph structure.
 /// Stores weighted relationships between value types.
 /// Allows traversal from one value to another.
 ///
+/// By default, nextNode walks the exits of a node in O(k).
+/// After compile(), each node samples from an alias table in O(1).
+/// Tables are rebuilt lazily for nodes whose pathways change after compiling.
+/// For large graphs that are done changing, freeze() packs everything into a CompactMarkovGraph.
+///
 template <typename T>
 class MarkovGraph
 {
@@ -113,16 +315,34 @@ public:
   ///
   const T& nextNode(const T &start_node, float t)
   {
-    auto &list = _elements[start_node];
+    auto iter = _elements.find(start_node);
+    if (iter == _elements.end())
+    {
+      return start_node;
+    }
+
+    auto &node = iter->second;
+    if (_compiled)
+    {
+      if (node.dirty)
+      {
+        node.compile();
+      }
+      if (node.table.empty())
+      {
+        return start_node;
+      }
+      return node.targets[node.table.sample(t)];
+    }
 
     auto possibilities = 0.0f;
-    for (auto &pair: list)
+    for (auto &pair: node.weights)
     {
       possibilities += pair.second;
     }
     auto value = t * possibilities;
 
-    for (auto &pair: list)
+    for (auto &pair: node.weights)
     {
       value -= pair.second;
       if (value <= 0.0f)
@@ -136,11 +356,207 @@ public:
 
   void addPathway(const T &from_node, const T &to_node, float weight)
   {
-    _elements[from_node][to_node] = weight;
+    auto &node = _elements[from_node];
+    node.weights[to_node] = weight;
+    node.dirty = true;
+  }
+
+  /// Build alias tables for every node and sample from them in nextNode from now on.
+  void compile()
+  {
+    _compiled = true;
+    for (auto &pair: _elements)
+    {
+      if (pair.second.dirty)
+      {
+        pair.second.compile();
+      }
+    }
+  }
+
+  bool isCompiled() const { return _compiled; }
+
+  /// Returns a read-only copy of the graph with nodes interned to dense ids and
+  /// edges packed into contiguous arrays. See CompactMarkovGraph.
+  CompactMarkovGraph<T> freeze() const
+  {
+    auto pathways = std::vector<typename CompactMarkovGraph<T>::Pathway>();
+    for (auto &node: _elements)
+    {
+      for (auto &exit: node.second.weights)
+      {
+        pathways.push_back({ node.first, exit.first, exit.second });
+      }
+    }
+    return CompactMarkovGraph<T>(pathways);
+  }
+
+  ///
+  /// Run one random walk of \a length nodes from each of \a starts, in parallel, into one contiguous buffer.
+  /// Walk i occupies [i * length, (i + 1) * length). Output depends only on the seed, not the thread count.
+  /// Freezes the graph on every call; for repeated batches, freeze() once and call CompactMarkovGraph::generateWalks.
+  ///
+  std::vector<T> generateWalks(const std::vector<T> &starts, size_t length, uint64_t seed, size_t thread_count = 0) const
+  {
+    const auto frozen = freeze();
+    auto ids = std::vector<uint32_t>();
+    ids.reserve(starts.size());
+    auto unknown = std::vector<size_t>();
+    for (size_t i = 0; i < starts.size(); i += 1)
+    {
+      auto id = frozen.nodeId(starts[i]);
+      if (id == CompactMarkovGraph<T>::InvalidNode)
+      { // nodes outside the graph stay where they are
+        unknown.push_back(i);
+        id = 0;
+      }
+      ids.push_back(id);
+    }
+
+    auto walks = std::vector<T>();
+    if (frozen.nodeCount() > 0)
+    {
+      const auto id_walks = frozen.generateWalks(ids, length, seed, thread_count);
+      walks.reserve(id_walks.size());
+      for (auto id: id_walks)
+      {
+        walks.push_back(frozen.value(id));
+      }
+    }
+    else
+    {
+      walks.resize(starts.size() * length);
+    }
+    for (auto i: unknown)
+    {
+      std::fill(walks.begin() + i * length, walks.begin() + (i + 1) * length, starts[i]);
+    }
+    return walks;
+  }
+
+  /// Approximate heap footprint in bytes of the pathway tables, for comparison with CompactMarkovGraph::memoryUsage().
+  /// Does not count compiled alias tables or memory owned by the values themselves.
+  size_t memoryUsage() const
+  {
+    const auto pointer = sizeof(void*);
+    auto bytes = _elements.bucket_count() * pointer + _elements.size() * (sizeof(std::pair<const T, Exits>) + 2 * pointer);
+    for (auto &node: _elements)
+    {
+      auto &weights = node.second.weights;
+      bytes += weights.bucket_count() * pointer + weights.size() * (sizeof(std::pair<const T, float>) + 2 * pointer);
+    }
+    return bytes;
+  }
+
+private:
+  struct Exits
+  {
+    std::unordered_map<T, float> weights;
+    // Compiled form: targets[i] is taken with probability weight[i] / total.
+    std::vector<T>  targets;
+    AliasTable      table;
+    bool            dirty = true;
+
+    void compile()
+    {
+      targets.clear();
+      auto w = std::vector<float>();
+      targets.reserve(weights.size());
+      w.reserve(weights.size());
+      for (auto &pair: weights)
+      {
+        targets.push_back(pair.first);
+        w.push_back(pair.second);
+      }
+      table.build(w.data(), w.size());
+      dirty = false;
+    }
+  };
+
+  std::unordered_map<T, Exits> _elements;
+  bool                         _compiled = false;
+};
+
+///
+/// Markov graph whose pathway weights change often, e.g. every frame.
+/// Each node keeps its exit weights in a Fenwick tree, so changing a weight
+/// and sampling the next node are both O(log k) in the number of exits.
+/// Prefer MarkovGraph::compile() for graphs that are built once and then sampled.
+///
+template <typename T>
+class DynamicMarkovGraph
+{
+public:
+  ///
+  /// Return the next node in the graph at normalized position t.
+  /// If there is no next node in the graph, returns start_node.
+  ///
+  const T& nextNode(const T &start_node, float t) const
+  {
+    auto iter = _elements.find(start_node);
+    if (iter == _elements.end())
+    {
+      return start_node;
+    }
+
+    auto &node = iter->second;
+    auto index = node.weights.sample(t);
+    if (index < node.targets.size())
+    {
+      return node.targets[index];
+    }
+    return start_node;
+  }
+
+  /// Set the weight of the pathway between two nodes, creating it if needed. Negative weights count as zero.
+  void addPathway(const T &from_node, const T &to_node, float weight)
+  {
+    weight = std::max(weight, 0.0f);
+    auto &node = _elements[from_node];
+    auto iter = node.indices.find(to_node);
+    if (iter == node.indices.end())
+    {
+      node.indices[to_node] = node.targets.size();
+      node.targets.push_back(to_node);
+      node.weights.push_back(weight);
+    }
+    else
+    {
+      node.weights.set(iter->second, weight);
+    }
+  }
+
+  /// Add \a amount to the weight of the pathway between two nodes, creating it if needed.
+  void reinforcePathway(const T &from_node, const T &to_node, float amount)
+  {
+    addPathway(from_node, to_node, pathwayWeight(from_node, to_node) + amount);
+  }
+
+  /// Returns the weight of the pathway between two nodes, or zero if there is none.
+  float pathwayWeight(const T &from_node, const T &to_node) const
+  {
+    auto node = _elements.find(from_node);
+    if (node == _elements.end())
+    {
+      return 0.0f;
+    }
+    auto iter = node->second.indices.find(to_node);
+    if (iter == node->second.indices.end())
+    {
+      return 0.0f;
+    }
+    return node->second.weights.weight(iter->second);
   }
 
 private:
-  std::unordered_map<T, std::unordered_map<T, float>> _elements;
+  struct Exits
+  {
+    std::unordered_map<T, size_t> indices;
+    std::vector<T>                targets;
+    FenwickTree                   weights;
+  };
+
+  std::unordered_map<T, Exits> _elements;
 };
 
 } // namespace pockets
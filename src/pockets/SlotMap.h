@@ -0,0 +1,267 @@
+/*
+ * Copyright (c) 2015 David Wicks, sansumbrella.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+#include "Pockets.h"
+#include <cassert>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+namespace pockets {
+
+///
+/// Stable reference to an element of a slot_map.
+/// Handles to erased elements are detected through the generation count,
+/// so a stale handle never aliases a newer element stored in the same slot.
+///
+struct slot_handle
+{
+  slot_handle() = default;
+  slot_handle(uint32_t index, uint32_t generation)
+  : index(index),
+    generation(generation)
+  {}
+
+  uint32_t index = 0;
+  /// Generation zero is never issued, so default-constructed handles are always invalid.
+  uint32_t generation = 0;
+
+  bool operator == (const slot_handle &rhs) const { return index == rhs.index && generation == rhs.generation; }
+  bool operator != (const slot_handle &rhs) const { return ! (*this == rhs); }
+};
+
+///
+/// Unordered container with O(1) insertion, erasure, and handle lookup.
+/// Elements are stored densely, so iteration walks a single contiguous array.
+/// Erasure moves the last element into the erased position; handles stay valid, pointers and iterators do not.
+///
+/// auto handle = lines.insert(line);
+/// if (auto *line = lines.get(handle)) { ... }
+/// lines.erase(handle);
+/// for (auto &line: lines) { ... }
+///
+template <typename T>
+class slot_map
+{
+public:
+  using value_type = T;
+  using handle = slot_handle;
+  using iterator = typename std::vector<T>::iterator;
+  using const_iterator = typename std::vector<T>::const_iterator;
+
+  handle  insert(T value) { return emplace(std::move(value)); }
+  template <typename ... Args>
+  handle  emplace(Args&& ... args);
+
+  /// Erases the element referenced by \a h. Returns false if \a h is stale.
+  bool    erase(handle h);
+  bool    contains(handle h) const { return h.index < _slots.size() && _slots[h.index].generation == h.generation; }
+
+  /// Returns a pointer to the element referenced by \a h, or nullptr if \a h is stale.
+  T*        get(handle h) { return contains(h) ? &_values[_slots[h.index].dense_index] : nullptr; }
+  const T*  get(handle h) const { return contains(h) ? &_values[_slots[h.index].dense_index] : nullptr; }
+
+  /// Unchecked access. \a h must be valid.
+  T&        operator[](handle h) { assert(contains(h)); return _values[_slots[h.index].dense_index]; }
+  const T&  operator[](handle h) const { assert(contains(h)); return _values[_slots[h.index].dense_index]; }
+
+  /// Returns the handle of the element at position \a dense_index during iteration.
+  handle    handle_at(size_t dense_index) const;
+
+  void    clear();
+  void    reserve(size_t size) { _values.reserve(size); _dense_to_slot.reserve(size); _slots.reserve(size); }
+  size_t  size() const { return _values.size(); }
+  bool    empty() const { return _values.empty(); }
+
+  T*        data() { return _values.data(); }
+  const T*  data() const { return _values.data(); }
+
+  iterator        begin() { return _values.begin(); }
+  iterator        end() { return _values.end(); }
+  const_iterator  begin() const { return _values.begin(); }
+  const_iterator  end() const { return _values.end(); }
+
+private:
+  static const uint32_t EndOfFreeList = std::numeric_limits<uint32_t>::max();
+
+  struct Slot
+  {
+    /// Position in _values while occupied; next free slot while free.
+    uint32_t dense_index = 0;
+    uint32_t generation = 1;
+  };
+
+  std::vector<T>        _values;
+  std::vector<uint32_t> _dense_to_slot;
+  std::vector<Slot>     _slots;
+  uint32_t              _free_head = EndOfFreeList;
+};
+
+///
+/// Set of small unsigned integers (e.g. entity ids) with O(1) insertion, erasure, and membership tests.
+/// Members are stored densely for iteration; a sparse array maps each value to its dense position.
+/// Memory grows with the largest value inserted.
+///
+class sparse_set
+{
+public:
+  using value_type = uint32_t;
+  using const_iterator = std::vector<uint32_t>::const_iterator;
+
+  /// Largest value a sparse_set can hold. Sizing the sparse array for UINT32_MAX would wrap to zero.
+  static const uint32_t MaxValue = std::numeric_limits<uint32_t>::max() - 1;
+
+  /// Inserts \a value. Returns false if it was already present, or is above MaxValue.
+  bool insert(uint32_t value)
+  {
+    if (value > MaxValue || contains(value)) {
+      return false;
+    }
+    if (value >= _sparse.size()) {
+      _sparse.resize(value + 1);
+    }
+    _sparse[value] = static_cast<uint32_t>(_dense.size());
+    _dense.push_back(value);
+    return true;
+  }
+
+  /// Erases \a value by moving the last member into its place. Returns false if it was not present.
+  bool erase(uint32_t value)
+  {
+    if (! contains(value)) {
+      return false;
+    }
+    const auto position = _sparse[value];
+    const auto last = _dense.back();
+    _dense[position] = last;
+    _sparse[last] = position;
+    _dense.pop_back();
+    return true;
+  }
+
+  bool contains(uint32_t value) const
+  {
+    return value < _sparse.size() && _sparse[value] < _dense.size() && _dense[_sparse[value]] == value;
+  }
+  size_t count(uint32_t value) const { return contains(value); }
+
+  void    clear() { _dense.clear(); }
+  void    reserve(size_t size) { _dense.reserve(size); }
+  size_t  size() const { return _dense.size(); }
+  bool    empty() const { return _dense.empty(); }
+
+  const_iterator begin() const { return _dense.begin(); }
+  const_iterator end() const { return _dense.end(); }
+
+private:
+  std::vector<uint32_t> _dense;
+  /// Position in _dense of each value. Entries for absent values are stale and checked against _dense.
+  std::vector<uint32_t> _sparse;
+};
+
+// ===================================
+// slot_map Template Implementation
+// ===================================
+
+template <typename T>
+template <typename ... Args>
+slot_handle slot_map<T>::emplace(Args&& ... args)
+{
+  auto index = _free_head;
+  if (index == EndOfFreeList) {
+    index = static_cast<uint32_t>(_slots.size());
+    _slots.emplace_back();
+  }
+  else {
+    _free_head = _slots[index].dense_index;
+  }
+
+  auto &slot = _slots[index];
+  slot.dense_index = static_cast<uint32_t>(_values.size());
+  _values.emplace_back(std::forward<Args>(args)...);
+  _dense_to_slot.push_back(index);
+
+  return handle{ index, slot.generation };
+}
+
+template <typename T>
+bool slot_map<T>::erase(handle h)
+{
+  if (! contains(h)) {
+    return false;
+  }
+
+  auto &slot = _slots[h.index];
+  const auto position = slot.dense_index;
+  const auto last = _values.size() - 1;
+  if (position != last)
+  { // move the last element into the hole and point its slot at the new position
+    _values[position] = std::move(_values[last]);
+    _dense_to_slot[position] = _dense_to_slot[last];
+    _slots[_dense_to_slot[position]].dense_index = position;
+  }
+  _values.pop_back();
+  _dense_to_slot.pop_back();
+
+  // invalidate outstanding handles, skipping generation zero on wraparound
+  slot.generation += 1;
+  if (slot.generation == 0) {
+    slot.generation = 1;
+  }
+  slot.dense_index = _free_head;
+  _free_head = h.index;
+
+  return true;
+}
+
+template <typename T>
+slot_handle slot_map<T>::handle_at(size_t dense_index) const
+{
+  const auto index = _dense_to_slot[dense_index];
+  return handle{ index, _slots[index].generation };
+}
+
+template <typename T>
+void slot_map<T>::clear()
+{
+  for (auto index: _dense_to_slot)
+  {
+    auto &slot = _slots[index];
+    slot.generation += 1;
+    if (slot.generation == 0) {
+      slot.generation = 1;
+    }
+    slot.dense_index = _free_head;
+    _free_head = index;
+  }
+  _values.clear();
+  _dense_to_slot.clear();
+}
+
+} // namespace pockets
@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 2015 David Wicks, sansumbrella.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+#include "Pockets.h"
+#include <cassert>
+#include <cstddef>
+
+namespace pockets {
+
+///
+/// Non-owning view of a contiguous run of elements, like C++20's std::span.
+/// Lets functions read or fill caller-owned memory without caring how it is allocated.
+///
+/// void fill(span<float> out);
+/// auto values = std::vector<float>(100);
+/// fill(values);
+/// fill(span<float>(values).subspan(50, 25));
+///
+template <typename T>
+class span
+{
+public:
+  using element_type = T;
+  using iterator = T*;
+
+  span() = default;
+  span(T *data, size_t size)
+  : _data(data),
+    _size(size)
+  {}
+  template <typename U>
+  span(std::vector<U> &values)
+  : _data(values.data()),
+    _size(values.size())
+  {}
+  template <typename U>
+  span(const std::vector<U> &values)
+  : _data(values.data()),
+    _size(values.size())
+  {}
+  /// Allows span<T> to convert to span<const T>.
+  template <typename U>
+  span(const span<U> &other)
+  : _data(other.data()),
+    _size(other.size())
+  {}
+
+  T*      data() const { return _data; }
+  size_t  size() const { return _size; }
+  size_t  size_bytes() const { return _size * sizeof(T); }
+  bool    empty() const { return _size == 0; }
+
+  T&      operator[](size_t index) const { assert(index < _size); return _data[index]; }
+  T&      front() const { return _data[0]; }
+  T&      back() const { return _data[_size - 1]; }
+
+  iterator begin() const { return _data; }
+  iterator end() const { return _data + _size; }
+
+  /// The \a count elements starting at \a offset.
+  span    subspan(size_t offset, size_t count) const { assert(offset + count <= _size); return span(_data + offset, count); }
+  span    first(size_t count) const { return subspan(0, count); }
+
+private:
+  T       *_data = nullptr;
+  size_t  _size = 0;
+};
+
+} // namespace pockets
@@ -28,6 +28,15 @@
 #pragma once
 
 #include "Pockets.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+  #include <emmintrin.h>
+  #define POCKETS_SSE2 1
+#endif
 
 namespace pockets
 {
@@ -59,4 +68,145 @@ inline std::string trim(const std::string &str)
   }
 }
 
+namespace detail
+{
+
+/// Returns the number of leading 7-bit ASCII bytes in [begin, end).
+/// Checks 16 bytes at a time with SSE2 where available and 8 bytes at a time otherwise.
+inline size_t ascii_prefix_length(const char *begin, const char *end)
+{
+  auto p = begin;
+#if defined(POCKETS_SSE2)
+  while (end - p >= 16) {
+    const auto chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    if (_mm_movemask_epi8(chunk) != 0) {
+      break;
+    }
+    p += 16;
+  }
+#endif
+  while (end - p >= 8) {
+    uint64_t word;
+    std::memcpy(&word, p, sizeof(word));
+    if (word & 0x8080808080808080ull) {
+      break;
+    }
+    p += 8;
+  }
+  while (p < end && static_cast<unsigned char>(*p) < 0x80) {
+    p += 1;
+  }
+  return p - begin;
+}
+
+} // namespace detail
+
+/// Returns true if every byte of \a str is 7-bit ASCII.
+inline bool is_ascii(const std::string &str)
+{
+  return detail::ascii_prefix_length(str.data(), str.data() + str.size()) == str.size();
+}
+
+/// Returns the unicode code points in the UTF-8 encoded string \a str.
+/// Malformed, overlong, and surrogate sequences are replaced with U+FFFD, one per invalid byte.
+/// Runs of ASCII are copied in bulk without per-byte decoding.
+inline std::u32string utf8_decode(const std::string &str)
+{
+  const char32_t replacement = 0xFFFD;
+  auto result = std::u32string();
+  result.reserve(str.size());
+
+  auto p = str.data();
+  const auto end = p + str.size();
+  while (p < end)
+  {
+    const auto ascii = detail::ascii_prefix_length(p, end);
+    result.append(p, p + ascii);
+    p += ascii;
+    if (p == end) {
+      break;
+    }
+
+    const auto lead = static_cast<unsigned char>(*p);
+    auto length = 0;
+    auto code_point = char32_t(0);
+    auto minimum = char32_t(0);
+    if ((lead & 0xE0) == 0xC0) {
+      length = 2;
+      code_point = lead & 0x1F;
+      minimum = 0x80;
+    }
+    else if ((lead & 0xF0) == 0xE0) {
+      length = 3;
+      code_point = lead & 0x0F;
+      minimum = 0x800;
+    }
+    else if ((lead & 0xF8) == 0xF0) {
+      length = 4;
+      code_point = lead & 0x07;
+      minimum = 0x10000;
+    }
+
+    auto valid = length > 0 && (end - p) >= length;
+    for (auto i = 1; valid && i < length; i += 1) {
+      const auto c = static_cast<unsigned char>(p[i]);
+      valid = (c & 0xC0) == 0x80;
+      code_point = (code_point << 6) | (c & 0x3F);
+    }
+    valid = valid && code_point >= minimum && code_point <= 0x10FFFF && (code_point < 0xD800 || code_point > 0xDFFF);
+
+    if (valid) {
+      result.push_back(code_point);
+      p += length;
+    }
+    else {
+      result.push_back(replacement);
+      p += 1;
+    }
+  }
+
+  return result;
+}
+
+/// Returns the UTF-8 encoding of a single unicode \a code_point.
+/// Code points outside the unicode range are encoded as U+FFFD.
+inline std::string utf8_encode(char32_t code_point)
+{
+  if (code_point > 0x10FFFF || (code_point >= 0xD800 && code_point <= 0xDFFF)) {
+    code_point = 0xFFFD;
+  }
+
+  auto result = std::string();
+  if (code_point < 0x80) {
+    result.push_back(static_cast<char>(code_point));
+  }
+  else if (code_point < 0x800) {
+    result.push_back(static_cast<char>(0xC0 | (code_point >> 6)));
+    result.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+  }
+  else if (code_point < 0x10000) {
+    result.push_back(static_cast<char>(0xE0 | (code_point >> 12)));
+    result.push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+    result.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+  }
+  else {
+    result.push_back(static_cast<char>(0xF0 | (code_point >> 18)));
+    result.push_back(static_cast<char>(0x80 | ((code_point >> 12) & 0x3F)));
+    result.push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+    result.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+  }
+  return result;
+}
+
+/// Returns the UTF-8 encoding of the code points in \a str.
+inline std::string utf8_encode(const std::u32string &str)
+{
+  auto result = std::string();
+  result.reserve(str.size());
+  for (auto c: str) {
+    result += utf8_encode(c);
+  }
+  return result;
+}
+
 } // namespace pockets
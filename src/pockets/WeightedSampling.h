@@ -0,0 +1,266 @@
+/*
+ * Copyright (c) 2015 David Wicks, sansumbrella.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+#include "Pockets.h"
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+
+namespace pockets {
+
+/// SplitMix64 finalizer. Scrambles every input bit across the whole output; useful for hashing and seeding.
+inline uint64_t mix_bits(uint64_t z)
+{
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+  return z ^ (z >> 31);
+}
+
+///
+/// Counter-based random numbers.
+/// Returns a uniform float in [0, 1) that depends only on (\a seed, \a stream, \a counter),
+/// so independent streams can be drawn from any thread, in any order, with reproducible results.
+///
+inline float counter_uniform(uint64_t seed, uint64_t stream, uint64_t counter)
+{
+  const auto bits = mix_bits(seed + 0x9E3779B97F4A7C15ull * (mix_bits(stream) + counter + 1));
+  // top 24 bits fill a float mantissa exactly
+  return static_cast<float>(bits >> 40) * (1.0f / 16777216.0f);
+}
+
+///
+/// Walker/Vose alias table for sampling an index in proportion to a list of weights.
+/// Building is O(k); each sample is O(1) regardless of the number of weights.
+///
+/// auto table = AliasTable(weights);
+/// auto index = table.sample(randFloat());
+///
+class AliasTable
+{
+public:
+  AliasTable() = default;
+  explicit AliasTable(const std::vector<float> &weights) { build(weights.data(), weights.size()); }
+
+  /// Rebuild the table from \a count weights. Negative weights are treated as zero.
+  /// If the weights sum to zero, the table is empty.
+  void build(const float *weights, size_t count);
+
+  /// Returns the index sampled at normalized position \a t in [0, 1].
+  /// The table must not be empty.
+  size_t sample(float t) const
+  {
+    const auto n = _probability.size();
+    const auto scaled = static_cast<double>(t) * n;
+    const auto column = std::min(static_cast<size_t>(scaled), n - 1);
+    const auto coin = scaled - column;
+    return coin < _probability[column] ? column : _alias[column];
+  }
+
+  size_t size() const { return _probability.size(); }
+  bool   empty() const { return _probability.empty(); }
+
+private:
+  /// Chance of keeping each column rather than taking its alias.
+  std::vector<float>    _probability;
+  std::vector<uint32_t> _alias;
+};
+
+inline void AliasTable::build(const float *weights, size_t count)
+{
+  _probability.clear();
+  _alias.clear();
+
+  auto total = 0.0;
+  for (size_t i = 0; i < count; i += 1) {
+    total += std::max(weights[i], 0.0f);
+  }
+  if (total <= 0.0) {
+    return;
+  }
+
+  _probability.resize(count);
+  _alias.resize(count);
+
+  // scale weights so the average column is exactly full
+  auto scaled = std::vector<double>(count);
+  auto small = std::vector<uint32_t>();
+  auto large = std::vector<uint32_t>();
+  small.reserve(count);
+  large.reserve(count);
+  for (size_t i = 0; i < count; i += 1)
+  {
+    scaled[i] = std::max(weights[i], 0.0f) * count / total;
+    if (scaled[i] < 1.0) {
+      small.push_back(static_cast<uint32_t>(i));
+    }
+    else {
+      large.push_back(static_cast<uint32_t>(i));
+    }
+  }
+
+  // fill each under-full column with probability from an over-full one
+  while (! small.empty() && ! large.empty())
+  {
+    const auto less = small.back();
+    small.pop_back();
+    const auto more = large.back();
+
+    _probability[less] = static_cast<float>(scaled[less]);
+    _alias[less] = more;
+
+    scaled[more] = (scaled[more] + scaled[less]) - 1.0;
+    if (scaled[more] < 1.0) {
+      large.pop_back();
+      small.push_back(more);
+    }
+  }
+
+  // anything left over is full, up to rounding error
+  for (auto i: large) {
+    _probability[i] = 1.0f;
+    _alias[i] = i;
+  }
+  for (auto i: small) {
+    _probability[i] = 1.0f;
+    _alias[i] = i;
+  }
+}
+
+///
+/// Fenwick (binary indexed) tree over a list of weights.
+/// Changing a weight and sampling an index in proportion to the weights are both O(log k),
+/// which suits distributions that change between every sample.
+///
+/// auto tree = FenwickTree(weights);
+/// tree.set(2, 5.0f);
+/// auto index = tree.sample(randFloat());
+///
+class FenwickTree
+{
+public:
+  FenwickTree() = default;
+  /// Builds from \a weights in O(k).
+  explicit FenwickTree(const std::vector<float> &weights);
+
+  /// Appends a weight in O(log k).
+  void    push_back(float weight);
+  /// Replaces the weight at \a index in O(log k).
+  void    set(size_t index, float weight);
+  float   weight(size_t index) const { return _weights[index]; }
+
+  /// Sum of the first \a count weights.
+  double  prefix_sum(size_t count) const;
+  double  total() const { return prefix_sum(_weights.size()); }
+
+  /// Returns the first index whose running total reaches \a value, or size() if none does.
+  size_t  lower_bound(double value) const;
+  /// Returns the index sampled at normalized position \a t in [0, 1], or size() if all weights are zero.
+  size_t  sample(float t) const
+  {
+    // searching for at least the smallest positive value skips zero weights, even at t = 0
+    const auto sum = total();
+    return sum > 0.0 ? lower_bound(std::max(t * sum, std::numeric_limits<double>::min())) : size();
+  }
+
+  void    clear() { _tree.clear(); _weights.clear(); }
+  size_t  size() const { return _weights.size(); }
+  bool    empty() const { return _weights.empty(); }
+
+private:
+  /// 1-based; _tree[i] holds the sum of the (i & -i) weights ending at weight i - 1.
+  /// Stored as double so that many small updates don't drift noticeably.
+  std::vector<double> _tree;
+  std::vector<float>  _weights;
+};
+
+inline FenwickTree::FenwickTree(const std::vector<float> &weights)
+: _tree(weights.size() + 1, 0.0),
+  _weights(weights)
+{
+  for (size_t i = 1; i < _tree.size(); i += 1)
+  {
+    _tree[i] += _weights[i - 1];
+    const auto parent = i + (i & (~i + 1));
+    if (parent < _tree.size()) {
+      _tree[parent] += _tree[i];
+    }
+  }
+}
+
+inline void FenwickTree::push_back(float weight)
+{
+  if (_tree.empty()) {
+    _tree.push_back(0.0);
+  }
+  const auto i = _tree.size();
+  const auto low_bit = i & (~i + 1);
+  // the new node covers itself plus the (low_bit - 1) weights before it
+  _tree.push_back(weight + prefix_sum(i - 1) - prefix_sum(i - low_bit));
+  _weights.push_back(weight);
+}
+
+inline void FenwickTree::set(size_t index, float weight)
+{
+  const auto delta = static_cast<double>(weight) - _weights[index];
+  _weights[index] = weight;
+  for (auto i = index + 1; i < _tree.size(); i += i & (~i + 1)) {
+    _tree[i] += delta;
+  }
+}
+
+inline double FenwickTree::prefix_sum(size_t count) const
+{
+  auto sum = 0.0;
+  for (auto i = count; i > 0; i -= i & (~i + 1)) {
+    sum += _tree[i];
+  }
+  return sum;
+}
+
+inline size_t FenwickTree::lower_bound(double value) const
+{
+  const auto n = _weights.size();
+  auto step = size_t(1);
+  while (step * 2 <= n) {
+    step *= 2;
+  }
+
+  // descend from the largest power of two, skipping every block whose sum falls short
+  auto position = size_t(0);
+  for (; step > 0; step /= 2)
+  {
+    if (position + step <= n && _tree[position + step] < value)
+    {
+      position += step;
+      value -= _tree[position];
+    }
+  }
+  return position;
+}
+
+} // namespace pockets
@@ -0,0 +1,739 @@
+//
+//  LineGeometry.h
+//
+
+#pragma once
+
+#include "pockets/Pockets.h"
+#include "pockets/Parallel.h"
+#include "pockets/SlotMap.h"
+#include "pockets/Span.h"
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <limits>
+
+namespace pockets
+{
+
+/// Plain float triple; same layout as ci::vec3, so point arrays can be viewed either way.
+struct LinePoint {
+    float x, y, z;
+};
+
+inline bool operator == (const LinePoint &a, const LinePoint &b) { return a.x == b.x && a.y == b.y && a.z == b.z; }
+inline bool operator != (const LinePoint &a, const LinePoint &b) { return ! (a == b); }
+
+/// Plain float rgba; same layout as ci::ColorA.
+struct LineColor {
+    float r, g, b, a;
+};
+
+///
+/// One expanded line vertex, as read by LineRenderer's shader.
+/// Each point of a line becomes two of these, one on either side of the line.
+///
+struct LineVertex {
+    LinePoint position;
+    LinePoint previous;
+    LinePoint next;
+    LineColor color;
+    float offset; // signed half-width
+    int32_t mitered;
+};
+
+/// Column-major 4x4 matrix; same layout as ci::mat4, so one can be copied into the other.
+struct LineMatrix {
+    float m[16];
+
+    static LineMatrix identity() { return LineMatrix{ { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 } }; }
+};
+
+/// Axis-aligned bounding box. Empty boxes have min above max.
+struct LineBounds {
+    LinePoint min = { std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max() };
+    LinePoint max = { std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest() };
+
+    bool empty() const { return min.x > max.x; }
+    ///
+    /// True if the box may be visible under \a view_projection. Conservative: a box is
+    /// rejected only when all eight corners fall outside the same clip plane.
+    ///
+    bool intersectsFrustum(const LineMatrix &view_projection) const;
+};
+
+struct LineStyle {
+    float width = 1.0f;
+    LineColor front_color = { 1.0f, 1.0f, 1.0f, 1.0f };
+    LineColor back_color = { 1.0f, 1.0f, 1.0f, 1.0f };
+    bool mitered = false;
+};
+
+///
+/// A line to add in bulk: its points and how to draw them. \a ramp, if not empty, holds each point's
+/// place along the style's color ramp (0 at the front color, 1 at the back), so a line thinned
+/// by LineSimplifier keeps the colors its points had. Empty spaces the points evenly along the ramp.
+///
+struct LinePolyline {
+    span<const LinePoint> positions;
+    LineStyle style;
+    span<const float> ramp;
+};
+
+/// Stable reference to a line in a LineGeometryBuilder.
+using LineHandle = slot_handle;
+
+///
+/// One draw call's worth of a LineGeometryBuilder's indices: \a index_count 16-bit indices
+/// from \a index_offset, each relative to \a base_vertex (as for glDrawElementsBaseVertex).
+///
+struct LineDrawRange {
+    size_t base_vertex;
+    size_t index_offset;
+    size_t index_count;
+};
+
+/// A run of bytes within a vertex or index array.
+struct LineByteRange {
+    size_t offset;
+    size_t size;
+};
+
+///
+/// Per-point colors of a line, ramping from its style's front color toward the back color.
+/// Point i sits at i / point_count along the ramp, unless \a ramp gives each point's place.
+///
+struct LineColorRamp {
+    LineColorRamp(const LineStyle &style, size_t point_count, span<const float> ramp = span<const float>())
+    : front(style.front_color),
+      delta{ style.back_color.r - front.r, style.back_color.g - front.g, style.back_color.b - front.b, style.back_color.a - front.a },
+      step(point_count > 0 ? 1.0f / point_count : 0.0f),
+      places(ramp.empty() ? nullptr : ramp.data())
+    {
+        assert(ramp.empty() || ramp.size() == point_count);
+    }
+
+    /// Place of point \a i along an evenly spaced ramp of the given point count.
+    static float place(size_t i, size_t point_count) { return i * (point_count > 0 ? 1.0f / point_count : 0.0f); }
+
+    /// Color of point \a i. A multiply-add per channel, so loops calling it vectorize.
+    LineColor at(size_t i) const
+    {
+        const auto t = places ? places[i] : i * step;
+        return LineColor{ front.r + delta.r * t, front.g + delta.g * t, front.b + delta.b * t, front.a + delta.a * t };
+    }
+
+    LineColor front;
+    LineColor delta;
+    float step;
+    const float *places;
+};
+
+///
+/// Element ranges of an array that changed since they were last uploaded.
+/// Sequential marks extend one range, as when appending; past 4096 scattered ranges,
+/// the whole array is flagged instead, since one big upload beats thousands of small ones.
+///
+class LineDirtyRanges {
+public:
+    void mark(size_t begin, size_t end);
+    void markAll() { _all = true; _ranges.clear(); }
+    void clear() { _all = false; _ranges.clear(); }
+    bool empty() const { return ! _all && _ranges.empty(); }
+
+    ///
+    /// Byte ranges of an array of \a element_count elements of \a element_size bytes, sorted and merged.
+    /// Ranges closer than \a merge_gap bytes are joined, trading a little extra upload for fewer calls.
+    ///
+    std::vector<LineByteRange> bytes(size_t element_count, size_t element_size, size_t merge_gap) const;
+
+private:
+    /// Element range [begin, end).
+    using Range = std::pair<size_t, size_t>;
+    std::vector<Range> _ranges;
+    bool _all = false;
+};
+
+///
+/// Expands polylines into the triangle geometry LineRenderer draws, without touching OpenGL.
+/// Build on any thread, then hand the builder to LineRenderer::setGeometry for upload.
+///
+/// Lines can be updated or removed through the handle returned when they were added.
+/// Changes are recorded as dirty ranges, so a renderer re-uploads only what changed.
+/// Removed lines and lines that outgrow their space leave degenerate triangles behind;
+/// the arrays are compacted once that waste outweighs the live geometry.
+///
+/// Indices are 16 bits, relative to the start of a batch of BatchStride vertices.
+/// Each segment belongs to the batch its first vertex falls in, so lines of any length
+/// split across batches on their own; drawRanges() lists one draw call per batch.
+///
+/// The static functions write one line into caller-supplied spans, for callers managing their own memory:
+///
+/// auto vertices = std::vector<LineVertex>(LineGeometryBuilder::vertexCount(points.size()));
+/// auto indices = std::vector<uint32_t>(LineGeometryBuilder::indexCount(points.size()));
+/// LineGeometryBuilder::build(points, style, 0, vertices, indices);
+///
+class LineGeometryBuilder {
+public:
+    static size_t vertexCount(size_t point_count) { return point_count * 2; }
+    static size_t indexCount(size_t point_count) { return point_count > 1 ? (point_count - 1) * 6 : 0; }
+    ///
+    /// Vertices per batch of 16-bit indices. A batch's last segment reaches three vertices
+    /// past its stride, so indices stay below 0xFFFF, which is left free for primitive restart.
+    ///
+    static const size_t BatchStride = 65532;
+
+    ///
+    /// Write the geometry of one line. \a vertices must hold vertexCount(positions.size()) elements
+    /// and \a indices indexCount(positions.size()); indices refer to vertices starting at \a base_vertex.
+    ///
+    static void build(span<const LinePoint> positions, const LineStyle &style, uint32_t base_vertex, span<LineVertex> vertices, span<uint32_t> indices, span<const float> ramp = span<const float>());
+    ///
+    /// Write only the vertices of one line; \a vertices must hold vertexCount(positions.size()) elements.
+    /// Returns the line's bounds, gathered in the same pass. \a ramp is as for LinePolyline.
+    ///
+    static LineBounds buildVertices(span<const LinePoint> positions, const LineStyle &style, span<LineVertex> vertices, span<const float> ramp = span<const float>());
+
+    /// Append a line's geometry to the builder.
+    LineHandle addLine(span<const LinePoint> positions, const LineStyle &style);
+    ///
+    /// Append many lines at once. Sizes the output exactly, grows it once,
+    /// then expands the lines in parallel chunks of roughly equal point counts.
+    /// Returns a handle for each line, in order.
+    ///
+    std::vector<LineHandle> addLines(span<const LinePolyline> lines, size_t thread_count = 0);
+
+    ///
+    /// Replace the points of a line, keeping its style; they are spaced evenly along its color ramp. Rebuilds in place when the line
+    /// still fits in its space, otherwise moves it to the end. Returns false if \a line is stale.
+    ///
+    bool updateLine(LineHandle line, span<const LinePoint> positions);
+    /// Remove a line. Returns false if \a line is stale.
+    bool removeLine(LineHandle line);
+    bool contains(LineHandle line) const { return _lines.contains(line); }
+    size_t lineCount() const { return _lines.size(); }
+    /// Bounds of a line's points; empty if \a line is stale.
+    LineBounds bounds(LineHandle line) const
+    {
+        const auto *l = _lines.get(line);
+        return l ? l->bounds : LineBounds();
+    }
+
+    /// Remove all lines. Outstanding handles become stale.
+    void clear();
+    void reserve(size_t point_count, size_t line_count);
+    /// Pack live lines together, in their original order. Marks everything dirty.
+    void compact();
+
+    const std::vector<LineVertex>& vertices() const { return _vertices; }
+    /// Batch-relative indices; draw them with drawRanges().
+    const std::vector<uint16_t>& indices() const { return _indices; }
+    ///
+    /// One range per batch of vertices, in draw order. Skips the index blocks of removed lines,
+    /// but may include degenerate triangles between live lines.
+    ///
+    const std::vector<LineDrawRange>& drawRanges() const;
+
+    ///
+    /// Gather the indices of the lines whose bounds may be visible under \a view_projection
+    /// into culledIndices(), with one culledRanges() entry per batch, and return how many lines passed.
+    /// Relies on the bounds kept for each line, so it costs one box test per line plus a copy of the visible indices.
+    ///
+    size_t cull(const LineMatrix &view_projection);
+    /// Batch-relative indices of the lines that passed the last cull(); draw them with culledRanges().
+    const std::vector<uint16_t>& culledIndices() const { return _culled_indices; }
+    const std::vector<LineDrawRange>& culledRanges() const { return _culled_ranges; }
+
+    ///
+    /// Byte ranges of vertices() and indices() changed since the last markClean(), sorted and merged.
+    /// Ranges closer than \a merge_gap bytes are joined, trading a little extra upload for fewer calls.
+    ///
+    std::vector<LineByteRange> dirtyVertexRanges(size_t merge_gap = 4096) const { return _dirty_vertices.bytes(_vertices.size(), sizeof(LineVertex), merge_gap); }
+    std::vector<LineByteRange> dirtyIndexRanges(size_t merge_gap = 4096) const { return _dirty_indices.bytes(_indices.size(), sizeof(uint16_t), merge_gap); }
+    bool isDirty() const { return ! _dirty_vertices.empty() || ! _dirty_indices.empty(); }
+    /// Call once the dirty ranges have been uploaded.
+    void markClean() { _dirty_vertices.clear(); _dirty_indices.clear(); }
+    /// Flag every vertex and index as dirty, e.g. when the destination buffer was reallocated.
+    void markAllDirty() { _dirty_vertices.markAll(); _dirty_indices.markAll(); }
+
+private:
+    struct Line {
+        size_t vertex_offset = 0;
+        size_t vertex_capacity = 0;
+        size_t index_offset = 0;
+        size_t index_capacity = 0;
+        size_t point_count = 0;
+        LineStyle style;
+        LineBounds bounds;
+    };
+    Line makeLine(size_t point_count, const LineStyle &style);
+    void buildLine(Line &line, span<const LinePoint> positions, span<const float> ramp = span<const float>());
+    /// Write the batch-relative indices of segments [first, last) of a line. With \a degenerate,
+    /// each segment's triangles collapse onto its first vertex, so the rasterizer discards them.
+    void writeIndices(const Line &line, size_t first, size_t last, bool degenerate);
+    /// Replace a line's index block with degenerate triangles from index \a from on, so it draws nothing there.
+    void retireIndices(const Line &line, size_t from);
+    void compactIfWasteful();
+    void changed() { _order_stale = true; _draw_ranges_stale = true; }
+    /// Live lines in the order they sit in the arrays, which is also their order in the index array.
+    const std::vector<const Line*>& lineOrder() const;
+    /// Calls fn(base_vertex, begin_segment, end_segment) for each batch that a line's live segments fall in.
+    template <typename Fn>
+    static void forEachBatch(const Line &line, Fn &&fn);
+
+    std::vector<LineVertex> _vertices;
+    std::vector<uint16_t> _indices;
+    slot_map<Line> _lines;
+    size_t _live_vertices = 0;
+
+    mutable std::vector<const Line*> _order;
+    mutable bool _order_stale = false;
+    mutable std::vector<LineDrawRange> _draw_ranges;
+    mutable bool _draw_ranges_stale = false;
+    std::vector<uint16_t> _culled_indices;
+    std::vector<LineDrawRange> _culled_ranges;
+
+    LineDirtyRanges _dirty_vertices;
+    LineDirtyRanges _dirty_indices;
+};
+
+inline void LineGeometryBuilder::build(span<const LinePoint> positions, const LineStyle &style, uint32_t base_vertex, span<LineVertex> vertices, span<uint32_t> indices, span<const float> ramp)
+{
+    const auto count = positions.size();
+    assert(indices.size() == indexCount(count));
+
+    // two triangles joining each point's pair of vertices to the next point's
+    auto *index = indices.data();
+    for (size_t i = 0; i + 1 < count; i += 1) {
+        const auto v = base_vertex + static_cast<uint32_t>(i * 2);
+        index[0] = v + 0;
+        index[1] = v + 1;
+        index[2] = v + 2;
+
+        index[3] = v + 2;
+        index[4] = v + 1;
+        index[5] = v + 3;
+        index += 6;
+    }
+
+    buildVertices(positions, style, vertices, ramp);
+}
+
+inline LineBounds LineGeometryBuilder::buildVertices(span<const LinePoint> positions, const LineStyle &style, span<LineVertex> vertices, span<const float> ramp)
+{
+    const auto count = positions.size();
+    assert(vertices.size() == vertexCount(count));
+    auto bounds = LineBounds();
+    if (count == 0) {
+        return bounds;
+    }
+
+    // interior points are branch-free so the loop vectorizes
+    const auto mitered = style.mitered ? 1 : 0;
+    const auto half_width = style.width / 2.0f;
+    const auto colors = LineColorRamp(style, count, ramp);
+    const auto *p = positions.data();
+    auto *vertex = vertices.data();
+    auto &low = bounds.min;
+    auto &high = bounds.max;
+    auto emit = [&] (size_t i, const LinePoint &previous, const LinePoint &next) {
+        const auto color = colors.at(i);
+        vertex[i * 2] = LineVertex{ p[i], previous, next, color, half_width, mitered };
+        vertex[i * 2 + 1] = LineVertex{ p[i], previous, next, color, -half_width, mitered };
+        low = LinePoint{ std::min(low.x, p[i].x), std::min(low.y, p[i].y), std::min(low.z, p[i].z) };
+        high = LinePoint{ std::max(high.x, p[i].x), std::max(high.y, p[i].y), std::max(high.z, p[i].z) };
+    };
+
+    // endpoints use themselves as their missing neighbor
+    emit(0, p[0], p[count > 1 ? 1 : 0]);
+    for (size_t i = 1; i + 1 < count; i += 1) {
+        emit(i, p[i - 1], p[i + 1]);
+    }
+    if (count > 1) {
+        emit(count - 1, p[count - 2], p[count - 1]);
+    }
+    return bounds;
+}
+
+inline auto LineGeometryBuilder::makeLine(size_t point_count, const LineStyle &style) -> Line
+{
+    auto line = Line();
+    line.vertex_offset = _vertices.size();
+    line.vertex_capacity = vertexCount(point_count);
+    line.index_offset = _indices.size();
+    line.index_capacity = indexCount(point_count);
+    line.point_count = point_count;
+    line.style = style;
+
+    _vertices.resize(line.vertex_offset + line.vertex_capacity);
+    _indices.resize(line.index_offset + line.index_capacity);
+    _dirty_vertices.mark(line.vertex_offset, _vertices.size());
+    _dirty_indices.mark(line.index_offset, _indices.size());
+    _live_vertices += line.vertex_capacity;
+    changed();
+    return line;
+}
+
+inline void LineGeometryBuilder::buildLine(Line &line, span<const LinePoint> positions, span<const float> ramp)
+{
+    line.bounds = buildVertices(positions, line.style, span<LineVertex>(_vertices).subspan(line.vertex_offset, vertexCount(positions.size())), ramp);
+    writeIndices(line, 0, indexCount(positions.size()) / 6, false);
+}
+
+inline void LineGeometryBuilder::writeIndices(const Line &line, size_t first, size_t last, bool degenerate)
+{
+    // walk the segments one batch at a time, so the inner loop is plain arithmetic
+    const auto a = degenerate ? 0 : 1;
+    auto segment = first;
+    while (segment < last) {
+        const auto start = line.vertex_offset + segment * 2;
+        const auto base = start / BatchStride * BatchStride;
+        const auto batch_end = std::min(last, (base + BatchStride - line.vertex_offset + 1) / 2);
+        auto *index = _indices.data() + line.index_offset + segment * 6;
+        for (; segment < batch_end; segment += 1) {
+            const auto v = static_cast<uint16_t>(line.vertex_offset + segment * 2 - base);
+            index[0] = v;
+            index[1] = v + a;
+            index[2] = v + 2 * a;
+
+            index[3] = v + 2 * a;
+            index[4] = v + a;
+            index[5] = v + 3 * a;
+            index += 6;
+        }
+    }
+}
+
+inline LineHandle LineGeometryBuilder::addLine(span<const LinePoint> positions, const LineStyle &style)
+{
+    auto line = makeLine(positions.size(), style);
+    buildLine(line, positions);
+    return _lines.insert(line);
+}
+
+inline std::vector<LineHandle> LineGeometryBuilder::addLines(span<const LinePolyline> lines, size_t thread_count)
+{
+    // exact output offsets of every line
+    auto records = std::vector<Line>();
+    auto handles = std::vector<LineHandle>();
+    records.reserve(lines.size());
+    handles.reserve(lines.size());
+    auto vertex_end = _vertices.size();
+    auto index_end = _indices.size();
+    for (auto &l: lines) {
+        auto line = Line();
+        line.vertex_offset = vertex_end;
+        line.vertex_capacity = vertexCount(l.positions.size());
+        line.index_offset = index_end;
+        line.index_capacity = indexCount(l.positions.size());
+        line.point_count = l.positions.size();
+        line.style = l.style;
+        vertex_end += line.vertex_capacity;
+        index_end += line.index_capacity;
+        records.push_back(line);
+        handles.push_back(_lines.insert(line));
+    }
+    _dirty_vertices.mark(_vertices.size(), vertex_end);
+    _dirty_indices.mark(_indices.size(), index_end);
+    _live_vertices += vertex_end - _vertices.size();
+    changed();
+    const auto vertex_begin = _vertices.size();
+    _vertices.resize(vertex_end);
+    _indices.resize(index_end);
+
+    // split by vertex count rather than line count, so a few long lines don't leave threads idle
+    const auto total = vertex_end - vertex_begin;
+    const auto chunks = std::min(resolve_thread_count(thread_count), lines.size());
+    auto line_at = [&] (size_t chunk) {
+        const auto target = vertex_begin + total * chunk / std::max<size_t>(1, chunks);
+        return static_cast<size_t>(std::lower_bound(records.begin(), records.end(), target, [] (const Line &line, size_t v) { return line.vertex_offset < v; }) - records.begin());
+    };
+
+    parallel_for_chunks(chunks, chunks, [&] (size_t begin_chunk, size_t end_chunk, size_t) {
+        const auto end = end_chunk == chunks ? lines.size() : line_at(end_chunk);
+        for (auto i = line_at(begin_chunk); i < end; i += 1) {
+            buildLine(records[i], lines[i].positions, lines[i].ramp);
+        }
+    });
+    for (size_t i = 0; i < records.size(); i += 1) {
+        _lines[handles[i]].bounds = records[i].bounds;
+    }
+
+    return handles;
+}
+
+inline bool LineGeometryBuilder::updateLine(LineHandle handle, span<const LinePoint> positions)
+{
+    auto *line = _lines.get(handle);
+    if (! line) {
+        return false;
+    }
+
+    const auto vertices = vertexCount(positions.size());
+    const auto indices = indexCount(positions.size());
+    _live_vertices = _live_vertices - vertexCount(line->point_count) + vertices;
+    if (vertices <= line->vertex_capacity && indices <= line->index_capacity) {
+        // rebuild in place; index values only change if the point count did
+        const auto previous_count = line->point_count;
+        line->point_count = positions.size();
+        buildLine(*line, positions);
+        _dirty_vertices.mark(line->vertex_offset, line->vertex_offset + vertices);
+        if (positions.size() != previous_count) {
+            changed();
+            retireIndices(*line, indices);
+            _dirty_indices.mark(line->index_offset, line->index_offset + line->index_capacity);
+        }
+    }
+    else {
+        retireIndices(*line, 0);
+        _live_vertices -= vertices;
+        const auto style = line->style;
+        *line = makeLine(positions.size(), style);
+        buildLine(*line, positions);
+    }
+
+    compactIfWasteful();
+    return true;
+}
+
+inline bool LineGeometryBuilder::removeLine(LineHandle handle)
+{
+    auto *line = _lines.get(handle);
+    if (! line) {
+        return false;
+    }
+
+    retireIndices(*line, 0);
+    _live_vertices -= vertexCount(line->point_count);
+    _lines.erase(handle);
+    changed();
+
+    compactIfWasteful();
+    return true;
+}
+
+inline void LineGeometryBuilder::retireIndices(const Line &line, size_t from)
+{
+    writeIndices(line, from / 6, line.index_capacity / 6, true);
+    _dirty_indices.mark(line.index_offset + from, line.index_offset + line.index_capacity);
+}
+
+inline void LineGeometryBuilder::compactIfWasteful()
+{
+    const auto wasted = _vertices.size() - _live_vertices;
+    if (wasted > 4096 && wasted > _live_vertices) {
+        compact();
+    }
+}
+
+inline void LineGeometryBuilder::compact()
+{
+    // keep draw order by walking lines in their current order in the arrays
+    auto order = std::vector<size_t>(_lines.size());
+    for (size_t i = 0; i < order.size(); i += 1) {
+        order[i] = i;
+    }
+    const auto *lines = _lines.data();
+    std::sort(order.begin(), order.end(), [lines] (size_t a, size_t b) { return lines[a].vertex_offset < lines[b].vertex_offset; });
+
+    auto vertices = std::vector<LineVertex>();
+    vertices.reserve(_live_vertices);
+    auto index_count = size_t(0);
+    for (auto i: order) {
+        auto &line = _lines.data()[i];
+        const auto vertex_count = vertexCount(line.point_count);
+        const auto new_vertex_offset = vertices.size();
+        vertices.insert(vertices.end(), _vertices.begin() + line.vertex_offset, _vertices.begin() + line.vertex_offset + vertex_count);
+        line.vertex_offset = new_vertex_offset;
+        line.vertex_capacity = vertex_count;
+        line.index_offset = index_count;
+        line.index_capacity = indexCount(line.point_count);
+        index_count += line.index_capacity;
+    }
+    std::swap(vertices, _vertices);
+
+    // lines may have moved between batches, so their indices are written afresh
+    _indices.resize(index_count);
+    for (auto &line: _lines) {
+        writeIndices(line, 0, line.index_capacity / 6, false);
+    }
+    _indices.shrink_to_fit();
+    changed();
+    markAllDirty();
+}
+
+inline void LineGeometryBuilder::clear()
+{
+    _vertices.clear();
+    _indices.clear();
+    _lines.clear();
+    _live_vertices = 0;
+    changed();
+    markAllDirty();
+}
+
+inline void LineGeometryBuilder::reserve(size_t point_count, size_t line_count)
+{
+    _vertices.reserve(vertexCount(point_count));
+    _indices.reserve(point_count > line_count ? (point_count - line_count) * 6 : 0);
+    _lines.reserve(line_count);
+}
+
+inline auto LineGeometryBuilder::lineOrder() const -> const std::vector<const Line*>&
+{
+    if (_order_stale) {
+        _order_stale = false;
+        _order.clear();
+        _order.reserve(_lines.size());
+        for (auto &line: _lines) {
+            _order.push_back(&line);
+        }
+        std::sort(_order.begin(), _order.end(), [] (const Line *a, const Line *b) { return a->index_offset < b->index_offset; });
+    }
+    return _order;
+}
+
+template <typename Fn>
+void LineGeometryBuilder::forEachBatch(const Line &line, Fn &&fn)
+{
+    const auto segments = indexCount(line.point_count) / 6;
+    auto segment = size_t(0);
+    while (segment < segments) {
+        const auto base = (line.vertex_offset + segment * 2) / BatchStride * BatchStride;
+        const auto batch_end = std::min(segments, (base + BatchStride - line.vertex_offset + 1) / 2);
+        fn(base, segment, batch_end);
+        segment = batch_end;
+    }
+}
+
+inline const std::vector<LineDrawRange>& LineGeometryBuilder::drawRanges() const
+{
+    if (! _draw_ranges_stale) {
+        return _draw_ranges;
+    }
+    _draw_ranges_stale = false;
+    _draw_ranges.clear();
+
+    // lines sit in the same order in both arrays, so walking them by index offset walks the batches in order
+    for (auto *line: lineOrder()) {
+        forEachBatch(*line, [this, line] (size_t base, size_t first, size_t last) {
+            const auto begin = line->index_offset + first * 6;
+            const auto end = line->index_offset + last * 6;
+            // indices between two lines of one batch are valid in that batch too, so one call covers both
+            if (! _draw_ranges.empty() && _draw_ranges.back().base_vertex == base) {
+                _draw_ranges.back().index_count = end - _draw_ranges.back().index_offset;
+            }
+            else {
+                _draw_ranges.push_back(LineDrawRange{ base, begin, end - begin });
+            }
+        });
+    }
+    return _draw_ranges;
+}
+
+inline size_t LineGeometryBuilder::cull(const LineMatrix &view_projection)
+{
+    _culled_indices.clear();
+    _culled_ranges.clear();
+    auto visible = size_t(0);
+    for (auto *line: lineOrder()) {
+        if (! line->bounds.intersectsFrustum(view_projection)) {
+            continue;
+        }
+        visible += 1;
+        forEachBatch(*line, [this, line] (size_t base, size_t first, size_t last) {
+            const auto begin = _indices.begin() + line->index_offset;
+            const auto offset = _culled_indices.size();
+            _culled_indices.insert(_culled_indices.end(), begin + first * 6, begin + last * 6);
+            if (! _culled_ranges.empty() && _culled_ranges.back().base_vertex == base) {
+                _culled_ranges.back().index_count += (last - first) * 6;
+            }
+            else {
+                _culled_ranges.push_back(LineDrawRange{ base, offset, (last - first) * 6 });
+            }
+        });
+    }
+    return visible;
+}
+
+inline bool LineBounds::intersectsFrustum(const LineMatrix &view_projection) const
+{
+    if (empty()) {
+        return false;
+    }
+
+    // count the corners beyond each clip plane: -w < x, y, z < w
+    const auto *m = view_projection.m;
+    int outside[6] = { 0, 0, 0, 0, 0, 0 };
+    for (auto corner = 0; corner < 8; corner += 1) {
+        const auto x = (corner & 1) ? max.x : min.x;
+        const auto y = (corner & 2) ? max.y : min.y;
+        const auto z = (corner & 4) ? max.z : min.z;
+        const auto cx = m[0] * x + m[4] * y + m[8] * z + m[12];
+        const auto cy = m[1] * x + m[5] * y + m[9] * z + m[13];
+        const auto cz = m[2] * x + m[6] * y + m[10] * z + m[14];
+        const auto cw = m[3] * x + m[7] * y + m[11] * z + m[15];
+        outside[0] += cx < -cw;
+        outside[1] += cx > cw;
+        outside[2] += cy < -cw;
+        outside[3] += cy > cw;
+        outside[4] += cz < -cw;
+        outside[5] += cz > cw;
+    }
+    return std::none_of(std::begin(outside), std::end(outside), [] (int count) { return count == 8; });
+}
+
+inline void LineDirtyRanges::mark(size_t begin, size_t end)
+{
+    if (_all || begin == end) {
+        return;
+    }
+    if (! _ranges.empty() && _ranges.back().second == begin) {
+        _ranges.back().second = end;
+        return;
+    }
+    _ranges.emplace_back(begin, end);
+    if (_ranges.size() > 4096) {
+        markAll();
+    }
+}
+
+inline std::vector<LineByteRange> LineDirtyRanges::bytes(size_t element_count, size_t element_size, size_t merge_gap) const
+{
+    auto result = std::vector<LineByteRange>();
+    if (_all) {
+        if (element_count > 0) {
+            result.push_back(LineByteRange{ 0, element_count * element_size });
+        }
+        return result;
+    }
+    if (_ranges.empty()) {
+        return result;
+    }
+
+    auto sorted = _ranges;
+    std::sort(sorted.begin(), sorted.end());
+    const auto gap = merge_gap / element_size;
+    auto current = sorted.front();
+    for (auto &r: sorted) {
+        if (r.first <= current.second + gap) {
+            current.second = std::max(current.second, r.second);
+        }
+        else {
+            result.push_back(LineByteRange{ current.first * element_size, (current.second - current.first) * element_size });
+            current = r;
+        }
+    }
+    result.push_back(LineByteRange{ current.first * element_size, (current.second - current.first) * element_size });
+
+    // ranges may refer to elements dropped since; clip to the array
+    const auto limit = element_count * element_size;
+    for (auto &r: result) {
+        r.offset = std::min(r.offset, limit);
+        r.size = std::min(r.size, limit - r.offset);
+    }
+    result.erase(std::remove_if(result.begin(), result.end(), [] (const LineByteRange &r) { return r.size == 0; }), result.end());
+    return result;
+}
+
+} // namespace pockets
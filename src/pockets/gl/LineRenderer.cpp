@@ -3,6 +3,7 @@
 //
 
 #include "LineRenderer.h"
+#include <cstring>
 
 using namespace pockets;
 using namespace cinder;
@@ -11,6 +12,24 @@ namespace {
 
 using Vertex = LineRenderer::Vertex;
 
+static_assert(sizeof(vec3) == sizeof(LinePoint), "LineRenderer views ci::vec3 arrays as LinePoints.");
+
+LineColor toLineColor(const ColorA &c) { return LineColor{ c.r, c.g, c.b, c.a }; }
+
+/// Upload the byte \a ranges of \a data, or all \a bytes of it if the buffer has to grow.
+void uploadRanges(const gl::VboRef &buffer, const void *data, size_t bytes, const std::vector<LineByteRange> &ranges)
+{
+    if (static_cast<GLsizeiptr>(bytes) > buffer->getSize()) {
+        // growing discards the buffer's contents, so send everything; grow ahead to keep this rare
+        buffer->ensureMinimumSize(std::max<GLsizeiptr>(bytes, buffer->getSize() + buffer->getSize() / 2));
+        buffer->bufferSubData(0, bytes, data);
+        return;
+    }
+    for (auto &range: ranges) {
+        buffer->bufferSubData(range.offset, range.size, static_cast<const uint8_t*>(data) + range.offset);
+    }
+}
+
 const auto VertexLayout = ([] {
     geom::BufferLayout layout;
     layout.append(geom::Attrib::POSITION, 3, sizeof(Vertex), offsetof(Vertex, position));
@@ -30,34 +49,115 @@ const auto VertexMapping = gl::Batch::AttributeMapping{ { geom::Attrib::POSITION
     { geom::Attrib::CUSTOM_2, "EdgeOffset" },
     { geom::Attrib::CUSTOM_3, "Miter" } };
 
+/// Instance k reads points k through k + 3; the segment runs from point k + 1 to point k + 2.
+const auto SegmentLayout = ([] {
+    using Point = LineSegmentPoint;
+    const auto stride = sizeof(Point);
+    geom::BufferLayout layout;
+    layout.append(geom::Attrib::CUSTOM_0, 3, stride, offsetof(Point, position), 1);
+    layout.append(geom::Attrib::POSITION, 3, stride, stride + offsetof(Point, position), 1);
+    layout.append(geom::Attrib::CUSTOM_4, 3, stride, 2 * stride + offsetof(Point, position), 1);
+    layout.append(geom::Attrib::CUSTOM_1, 3, stride, 3 * stride + offsetof(Point, position), 1);
+    layout.append(geom::Attrib::COLOR, 4, stride, stride + offsetof(Point, color), 1);
+    layout.append(geom::Attrib::CUSTOM_5, 4, stride, 2 * stride + offsetof(Point, color), 1);
+    layout.append(geom::Attrib::CUSTOM_2, 1, stride, stride + offsetof(Point, half_width), 1);
+    layout.append(geom::Attrib::CUSTOM_6, 1, stride, 2 * stride + offsetof(Point, half_width), 1);
+    layout.append(geom::Attrib::CUSTOM_3, 1, stride, stride + offsetof(Point, mitered), 1);
+
+    return layout;
+}());
+
+const auto SegmentMapping = gl::Batch::AttributeMapping{ { geom::Attrib::POSITION, "ciPosition" },
+    { geom::Attrib::COLOR, "ciColor" },
+    { geom::Attrib::CUSTOM_0, "Previous" },
+    { geom::Attrib::CUSTOM_1, "Next" },
+    { geom::Attrib::CUSTOM_2, "EdgeOffset" },
+    { geom::Attrib::CUSTOM_3, "Miter" },
+    { geom::Attrib::CUSTOM_4, "PointB" },
+    { geom::Attrib::CUSTOM_5, "ColorB" },
+    { geom::Attrib::CUSTOM_6, "HalfWidthB" } };
+
 const auto VertexShader = R"vs(
 #version 330 core
 
 uniform mat4 ciModelViewProjection;
 uniform float AspectRatio;
 
-in vec3 ciPosition;
 in vec4 ciColor;
+#ifdef PACKED_VERTICES
+// origin of the batch being drawn; its last segment reaches vertices of the next batch, packed against NextOrigin
+uniform vec3 Origin;
+uniform vec3 NextOrigin;
+uniform int BatchEnd;
+in vec4 PositionOffset; // position relative to the batch origin, and half-width
+in uint PositionZOffset; // bytes 4-7 of the same vertex, read as bits: the miter flag is the top bit
+in vec4 PreviousNextX;
+in vec2 NextYZ;
+#else
+in vec3 ciPosition;
 in vec3 Previous;
 in vec3 Next;
 in float EdgeOffset;
 in int Miter;
+#ifdef SEGMENT_INSTANCES
+// one instance per segment, from ciPosition to PointB; EdgeOffset is the half-width at ciPosition
+in vec3 PointB;
+in vec4 ColorB;
+in float HalfWidthB;
+#endif
+#endif
 
 out Vertex {
 	vec4 Color;
 } v;
 
 void main() {
+#ifdef PACKED_VERTICES
+	// gl_VertexID includes the base vertex, so it tells which batch a vertex was packed in
+	vec3 origin = gl_VertexID < BatchEnd ? Origin : NextOrigin;
+	vec3 position = origin + PositionOffset.xyz;
+	vec3 previous = origin + PreviousNextX.xyz;
+	vec3 next = origin + vec3(PreviousNextX.w, NextYZ);
+	// even vertices sit on the positive side of the line
+	float edgeOffset = (gl_VertexID % 2 == 0) ? abs(PositionOffset.w) : -abs(PositionOffset.w);
+	bool mitered = (PositionZOffset & 0x80000000u) != 0u;
+	vec4 color = ciColor;
+#elif defined(SEGMENT_INSTANCES)
+	// the zero-width points framing each line collapse the segments that reach them
+	if (EdgeOffset == 0.0 || HalfWidthB == 0.0) {
+		gl_Position = vec4(0.0);
+		v.Color = vec4(0.0);
+		return;
+	}
+	// corners of the segment's two triangles, in the order LineGeometryBuilder indexes them
+	int corner = gl_VertexID % 6;
+	bool atB = corner == 2 || corner == 3 || corner == 5;
+	float side = (corner == 1 || corner == 4 || corner == 5) ? -1.0 : 1.0;
+	vec3 position = atB ? PointB : ciPosition;
+	vec3 previous = atB ? ciPosition : Previous;
+	vec3 next = atB ? Next : PointB;
+	float edgeOffset = side * (atB ? HalfWidthB : EdgeOffset);
+	bool mitered = Miter == 1;
+	vec4 color = atB ? ColorB : ciColor;
+#else
+	vec3 position = ciPosition;
+	vec3 previous = Previous;
+	vec3 next = Next;
+	float edgeOffset = EdgeOffset;
+	bool mitered = Miter == 1;
+	vec4 color = ciColor;
+#endif
+
 	vec2 aspectVector = vec2(AspectRatio, 1.0);
-	vec4 previousPoint = ciModelViewProjection * vec4(Previous, 1.0);
-	vec4 currentPoint = ciModelViewProjection * vec4(ciPosition, 1.0);
-	vec4 nextPoint = ciModelViewProjection * vec4(Next, 1.0);
+	vec4 previousPoint = ciModelViewProjection * vec4(previous, 1.0);
+	vec4 currentPoint = ciModelViewProjection * vec4(position, 1.0);
+	vec4 nextPoint = ciModelViewProjection * vec4(next, 1.0);
 
 	vec2 currentScreen = aspectVector * currentPoint.xy / currentPoint.w;
 	vec2 previousScreen = aspectVector * previousPoint.xy / previousPoint.w;
 	vec2 nextScreen = aspectVector * nextPoint.xy / nextPoint.w;
 
-	float len = EdgeOffset;
+	float len = edgeOffset;
 
 	vec2 dir = vec2(0.0);
 	if (currentScreen == previousScreen) {
@@ -68,13 +168,13 @@ void main() {
 	}
 	else {
 		vec2 ab = normalize(currentScreen - previousScreen);
-		if (Miter == 1) {
+		if (mitered) {
 			vec2 bc = normalize(nextScreen - currentScreen);
 			vec2 tangent = normalize(ab + bc);
 			vec2 normal = vec2(-ab.y, ab.x);
 			vec2 miter = vec2(-tangent.y, tangent.x);
 			dir = tangent;
-			len = EdgeOffset / clamp(dot(miter, normal), 0.1, 1.0);
+			len = edgeOffset / clamp(dot(miter, normal), 0.1, 1.0);
 		}
 		else {
 			dir = ab;
@@ -86,7 +186,7 @@ void main() {
 
 	vec4 offset = vec4(normal, 0.0, 0.0);
 	gl_Position = currentPoint + offset;
-	v.Color = ciColor;
+	v.Color = color;
 }
 
 )vs";
@@ -108,80 +208,183 @@ void main() {
 
 } // namespace
 
-LineRenderer::LineRenderer()
+LineRenderer::LineRenderer(VertexFormat format)
+: _format(format)
 {
-    auto points = std::vector<Vertex>(2 * 10 * 1000);
-    auto indices = std::vector<uint16_t>(points.size() * 6);
-    _vertex_buffer = gl::Vbo::create(GL_ARRAY_BUFFER, points, GL_STREAM_DRAW);
-    _index_buffer = gl::Vbo::create(GL_ELEMENT_ARRAY_BUFFER, indices, GL_STREAM_DRAW);
-    auto mesh = gl::VboMesh::create(points.size(), GL_TRIANGLES, { { VertexLayout, _vertex_buffer } }, indices.size(), GL_UNSIGNED_INT, _index_buffer);
-    auto format = gl::GlslProg::Format().vertex(VertexShader).fragment(FragmentShader);
-    auto shader = gl::GlslProg::create(format);
+    // buffers start empty and grow with the geometry on upload
+    auto shader_format = gl::GlslProg::Format().vertex(VertexShader).fragment(FragmentShader);
+    _vertex_buffer = gl::Vbo::create(GL_ARRAY_BUFFER, 0, nullptr, GL_STREAM_DRAW);
+
+    if (_format == VertexFormat::InstancedSegments) {
+        // six vertices per instance and no indices; the points carry everything
+        auto mesh = gl::VboMesh::create(6, GL_TRIANGLES, { { SegmentLayout, _vertex_buffer } });
+        _batch = gl::Batch::create(mesh, gl::GlslProg::create(shader_format.define("SEGMENT_INSTANCES")), SegmentMapping);
+        return;
+    }
+
+    _index_buffer = gl::Vbo::create(GL_ELEMENT_ARRAY_BUFFER, 0, nullptr, GL_STREAM_DRAW);
+    _culled_index_buffer = gl::Vbo::create(GL_ELEMENT_ARRAY_BUFFER, 0, nullptr, GL_STREAM_DRAW);
+    if (_format == VertexFormat::Packed) {
+        _packed_shader = gl::GlslProg::create(shader_format.define("PACKED_VERTICES"));
+        _packed_vao = gl::Vao::create();
+
+        gl::ScopedVao vao(_packed_vao);
+        gl::ScopedBuffer vertices(_vertex_buffer);
+        // the element array binding belongs to the vao, so leave it bound
+        _index_buffer->bind();
+        const auto attribute = [this] (const char *name, GLint size, GLenum type, GLboolean normalized, size_t offset) {
+            const auto location = _packed_shader->getAttribLocation(name);
+            if (location >= 0) {
+                gl::enableVertexAttribArray(location);
+                gl::vertexAttribPointer(location, size, type, normalized, sizeof(PackedLineVertex), reinterpret_cast<const GLvoid*>(offset));
+            }
+        };
+        attribute("PositionOffset", 4, GL_HALF_FLOAT, GL_FALSE, offsetof(PackedLineVertex, position));
+        const auto flags = _packed_shader->getAttribLocation("PositionZOffset");
+        if (flags >= 0) {
+            gl::enableVertexAttribArray(flags);
+            gl::vertexAttribIPointer(flags, 1, GL_UNSIGNED_INT, sizeof(PackedLineVertex), reinterpret_cast<const GLvoid*>(offsetof(PackedLineVertex, position) + 2 * sizeof(uint16_t)));
+        }
+        attribute("PreviousNextX", 4, GL_HALF_FLOAT, GL_FALSE, offsetof(PackedLineVertex, previous));
+        attribute("NextYZ", 2, GL_HALF_FLOAT, GL_FALSE, offsetof(PackedLineVertex, next) + sizeof(uint16_t));
+        attribute("ciColor", 4, GL_UNSIGNED_BYTE, GL_TRUE, offsetof(PackedLineVertex, color));
+        return;
+    }
 
-    _batch = gl::Batch::create(mesh, shader, VertexMapping);
+    auto mesh = gl::VboMesh::create(0, GL_TRIANGLES, { { VertexLayout, _vertex_buffer } }, 0, GL_UNSIGNED_SHORT, _index_buffer);
+    _batch = gl::Batch::create(mesh, gl::GlslProg::create(shader_format), VertexMapping);
 }
 
 void LineRenderer::clear()
 {
-    _indices.clear();
-    _vertices.clear();
+    _geometry.clear();
+    _segments.clear();
+}
 
-    _needs_buffering = true;
+LineHandle LineRenderer::addLine(const std::vector<ci::vec3> &positions, float width, const ColorA &frontColor, const ColorA &backColor, bool mitered)
+{
+    auto style = LineStyle();
+    style.width = width;
+    style.front_color = toLineColor(frontColor);
+    style.back_color = toLineColor(backColor);
+    style.mitered = mitered;
+    if (_format == VertexFormat::InstancedSegments) {
+        return _segments.addLine(points(positions), style);
+    }
+    return _geometry.addLine(points(positions), style);
+}
+
+bool LineRenderer::updateLine(LineHandle line, const std::vector<ci::vec3> &positions)
+{
+    if (_format == VertexFormat::InstancedSegments) {
+        return _segments.updateLine(line, points(positions));
+    }
+    return _geometry.updateLine(line, points(positions));
 }
 
-void LineRenderer::addLine(const std::vector<ci::vec3> &positions, float width, const ColorA &frontColor, const ColorA &backColor, bool mitered)
+bool LineRenderer::removeLine(LineHandle line)
 {
-    // add indices
-    const auto index_offset = _vertices.size();
-    for (auto i = 0; i < (positions.size() - 1); i += 1) {
-        auto index = index_offset + i * 2;
-        _indices.push_back(index + 0);
-        _indices.push_back(index + 1);
-        _indices.push_back(index + 2);
+    if (_format == VertexFormat::InstancedSegments) {
+        return _segments.removeLine(line);
+    }
+    return _geometry.removeLine(line);
+}
 
-        _indices.push_back(index + 2);
-        _indices.push_back(index + 1);
-        _indices.push_back(index + 3);
+std::vector<LineHandle> LineRenderer::addLines(span<const LinePolyline> lines, size_t thread_count)
+{
+    if (_format == VertexFormat::InstancedSegments) {
+        return _segments.addLines(lines, thread_count);
     }
+    return _geometry.addLines(lines, thread_count);
+}
 
-    // add positions
-    const auto previous = [&positions](int index) {
-        return positions[glm::clamp(index - 1, 0, index)];
-    };
+std::vector<LineHandle> LineRenderer::addLines(span<const LinePolyline> lines, const LineSimplification &simplification, size_t thread_count)
+{
+    const auto simplified = LineSimplifier(simplification).simplify(lines, thread_count);
+    return addLines(simplified.lines, thread_count);
+}
 
-    const auto next = [&positions, high = positions.size() - 1](int index)
-    {
-        return positions[glm::clamp<int>(index + 1, 0, high)];
-    };
+LineSimplification LineRenderer::simplification(const ci::mat4 &view_projection, float tolerance)
+{
+    static_assert(sizeof(mat4) == sizeof(LineMatrix), "LineMatrix copies ci::mat4 directly.");
+    auto settings = LineSimplification();
+    std::memcpy(settings.view_projection.m, &view_projection, sizeof(LineMatrix));
+    auto viewport = gl::getViewport().second;
+    settings.viewport_width = static_cast<float>(viewport.x);
+    settings.viewport_height = static_cast<float>(viewport.y);
+    settings.tolerance = tolerance;
+    return settings;
+}
 
-    const auto color = [frontColor, backColor, end = positions.size()](int index)
-    {
-        return lerp(frontColor, backColor, (float)index / end);
-    };
+span<const LinePoint> LineRenderer::points(const std::vector<ci::vec3> &positions)
+{
+    return span<const LinePoint>(reinterpret_cast<const LinePoint*>(positions.data()), positions.size());
+}
 
-    auto mitered_int = mitered ? 1 : 0;
-    auto half_width = width / 2.0f;
-    for (auto i = 0; i < positions.size(); i += 1) {
-        _vertices.push_back(Vertex{ positions[i], previous(i), next(i), color(i), half_width, mitered_int });
-        _vertices.push_back(Vertex{ positions[i], previous(i), next(i), color(i), -half_width, mitered_int });
-    }
+void LineRenderer::setGeometry(LineGeometryBuilder geometry)
+{
+    _geometry = std::move(geometry);
+    _geometry.markAllDirty();
+}
 
-    _needs_buffering = true;
+void LineRenderer::setSegments(LineSegmentBuilder segments)
+{
+    _segments = std::move(segments);
+    _segments.markAllDirty();
 }
 
 void LineRenderer::bufferData()
 {
-    if (_needs_buffering)
-    {
-        const auto vb = sizeof(Vertex) * _vertices.size();
-        _vertex_buffer->ensureMinimumSize(vb);
-        _vertex_buffer->bufferSubData(0, vb, _vertices.data());
+    if (_format == VertexFormat::InstancedSegments) {
+        if (_segments.isDirty()) {
+            const auto &points = _segments.points();
+            uploadRanges(_vertex_buffer, points.data(), sizeof(LineSegmentPoint) * points.size(), _segments.dirtyRanges());
+            _segments.markClean();
+        }
+        return;
+    }
+    if (! _geometry.isDirty()) {
+        return;
+    }
 
-        const auto ib = sizeof(uint32_t) * _indices.size();
-        _index_buffer->ensureMinimumSize(ib);
-        _index_buffer->bufferSubData(0, ib, _indices.data());
+    if (_format == VertexFormat::Packed) {
+        bufferPackedVertices();
+    }
+    else {
+        bufferVertices();
+    }
+    const auto &indices = _geometry.indices();
+    uploadRanges(_index_buffer, indices.data(), sizeof(uint16_t) * indices.size(), _geometry.dirtyIndexRanges());
+
+    _geometry.markClean();
+}
 
-        _needs_buffering = false;
+void LineRenderer::bufferVertices()
+{
+    const auto &vertices = _geometry.vertices();
+    uploadRanges(_vertex_buffer, vertices.data(), sizeof(Vertex) * vertices.size(), _geometry.dirtyVertexRanges());
+}
+
+void LineRenderer::bufferPackedVertices()
+{
+    // batches whose geometry strayed from their origin come back whole, recentered
+    const auto ranges = _packed_vertices.update(_geometry.vertices(), _geometry.dirtyVertexRanges());
+    const auto &packed = _packed_vertices.vertices();
+    uploadRanges(_vertex_buffer, packed.data(), sizeof(PackedLineVertex) * packed.size(), ranges);
+}
+
+void LineRenderer::bufferCulledIndices()
+{
+    auto view_projection = LineMatrix();
+    const auto matrix = gl::getModelViewProjection();
+    std::memcpy(view_projection.m, &matrix, sizeof(LineMatrix));
+    _geometry.cull(view_projection);
+
+    // the visible set changes with the camera, so its indices are sent whole each frame
+    const auto &indices = _geometry.culledIndices();
+    const auto bytes = sizeof(uint16_t) * indices.size();
+    if (bytes > 0) {
+        uploadRanges(_culled_index_buffer, indices.data(), bytes, { LineByteRange{ 0, bytes } });
     }
 }
 
@@ -190,6 +393,36 @@ void LineRenderer::draw()
     bufferData();
 
     auto dims = vec2(gl::getViewport().second);
-    _batch->getGlslProg()->uniform("AspectRatio", dims.x / dims.y);
-    _batch->draw(0, _indices.size());
+    if (_format == VertexFormat::InstancedSegments) {
+        _batch->getGlslProg()->uniform("AspectRatio", dims.x / dims.y);
+        _batch->drawInstanced(static_cast<GLsizei>(_segments.instanceCount()));
+        return;
+    }
+
+    // upload before binding the vao, since uploading rebinds the element array buffer
+    if (_culling) {
+        bufferCulledIndices();
+    }
+    const auto &ranges = _culling ? _geometry.culledRanges() : _geometry.drawRanges();
+
+    const auto packed = _format == VertexFormat::Packed;
+    const auto &shader = packed ? _packed_shader : _batch->getGlslProg();
+    gl::ScopedVao vao(packed ? _packed_vao : _batch->getVao());
+    // the element array binding is vao state, so point it at the indices drawn this frame
+    (_culling ? _culled_index_buffer : _index_buffer)->bind();
+    gl::ScopedGlslProg scoped_shader(shader);
+    gl::setDefaultShaderVars();
+    shader->uniform("AspectRatio", dims.x / dims.y);
+    auto to_vec3 = [] (const LinePoint &p) { return vec3(p.x, p.y, p.z); };
+
+    // one call per batch of 16-bit indices
+    for (auto &range: ranges) {
+        if (packed) {
+            const auto batch = range.base_vertex / PackedLineBuffer::BatchStride;
+            shader->uniform("Origin", to_vec3(_packed_vertices.origin(batch)));
+            shader->uniform("NextOrigin", to_vec3(_packed_vertices.origin(batch + 1)));
+            shader->uniform("BatchEnd", static_cast<int>(range.base_vertex + PackedLineBuffer::BatchStride));
+        }
+        glDrawElementsBaseVertex(GL_TRIANGLES, static_cast<GLsizei>(range.index_count), GL_UNSIGNED_SHORT, reinterpret_cast<const GLvoid*>(range.index_offset * sizeof(uint16_t)), static_cast<GLint>(range.base_vertex));
+    }
 }
@@ -4,37 +4,84 @@
 
 #pragma once
 
+#include "LineGeometry.h"
+#include "PackedLineGeometry.h"
+#include "LineSegments.h"
+#include "LineSimplify.h"
+
 namespace pockets
 {
 
 ///
 /// Draws 3d lines expanded to a constant thickness in screen-space.
 /// Must be drawn with a perspective view matrix to behave properly.
+/// Geometry is built by a LineGeometryBuilder, either internally through addLine
+/// or on another thread and handed over with setGeometry.
+/// Lines can be updated and removed individually; each draw uploads only the byte ranges that changed.
+/// Buffers grow as needed; indices are 16 bits, drawn with one call per batch of vertices.
+///
+/// VertexFormat::Packed uploads PackedLineVertex instead of LineVertex, cutting vertex memory by 60%.
+/// Positions keep 11 significant bits relative to the center of each draw batch, which suits
+/// batches of moderate extent; large worlds should stay with VertexFormat::Float. See PackedLineBuffer.
+///
+/// VertexFormat::InstancedSegments stores each point once in a LineSegmentBuilder and draws
+/// one instance per segment, with no index buffer. It draws the same triangles as the other formats.
+///
+/// With culling on, the Float and Packed formats test each line's bounds against the current
+/// model-view-projection before drawing, and upload only the indices of the lines that may be visible.
+/// Vertices stay resident, so panning across a large scene costs no vertex uploads.
 ///
 class LineRenderer {
 public:
-    struct Vertex {
-        ci::vec3 position;
-        ci::vec3 previous;
-        ci::vec3 next;
-        ci::ColorA color;
-        float offset; // signed half-width
-        int mitered;
-    };
-
-    LineRenderer();
+    using Vertex = LineVertex;
+    enum class VertexFormat { Float, Packed, InstancedSegments };
+
+    explicit LineRenderer(VertexFormat format = VertexFormat::Float);
     void clear();
-    void addLine(const std::vector<ci::vec3> &positions, float width, const ci::ColorA &frontColor, const ci::ColorA &backColor, bool mitered);
+    LineHandle addLine(const std::vector<ci::vec3> &positions, float width, const ci::ColorA &frontColor, const ci::ColorA &backColor, bool mitered);
+    /// Replace the points of a line, keeping its style. Only the changed bytes are uploaded on the next draw.
+    bool updateLine(LineHandle line, const std::vector<ci::vec3> &positions);
+    bool removeLine(LineHandle line);
+    /// Add many lines at once, expanding them in parallel. See LineGeometryBuilder::addLines.
+    std::vector<LineHandle> addLines(span<const LinePolyline> lines, size_t thread_count = 0);
+    ///
+    /// Add many lines, first dropping the points that make no visible difference under \a simplification.
+    /// Dense traces then cost vertices in proportion to their size on screen. See LineSimplifier.
+    ///
+    std::vector<LineHandle> addLines(span<const LinePolyline> lines, const LineSimplification &simplification, size_t thread_count = 0);
+    /// Describe simplification to \a tolerance pixels for a camera's view-projection matrix and the current viewport.
+    static LineSimplification simplification(const ci::mat4 &view_projection, float tolerance);
+    /// View an array of positions as LinePoints, e.g. to describe a LinePolyline.
+    static span<const LinePoint> points(const std::vector<ci::vec3> &positions);
+    /// Replace everything drawn with geometry built elsewhere, e.g. on a worker thread.
+    void setGeometry(LineGeometryBuilder geometry);
+    const LineGeometryBuilder& geometry() const { return _geometry; }
+    /// As setGeometry, for VertexFormat::InstancedSegments.
+    void setSegments(LineSegmentBuilder segments);
+    const LineSegmentBuilder& segments() const { return _segments; }
+    /// Skip lines outside the view frustum on the CPU. Ignored by VertexFormat::InstancedSegments.
+    void setCulling(bool enabled) { _culling = enabled; }
+    bool isCulling() const { return _culling; }
     void draw();
 private:
+    VertexFormat            _format;
     ci::gl::VboRef          _vertex_buffer;
     ci::gl::VboRef          _index_buffer;
-    std::vector<uint32_t>   _indices;
-    std::vector<Vertex>     _vertices;
+    ci::gl::VboRef          _culled_index_buffer;
+    bool                    _culling = false;
+    LineGeometryBuilder     _geometry;
+    LineSegmentBuilder      _segments;
     ci::gl::BatchRef        _batch;
 
-    bool _needs_buffering = true;
+    // VertexFormat::Packed: Cinder's buffer layouts have no half float type, so the attributes are bound by hand
+    ci::gl::VaoRef                  _packed_vao;
+    ci::gl::GlslProgRef             _packed_shader;
+    PackedLineBuffer                _packed_vertices;
+
     void bufferData();
+    void bufferVertices();
+    void bufferPackedVertices();
+    void bufferCulledIndices();
 };
 
 } // namespace pockets
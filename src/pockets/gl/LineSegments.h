@@ -0,0 +1,302 @@
+//
+//  LineSegments.h
+//
+
+#pragma once
+
+#include "pockets/gl/LineGeometry.h"
+
+namespace pockets
+{
+
+///
+/// One point of a line in the instanced segment layout.
+/// Each point is stored once, where LineGeometryBuilder writes it into two vertices
+/// that also carry copies of both neighbors.
+///
+struct LineSegmentPoint {
+    LinePoint position;
+    LineColor color;
+    float half_width; // zero marks the padding between lines
+    int32_t mitered;
+};
+
+///
+/// Lays lines out for instanced drawing: one instance per segment, with no index buffer.
+/// Instance k draws the segment from point k + 1 to point k + 2 as two triangles,
+/// and reads points k and k + 3 to shape its joins.
+///
+/// Each line is framed by zero-width copies of its endpoints. They stand in for the
+/// missing neighbors at either end, and collapse the instances that straddle two lines.
+/// The triangles drawn match LineGeometryBuilder's exactly; see expandInstance.
+///
+/// Lines are added, updated and removed through handles, with the same dirty range
+/// tracking and compaction as LineGeometryBuilder.
+///
+class LineSegmentBuilder {
+public:
+    /// Points stored for a line of \a line_points points, including its framing copies.
+    static size_t pointCount(size_t line_points) { return line_points > 0 ? line_points + 2 : 0; }
+
+    /// Write one line into \a points, which must hold pointCount(positions.size()) elements. \a ramp is as for LinePolyline.
+    static void build(span<const LinePoint> positions, const LineStyle &style, span<LineSegmentPoint> points, span<const float> ramp = span<const float>());
+    ///
+    /// Write the six corners drawn by \a instance into \a corners, in the order LineGeometryBuilder
+    /// indexes its vertices. Mirrors the vertex shader, so the instanced path can be checked on the CPU.
+    /// Returns false if the instance straddles two lines and so collapses to nothing.
+    ///
+    static bool expandInstance(span<const LineSegmentPoint> points, size_t instance, LineVertex *corners);
+
+    LineHandle addLine(span<const LinePoint> positions, const LineStyle &style);
+    /// Append many lines at once, sized exactly and built in parallel. Returns a handle for each line, in order.
+    std::vector<LineHandle> addLines(span<const LinePolyline> lines, size_t thread_count = 0);
+    /// Replace the points of a line, keeping its style. Returns false if \a line is stale.
+    bool updateLine(LineHandle line, span<const LinePoint> positions);
+    /// Remove a line. Returns false if \a line is stale.
+    bool removeLine(LineHandle line);
+    bool contains(LineHandle line) const { return _lines.contains(line); }
+    size_t lineCount() const { return _lines.size(); }
+
+    void clear();
+    void reserve(size_t point_count, size_t line_count);
+    /// Pack live lines together, in their original order. Marks everything dirty.
+    void compact();
+
+    const std::vector<LineSegmentPoint>& points() const { return _points; }
+    /// Instances to draw, each of six vertices.
+    size_t instanceCount() const { return _points.size() > 3 ? _points.size() - 3 : 0; }
+
+    std::vector<LineByteRange> dirtyRanges(size_t merge_gap = 4096) const { return _dirty.bytes(_points.size(), sizeof(LineSegmentPoint), merge_gap); }
+    bool isDirty() const { return ! _dirty.empty(); }
+    void markClean() { _dirty.clear(); }
+    void markAllDirty() { _dirty.markAll(); }
+
+private:
+    struct Line {
+        size_t offset = 0;
+        size_t capacity = 0;
+        size_t point_count = 0;
+        LineStyle style;
+    };
+
+    Line makeLine(size_t point_count, const LineStyle &style);
+    void buildLine(const Line &line, span<const LinePoint> positions, span<const float> ramp = span<const float>());
+    /// Zero the widths of a line's points from \a from on, so instances reading them draw nothing.
+    void retirePoints(const Line &line, size_t from);
+    void compactIfWasteful();
+
+    std::vector<LineSegmentPoint> _points;
+    slot_map<Line> _lines;
+    size_t _live_points = 0;
+    LineDirtyRanges _dirty;
+};
+
+inline void LineSegmentBuilder::build(span<const LinePoint> positions, const LineStyle &style, span<LineSegmentPoint> points, span<const float> ramp)
+{
+    const auto count = positions.size();
+    assert(points.size() == pointCount(count));
+    if (count == 0) {
+        return;
+    }
+
+    const auto mitered = style.mitered ? 1 : 0;
+    const auto half_width = style.width / 2.0f;
+    const auto colors = LineColorRamp(style, count, ramp);
+    auto *out = points.data() + 1;
+    for (size_t i = 0; i < count; i += 1) {
+        out[i] = LineSegmentPoint{ positions[i], colors.at(i), half_width, mitered };
+    }
+    points[0] = LineSegmentPoint{ positions[0], colors.at(0), 0.0f, mitered };
+    points[count + 1] = LineSegmentPoint{ positions[count - 1], colors.at(count - 1), 0.0f, mitered };
+}
+
+inline bool LineSegmentBuilder::expandInstance(span<const LineSegmentPoint> points, size_t instance, LineVertex *corners)
+{
+    assert(instance + 3 < points.size());
+    const auto &previous = points[instance];
+    const auto &a = points[instance + 1];
+    const auto &b = points[instance + 2];
+    const auto &next = points[instance + 3];
+    const auto live = a.half_width != 0.0f && b.half_width != 0.0f;
+
+    const auto at_a = LineVertex{ a.position, previous.position, b.position, a.color, live ? a.half_width : 0.0f, a.mitered };
+    const auto at_b = LineVertex{ b.position, a.position, next.position, b.color, live ? b.half_width : 0.0f, a.mitered };
+    auto flip = [] (LineVertex v) {
+        v.offset = -v.offset;
+        return v;
+    };
+    corners[0] = at_a;
+    corners[1] = flip(at_a);
+    corners[2] = at_b;
+    corners[3] = at_b;
+    corners[4] = flip(at_a);
+    corners[5] = flip(at_b);
+    return live;
+}
+
+inline auto LineSegmentBuilder::makeLine(size_t point_count, const LineStyle &style) -> Line
+{
+    auto line = Line();
+    line.offset = _points.size();
+    line.capacity = pointCount(point_count);
+    line.point_count = point_count;
+    line.style = style;
+
+    _points.resize(line.offset + line.capacity);
+    _dirty.mark(line.offset, _points.size());
+    _live_points += line.capacity;
+    return line;
+}
+
+inline void LineSegmentBuilder::buildLine(const Line &line, span<const LinePoint> positions, span<const float> ramp)
+{
+    build(positions, line.style, span<LineSegmentPoint>(_points).subspan(line.offset, pointCount(positions.size())), ramp);
+}
+
+inline LineHandle LineSegmentBuilder::addLine(span<const LinePoint> positions, const LineStyle &style)
+{
+    const auto line = makeLine(positions.size(), style);
+    buildLine(line, positions);
+    return _lines.insert(line);
+}
+
+inline std::vector<LineHandle> LineSegmentBuilder::addLines(span<const LinePolyline> lines, size_t thread_count)
+{
+    auto records = std::vector<Line>();
+    auto handles = std::vector<LineHandle>();
+    records.reserve(lines.size());
+    handles.reserve(lines.size());
+    const auto begin = _points.size();
+    auto end = begin;
+    for (auto &l: lines) {
+        auto line = Line();
+        line.offset = end;
+        line.capacity = pointCount(l.positions.size());
+        line.point_count = l.positions.size();
+        line.style = l.style;
+        end += line.capacity;
+        records.push_back(line);
+        handles.push_back(_lines.insert(line));
+    }
+    _dirty.mark(begin, end);
+    _live_points += end - begin;
+    _points.resize(end);
+
+    // split by point count rather than line count, so a few long lines don't leave threads idle
+    const auto chunks = std::min(resolve_thread_count(thread_count), lines.size());
+    auto line_at = [&] (size_t chunk) {
+        const auto target = begin + (end - begin) * chunk / std::max<size_t>(1, chunks);
+        return static_cast<size_t>(std::lower_bound(records.begin(), records.end(), target, [] (const Line &line, size_t p) { return line.offset < p; }) - records.begin());
+    };
+
+    parallel_for_chunks(chunks, chunks, [&] (size_t begin_chunk, size_t end_chunk, size_t) {
+        const auto last = end_chunk == chunks ? lines.size() : line_at(end_chunk);
+        for (auto i = line_at(begin_chunk); i < last; i += 1) {
+            buildLine(records[i], lines[i].positions, lines[i].ramp);
+        }
+    });
+
+    return handles;
+}
+
+inline bool LineSegmentBuilder::updateLine(LineHandle handle, span<const LinePoint> positions)
+{
+    auto *line = _lines.get(handle);
+    if (! line) {
+        return false;
+    }
+
+    const auto points = pointCount(positions.size());
+    _live_points = _live_points - pointCount(line->point_count) + points;
+    if (points <= line->capacity) {
+        const auto previous_points = pointCount(line->point_count);
+        line->point_count = positions.size();
+        buildLine(*line, positions);
+        _dirty.mark(line->offset, line->offset + points);
+        if (previous_points > points) {
+            retirePoints(*line, points);
+        }
+    }
+    else {
+        retirePoints(*line, 0);
+        _live_points -= points;
+        const auto style = line->style;
+        *line = makeLine(positions.size(), style);
+        buildLine(*line, positions);
+    }
+
+    compactIfWasteful();
+    return true;
+}
+
+inline bool LineSegmentBuilder::removeLine(LineHandle handle)
+{
+    auto *line = _lines.get(handle);
+    if (! line) {
+        return false;
+    }
+
+    retirePoints(*line, 0);
+    _live_points -= pointCount(line->point_count);
+    _lines.erase(handle);
+
+    compactIfWasteful();
+    return true;
+}
+
+inline void LineSegmentBuilder::retirePoints(const Line &line, size_t from)
+{
+    for (auto i = line.offset + from; i < line.offset + line.capacity; i += 1) {
+        _points[i].half_width = 0.0f;
+    }
+    _dirty.mark(line.offset + from, line.offset + line.capacity);
+}
+
+inline void LineSegmentBuilder::compactIfWasteful()
+{
+    const auto wasted = _points.size() - _live_points;
+    if (wasted > 4096 && wasted > _live_points) {
+        compact();
+    }
+}
+
+inline void LineSegmentBuilder::compact()
+{
+    // keep draw order by walking lines in their current order in the array
+    auto order = std::vector<size_t>(_lines.size());
+    for (size_t i = 0; i < order.size(); i += 1) {
+        order[i] = i;
+    }
+    const auto *lines = _lines.data();
+    std::sort(order.begin(), order.end(), [lines] (size_t a, size_t b) { return lines[a].offset < lines[b].offset; });
+
+    auto points = std::vector<LineSegmentPoint>();
+    points.reserve(_live_points);
+    for (auto i: order) {
+        auto &line = _lines.data()[i];
+        const auto count = pointCount(line.point_count);
+        const auto new_offset = points.size();
+        points.insert(points.end(), _points.begin() + line.offset, _points.begin() + line.offset + count);
+        line.offset = new_offset;
+        line.capacity = count;
+    }
+
+    std::swap(points, _points);
+    markAllDirty();
+}
+
+inline void LineSegmentBuilder::clear()
+{
+    _points.clear();
+    _lines.clear();
+    _live_points = 0;
+    markAllDirty();
+}
+
+inline void LineSegmentBuilder::reserve(size_t point_count, size_t line_count)
+{
+    _points.reserve(point_count + 2 * line_count);
+    _lines.reserve(line_count);
+}
+
+} // namespace pockets
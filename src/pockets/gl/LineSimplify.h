@@ -0,0 +1,236 @@
+//
+//  LineSimplify.h
+//
+
+#pragma once
+
+#include "pockets/gl/LineGeometry.h"
+#include <cmath>
+#include <limits>
+
+namespace pockets
+{
+
+///
+/// How far lines may be simplified: \a tolerance pixels, once projected by \a view_projection
+/// into a viewport of \a viewport_width by \a viewport_height pixels.
+///
+struct LineSimplification {
+    LineMatrix view_projection = LineMatrix::identity();
+    float viewport_width = 1.0f;
+    float viewport_height = 1.0f;
+    float tolerance = 1.0f;
+};
+
+///
+/// Simplified copies of a list of lines. \a lines view \a points, ready for LineGeometryBuilder::addLines,
+/// and \a ramps, which hold where each kept point sat along its line's color ramp so its color doesn't shift.
+/// Moving keeps the views valid; a copy's views still point into the original.
+///
+struct SimplifiedLines {
+    std::vector<std::vector<LinePoint>> points;
+    std::vector<std::vector<float>> ramps;
+    std::vector<LinePolyline> lines;
+};
+
+///
+/// Drops points that make no visible difference on screen, before lines are expanded.
+/// A radial pass first drops points within tolerance of the last point kept, which cheaply
+/// thins dense traces (GPS or sensor logs, where many samples land on one pixel). Douglas–Peucker
+/// then drops points within tolerance of the line through their neighbors. Endpoints are always kept,
+/// as are points behind the camera, which have no screen position, and their neighbors.
+///
+/// Simplification depends on the view, so rerun it when the camera moves enough to matter.
+///
+class LineSimplifier {
+public:
+    explicit LineSimplifier(const LineSimplification &settings)
+    : _settings(settings)
+    {}
+
+    /// Append the points of \a positions that survive simplification to \a out.
+    void simplify(span<const LinePoint> positions, std::vector<LinePoint> &out) const;
+    /// Replace the contents of \a out with the indices of the points of \a positions that survive simplification, in order.
+    void simplifiedIndices(span<const LinePoint> positions, std::vector<uint32_t> &out) const;
+    ///
+    /// Simplify many lines in parallel chunks of roughly equal point counts.
+    /// Styles are carried over, and each kept point keeps its place on the color ramp.
+    /// The result is the same for any \a thread_count.
+    ///
+    SimplifiedLines simplify(span<const LinePolyline> lines, size_t thread_count = 0) const;
+
+private:
+    struct ScreenPoint {
+        float x, y;
+        bool visible; // false for points at or behind the camera plane
+    };
+
+    ScreenPoint project(const LinePoint &p) const;
+    static float segmentDistanceSquared(const ScreenPoint &p, const ScreenPoint &a, const ScreenPoint &b);
+
+    LineSimplification _settings;
+};
+
+inline auto LineSimplifier::project(const LinePoint &p) const -> ScreenPoint
+{
+    const auto *m = _settings.view_projection.m;
+    const auto x = m[0] * p.x + m[4] * p.y + m[8] * p.z + m[12];
+    const auto y = m[1] * p.x + m[5] * p.y + m[9] * p.z + m[13];
+    const auto w = m[3] * p.x + m[7] * p.y + m[11] * p.z + m[15];
+    if (w <= std::numeric_limits<float>::epsilon()) {
+        return ScreenPoint{ 0.0f, 0.0f, false };
+    }
+    return ScreenPoint{ (x / w * 0.5f + 0.5f) * _settings.viewport_width, (y / w * 0.5f + 0.5f) * _settings.viewport_height, true };
+}
+
+inline float LineSimplifier::segmentDistanceSquared(const ScreenPoint &p, const ScreenPoint &a, const ScreenPoint &b)
+{
+    const auto dx = b.x - a.x;
+    const auto dy = b.y - a.y;
+    const auto length_squared = dx * dx + dy * dy;
+    auto t = 0.0f;
+    if (length_squared > 0.0f) {
+        t = std::min(std::max(((p.x - a.x) * dx + (p.y - a.y) * dy) / length_squared, 0.0f), 1.0f);
+    }
+    const auto ex = a.x + dx * t - p.x;
+    const auto ey = a.y + dy * t - p.y;
+    return ex * ex + ey * ey;
+}
+
+inline void LineSimplifier::simplify(span<const LinePoint> positions, std::vector<LinePoint> &out) const
+{
+    auto kept = std::vector<uint32_t>();
+    simplifiedIndices(positions, kept);
+    for (auto i: kept) {
+        out.push_back(positions[i]);
+    }
+}
+
+inline void LineSimplifier::simplifiedIndices(span<const LinePoint> positions, std::vector<uint32_t> &out) const
+{
+    const auto count = positions.size();
+    out.clear();
+    if (count <= 2) {
+        for (size_t i = 0; i < count; i += 1) {
+            out.push_back(static_cast<uint32_t>(i));
+        }
+        return;
+    }
+    const auto tolerance_squared = _settings.tolerance * _settings.tolerance;
+
+    auto projected = std::vector<ScreenPoint>(count);
+    for (size_t i = 0; i < count; i += 1) {
+        projected[i] = project(positions[i]);
+    }
+
+    // radial pass: keep indices of points that moved at least a tolerance on screen,
+    // and the neighbors of points without a screen position, whose segments can't be judged
+    auto kept = std::vector<uint32_t>();
+    auto screen = std::vector<ScreenPoint>();
+    kept.push_back(0);
+    screen.push_back(projected[0]);
+    for (size_t i = 1; i + 1 < count; i += 1) {
+        const auto &p = projected[i];
+        const auto &last = screen.back();
+        const auto dx = p.x - last.x;
+        const auto dy = p.y - last.y;
+        if (! p.visible || ! last.visible || ! projected[i + 1].visible || dx * dx + dy * dy > tolerance_squared) {
+            kept.push_back(static_cast<uint32_t>(i));
+            screen.push_back(p);
+        }
+    }
+    kept.push_back(static_cast<uint32_t>(count - 1));
+    screen.push_back(projected[count - 1]);
+
+    // Points without a screen position can't be judged, so they and their neighbors are kept, splitting the line
+    // in one pass. Douglas–Peucker then runs between consecutive kept points, where every point is visible.
+    auto keep = std::vector<uint8_t>(kept.size(), 0);
+    keep.front() = 1;
+    keep.back() = 1;
+    for (size_t i = 0; i < screen.size(); i += 1) {
+        if (! screen[i].visible) {
+            keep[i] = 1;
+            keep[std::max<size_t>(i, 1) - 1] = 1;
+            keep[std::min(i + 1, screen.size() - 1)] = 1;
+        }
+    }
+    // an explicit stack, so long lines can't overflow the call stack
+    auto stack = std::vector<std::pair<size_t, size_t>>();
+    for (size_t first = 0, i = 1; i < keep.size(); i += 1) {
+        if (keep[i]) {
+            if (i > first + 1) {
+                stack.emplace_back(first, i);
+            }
+            first = i;
+        }
+    }
+    while (! stack.empty()) {
+        const auto first = stack.back().first;
+        const auto last = stack.back().second;
+        stack.pop_back();
+
+        auto farthest = first;
+        auto farthest_distance = tolerance_squared;
+        for (auto i = first + 1; i < last; i += 1) {
+            const auto distance = segmentDistanceSquared(screen[i], screen[first], screen[last]);
+            if (distance > farthest_distance) {
+                farthest = i;
+                farthest_distance = distance;
+            }
+        }
+        if (farthest != first) {
+            keep[farthest] = 1;
+            stack.emplace_back(first, farthest);
+            stack.emplace_back(farthest, last);
+        }
+    }
+
+    for (size_t i = 0; i < kept.size(); i += 1) {
+        if (keep[i]) {
+            out.push_back(kept[i]);
+        }
+    }
+}
+
+inline SimplifiedLines LineSimplifier::simplify(span<const LinePolyline> lines, size_t thread_count) const
+{
+    auto result = SimplifiedLines();
+    result.points.resize(lines.size());
+    result.ramps.resize(lines.size());
+
+    // split by point count rather than line count, so a few long traces don't leave threads idle
+    auto starts = std::vector<size_t>(lines.size() + 1, 0);
+    for (size_t i = 0; i < lines.size(); i += 1) {
+        starts[i + 1] = starts[i] + lines[i].positions.size();
+    }
+    const auto chunks = std::min(resolve_thread_count(thread_count), lines.size());
+    auto line_at = [&] (size_t chunk) {
+        const auto target = starts.back() * chunk / std::max<size_t>(1, chunks);
+        return static_cast<size_t>(std::lower_bound(starts.begin(), starts.end() - 1, target) - starts.begin());
+    };
+
+    parallel_for_chunks(chunks, chunks, [&] (size_t begin_chunk, size_t end_chunk, size_t) {
+        const auto end = end_chunk == chunks ? lines.size() : line_at(end_chunk);
+        auto kept = std::vector<uint32_t>();
+        for (auto i = line_at(begin_chunk); i < end; i += 1) {
+            const auto &line = lines[i];
+            simplifiedIndices(line.positions, kept);
+            auto &points = result.points[i];
+            auto &ramp = result.ramps[i];
+            points.reserve(kept.size());
+            ramp.reserve(kept.size());
+            for (auto k: kept) {
+                points.push_back(line.positions[k]);
+                ramp.push_back(line.ramp.empty() ? LineColorRamp::place(k, line.positions.size()) : line.ramp[k]);
+            }
+        }
+    });
+
+    result.lines.reserve(lines.size());
+    for (size_t i = 0; i < lines.size(); i += 1) {
+        result.lines.push_back(LinePolyline{ result.points[i], lines[i].style, result.ramps[i] });
+    }
+    return result;
+}
+
+} // namespace pockets
@@ -0,0 +1,239 @@
+//
+//  PackedLineGeometry.h
+//
+
+#pragma once
+
+#include "pockets/gl/LineGeometry.h"
+#include "pockets/HalfFloat.h"
+#include <cmath>
+
+namespace pockets
+{
+
+///
+/// Compact form of LineVertex: 24 bytes instead of 60.
+/// Positions are half floats relative to a per-batch origin (see PackedLineBuffer), and color is 8 bits per channel.
+///
+/// LineGeometryBuilder always puts the positive side of a line at even vertex indices,
+/// so the side is implied by the vertex index and the offset keeps only the half-width,
+/// a non-negative half float in the low 15 bits. The top bit is the miter flag, which shaders
+/// read as an integer rather than as a sign, so it survives a zero width.
+///
+/// Laid out so the GPU can read it as four 4-byte aligned attributes:
+/// position + offset (half4), previous + next.x (half4), next.yz (half2), and color (ubyte4).
+///
+struct PackedLineVertex {
+    uint16_t position[3];
+    uint16_t offset;
+    uint16_t previous[3];
+    uint16_t next[3];
+    uint8_t color[4];
+};
+
+static_assert(sizeof(PackedLineVertex) == 24, "PackedLineVertex must stay tightly packed.");
+
+///
+/// Center of the bounding box of \a vertices' positions, or zero if there are none.
+/// Using it as the origin halves the largest relative coordinate, and so the error, of packing.
+///
+inline LinePoint packingOrigin(span<const LineVertex> vertices)
+{
+    if (vertices.empty()) {
+        return LinePoint{ 0.0f, 0.0f, 0.0f };
+    }
+    auto low = vertices[0].position;
+    auto high = low;
+    for (auto &v: vertices) {
+        low = LinePoint{ std::min(low.x, v.position.x), std::min(low.y, v.position.y), std::min(low.z, v.position.z) };
+        high = LinePoint{ std::max(high.x, v.position.x), std::max(high.y, v.position.y), std::max(high.z, v.position.z) };
+    }
+    return LinePoint{ (low.x + high.x) * 0.5f, (low.y + high.y) * 0.5f, (low.z + high.z) * 0.5f };
+}
+
+///
+/// Encode one vertex. Each coordinate keeps 11 significant bits relative to \a origin,
+/// and must lie within 65504 of it; color channels are clamped to [0, 1] and rounded to 1/255.
+///
+inline PackedLineVertex packLineVertex(const LineVertex &vertex, const LinePoint &origin)
+{
+    auto packed = PackedLineVertex();
+    auto pack_point = [&origin] (const LinePoint &p, uint16_t *out) {
+        out[0] = float_to_half(p.x - origin.x);
+        out[1] = float_to_half(p.y - origin.y);
+        out[2] = float_to_half(p.z - origin.z);
+    };
+    auto pack_channel = [] (float c) {
+        return static_cast<uint8_t>(std::min(std::max(c, 0.0f), 1.0f) * 255.0f + 0.5f);
+    };
+
+    pack_point(vertex.position, packed.position);
+    pack_point(vertex.previous, packed.previous);
+    pack_point(vertex.next, packed.next);
+    packed.offset = float_to_half(std::abs(vertex.offset)) | (vertex.mitered ? 0x8000u : 0u);
+    packed.color[0] = pack_channel(vertex.color.r);
+    packed.color[1] = pack_channel(vertex.color.g);
+    packed.color[2] = pack_channel(vertex.color.b);
+    packed.color[3] = pack_channel(vertex.color.a);
+    return packed;
+}
+
+/// Encode \a vertices into \a out, which must be the same size.
+inline void packLineVertices(span<const LineVertex> vertices, const LinePoint &origin, span<PackedLineVertex> out)
+{
+    assert(vertices.size() == out.size());
+    for (size_t i = 0; i < vertices.size(); i += 1) {
+        out[i] = packLineVertex(vertices[i], origin);
+    }
+}
+
+///
+/// Largest distance along any axis from \a origin to a position, previous or next point of \a vertices.
+/// Coordinates are packed relative to the origin, so this must stay within HalfMax.
+///
+inline float packingExtent(span<const LineVertex> vertices, const LinePoint &origin)
+{
+    auto extent = 0.0f;
+    for (auto &v: vertices) {
+        for (auto *p: { &v.position, &v.previous, &v.next }) {
+            extent = std::max({ extent, std::abs(p->x - origin.x), std::abs(p->y - origin.y), std::abs(p->z - origin.z) });
+        }
+    }
+    return extent;
+}
+
+/// Decode the vertex stored at \a vertex_index; the index tells which side of the line it is on.
+inline LineVertex unpackLineVertex(const PackedLineVertex &packed, size_t vertex_index, const LinePoint &origin)
+{
+    auto unpack_point = [&origin] (const uint16_t *p) {
+        return LinePoint{ origin.x + half_to_float(p[0]), origin.y + half_to_float(p[1]), origin.z + half_to_float(p[2]) };
+    };
+    const auto half_width = half_to_float(packed.offset & 0x7FFFu);
+
+    auto vertex = LineVertex();
+    vertex.position = unpack_point(packed.position);
+    vertex.previous = unpack_point(packed.previous);
+    vertex.next = unpack_point(packed.next);
+    vertex.color = LineColor{ packed.color[0] / 255.0f, packed.color[1] / 255.0f, packed.color[2] / 255.0f, packed.color[3] / 255.0f };
+    vertex.offset = vertex_index % 2 == 0 ? half_width : -half_width;
+    vertex.mitered = (packed.offset & 0x8000u) ? 1 : 0;
+    return vertex;
+}
+
+///
+/// Packed copy of a LineGeometryBuilder's vertices, kept up to date from its dirty ranges.
+/// Each batch of BatchStride vertices is packed relative to its own origin, the center of the batch,
+/// so precision follows the extent of a batch rather than of the whole scene.
+/// Vertex k belongs to batch k / BatchStride. The last segment of a batch reads the first vertices
+/// of the next one, so a draw of batch b decodes those with origin(b + 1).
+///
+/// Partial updates reuse a batch's origin while the changed vertices stay within its reach,
+/// twice the batch's extent when it was last centered, and re-encode the whole batch around
+/// a new origin once they stray further. Geometry that moves far from where it started
+/// loses at most one bit of precision and never overflows, as long as each batch fits within HalfMax.
+///
+class PackedLineBuffer {
+public:
+    static const size_t BatchStride = LineGeometryBuilder::BatchStride;
+
+    ///
+    /// Encode the \a dirty byte ranges of \a vertices, as listed by LineGeometryBuilder::dirtyVertexRanges().
+    /// Returns the byte ranges of vertices() that changed, including any batch re-encoded around a new origin.
+    ///
+    std::vector<LineByteRange> update(span<const LineVertex> vertices, const std::vector<LineByteRange> &dirty);
+
+    const std::vector<PackedLineVertex>& vertices() const { return _vertices; }
+    size_t batchCount() const { return _batches.size(); }
+    /// Origin the vertices of \a batch are packed against; zero past the last batch.
+    LinePoint origin(size_t batch) const { return batch < _batches.size() ? _batches[batch].origin : LinePoint{ 0.0f, 0.0f, 0.0f }; }
+    /// Decode the vertex at \a index with its batch's origin.
+    LineVertex unpack(size_t index) const { return unpackLineVertex(_vertices[index], index, origin(index / BatchStride)); }
+
+private:
+    struct Batch {
+        LinePoint origin;
+        float reach;
+    };
+
+    bool withinReach(const LineVertex &vertex, const Batch &batch) const;
+    void recenter(span<const LineVertex> vertices, size_t batch);
+
+    std::vector<PackedLineVertex> _vertices;
+    std::vector<Batch> _batches;
+};
+
+inline bool PackedLineBuffer::withinReach(const LineVertex &vertex, const Batch &batch) const
+{
+    const auto &o = batch.origin;
+    for (auto *p: { &vertex.position, &vertex.previous, &vertex.next }) {
+        if (std::abs(p->x - o.x) > batch.reach || std::abs(p->y - o.y) > batch.reach || std::abs(p->z - o.z) > batch.reach) {
+            return false;
+        }
+    }
+    return true;
+}
+
+inline void PackedLineBuffer::recenter(span<const LineVertex> vertices, size_t batch)
+{
+    const auto first = batch * BatchStride;
+    const auto source = vertices.subspan(first, std::min(size_t(BatchStride), vertices.size() - first));
+    auto &b = _batches[batch];
+    b.origin = packingOrigin(source);
+    b.reach = std::min(2.0f * packingExtent(source, b.origin), HalfMax);
+    packLineVertices(source, b.origin, span<PackedLineVertex>(_vertices).subspan(first, source.size()));
+}
+
+inline std::vector<LineByteRange> PackedLineBuffer::update(span<const LineVertex> vertices, const std::vector<LineByteRange> &dirty)
+{
+    const auto batch_count = (vertices.size() + BatchStride - 1) / BatchStride;
+    // new batches have no origin yet, and re-encoding everything is a chance to recenter every batch
+    const auto everything = dirty.size() == 1 && dirty.front().size == sizeof(LineVertex) * vertices.size();
+    auto recentered = std::vector<uint8_t>(batch_count, everything ? 1 : 0);
+    for (auto b = std::min(_batches.size(), batch_count); b < batch_count; b += 1) {
+        recentered[b] = 1;
+    }
+    _vertices.resize(vertices.size());
+    _batches.resize(batch_count);
+
+    // encode in place against the current origins; a vertex out of reach marks its batch for recentering
+    for (auto &range: dirty) {
+        const auto end = (range.offset + range.size) / sizeof(LineVertex);
+        for (auto i = range.offset / sizeof(LineVertex); i < end; i += 1) {
+            const auto batch = i / BatchStride;
+            if (recentered[batch]) {
+                continue;
+            }
+            if (! withinReach(vertices[i], _batches[batch])) {
+                recentered[batch] = 1;
+                continue;
+            }
+            _vertices[i] = packLineVertex(vertices[i], _batches[batch].origin);
+        }
+    }
+
+    // changed bytes: dirty vertices of batches encoded in place, then recentered batches whole
+    auto changed = std::vector<LineByteRange>();
+    for (auto &range: dirty) {
+        auto i = range.offset / sizeof(LineVertex);
+        const auto end = (range.offset + range.size) / sizeof(LineVertex);
+        while (i < end) {
+            const auto batch = i / BatchStride;
+            const auto piece_end = std::min(end, (batch + 1) * BatchStride);
+            if (! recentered[batch]) {
+                changed.push_back(LineByteRange{ i * sizeof(PackedLineVertex), (piece_end - i) * sizeof(PackedLineVertex) });
+            }
+            i = piece_end;
+        }
+    }
+    for (size_t b = 0; b < batch_count; b += 1) {
+        if (recentered[b]) {
+            recenter(vertices, b);
+            const auto first = b * BatchStride;
+            const auto count = std::min(size_t(BatchStride), vertices.size() - first);
+            changed.push_back(LineByteRange{ first * sizeof(PackedLineVertex), count * sizeof(PackedLineVertex) });
+        }
+    }
+    return changed;
+}
+
+} // namespace pockets
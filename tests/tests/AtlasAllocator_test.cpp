@@ -0,0 +1,134 @@
+//
+//  AtlasAllocator_test.cpp
+//
+
+#include "catch.hpp"
+#include "pockets/AtlasAllocator.h"
+#include "pockets/WeightedSampling.h"
+
+using namespace pockets;
+using namespace std;
+
+namespace {
+
+bool overlap(const AtlasRect &a, const AtlasRect &b)
+{
+  return a.x < b.x + b.width && b.x < a.x + a.width && a.y < b.y + b.height && b.y < a.y + a.height;
+}
+
+/// True if every live allocation lies inside the atlas, no two overlap, and the free area adds up.
+bool consistent(const AtlasAllocator &atlas, const vector<AtlasId> &ids)
+{
+  auto used = int64_t(0);
+  for (size_t i = 0; i < ids.size(); i += 1)
+  {
+    const auto a = atlas.rect(ids[i]);
+    if (a.x < 0 || a.y < 0 || a.x + a.width > atlas.width() || a.y + a.height > atlas.height()) {
+      return false;
+    }
+    for (size_t j = i + 1; j < ids.size(); j += 1)
+    {
+      if (overlap(a, atlas.rect(ids[j]))) {
+        return false;
+      }
+    }
+    used += a.area();
+  }
+  return used + atlas.freeArea() == int64_t(atlas.width()) * atlas.height();
+}
+
+} // namespace
+
+TEST_CASE("AtlasAllocator_test")
+{
+  SECTION("Freed space merges back into the rectangles it was cut from")
+  {
+    auto atlas = AtlasAllocator(16, 16);
+    auto ids = vector<AtlasId>();
+    for (auto i = 0; i < 4; i += 1) {
+      ids.push_back(atlas.allocate(8, 8));
+    }
+    REQUIRE(all_of(ids.begin(), ids.end(), [&] (AtlasId id) { return atlas.contains(id); }));
+    REQUIRE(consistent(atlas, ids));
+    REQUIRE(atlas.freeArea() == 0);
+    REQUIRE_FALSE(atlas.contains(atlas.allocate(1, 1)));
+
+    REQUIRE(atlas.free(ids[1]));
+    REQUIRE_FALSE(atlas.free(ids[1]));
+    REQUIRE(atlas.rect(ids[1]).area() == 0);
+    REQUIRE(atlas.largestFreeRect().area() == 64);
+
+    for (auto id: { ids[0], ids[2], ids[3] }) {
+      atlas.free(id);
+    }
+    REQUIRE(atlas.freeRectCount() == 1);
+    REQUIRE(atlas.largestFreeRect().area() == 256);
+    REQUIRE(atlas.contains(atlas.allocate(16, 16)));
+  }
+
+  SECTION("Allocations land in the tightest free rectangle")
+  {
+    auto atlas = AtlasAllocator(64, 64);
+    auto wide = atlas.allocate(64, 60);
+    auto small = atlas.allocate(10, 4);
+    REQUIRE(atlas.rect(wide).y == 0);
+    REQUIRE(atlas.rect(small).y == 60);
+    REQUIRE_THROWS(atlas.allocate(0, 4));
+    REQUIRE_THROWS(AtlasAllocator(0, 10));
+  }
+
+  SECTION("Defragmenting moves allocations into earlier free space a few at a time")
+  {
+    auto atlas = AtlasAllocator(512, 512);
+    auto ids = vector<AtlasId>();
+    for (auto i = 0; i < 2000; i += 1)
+    {
+      auto id = atlas.allocate(4 + int(counter_uniform(11, 0, i) * 24), 4 + int(counter_uniform(11, 1, i) * 24));
+      if (atlas.contains(id)) {
+        ids.push_back(id);
+      }
+    }
+    // free most of them, leaving scattered survivors
+    auto live = vector<AtlasId>();
+    for (size_t i = 0; i < ids.size(); i += 1)
+    {
+      if (counter_uniform(11, 2, i) < 0.7f) {
+        atlas.free(ids[i]);
+      }
+      else {
+        live.push_back(ids[i]);
+      }
+    }
+    const auto sizes = [&] {
+      auto result = vector<pair<int, int>>();
+      for (auto id: live) {
+        result.emplace_back(atlas.rect(id).width, atlas.rect(id).height);
+      }
+      return result;
+    }();
+    REQUIRE(consistent(atlas, live));
+    const auto largest_before = atlas.largestFreeRect().area();
+
+    auto frames = 0;
+    for (; frames < 1000; frames += 1)
+    {
+      auto moves = atlas.defragment(16);
+      REQUIRE(moves.size() <= 16);
+      if (moves.empty()) {
+        break;
+      }
+      for (auto &move: moves)
+      {
+        REQUIRE_FALSE(overlap(move.from, move.to));
+        REQUIRE((move.to.width == move.from.width && move.to.height == move.from.height));
+      }
+    }
+
+    REQUIRE(frames < 1000);
+    REQUIRE(consistent(atlas, live));
+    for (size_t i = 0; i < live.size(); i += 1) {
+      REQUIRE((atlas.rect(live[i]).width == sizes[i].first && atlas.rect(live[i]).height == sizes[i].second));
+    }
+    REQUIRE(atlas.largestFreeRect().area() > largest_before);
+  }
+}
@@ -0,0 +1,83 @@
+//
+//  Collections_test.cpp
+//
+
+#include "catch.hpp"
+#include "pockets/CollectionUtilities.hpp"
+#include <set>
+#include <unordered_set>
+
+using namespace pockets;
+using namespace std;
+
+TEST_CASE("Collections_test")
+{
+  auto collection = vector<int>{ 1, 2, 3, 4, 5, 6 };
+
+  SECTION("vector_remove removes all copies and preserves order")
+  {
+    auto copies = vector<int>{ 1, 2, 1, 3, 1 };
+    vector_remove(&copies, 1);
+
+    REQUIRE(copies == (vector<int>{ 2, 3 }));
+  }
+
+  SECTION("unordered_remove swaps the last element into the removed slot")
+  {
+    REQUIRE(unordered_remove(&collection, 2));
+    REQUIRE(collection == (vector<int>{ 1, 6, 3, 4, 5 }));
+
+    REQUIRE(unordered_remove(&collection, 5));
+    REQUIRE(collection == (vector<int>{ 1, 6, 3, 4 }));
+
+    REQUIRE_FALSE(unordered_remove(&collection, 10));
+    REQUIRE(collection.size() == 4);
+  }
+
+  SECTION("unordered_remove_at works on the only element")
+  {
+    auto single = vector<int>{ 7 };
+    unordered_remove_at(&single, 0);
+
+    REQUIRE(single.empty());
+  }
+
+  SECTION("remove_all_of removes a batch in one pass and preserves order")
+  {
+    remove_all_of(&collection, unordered_set<int>{ 2, 5, 10 });
+    REQUIRE(collection == (vector<int>{ 1, 3, 4, 6 }));
+
+    remove_all_of(&collection, set<int>{});
+    REQUIRE(collection == (vector<int>{ 1, 3, 4, 6 }));
+  }
+
+  SECTION("sorted_remove_all_of merges a sorted batch out of a sorted vector")
+  {
+    auto sorted = vector<int>{ 1, 2, 2, 3, 5, 8, 13 };
+    sorted_remove_all_of(&sorted, vector<int>{ 0, 2, 8, 21 });
+    REQUIRE(sorted == (vector<int>{ 1, 3, 5, 13 }));
+
+    auto descending = vector<int>{ 6, 5, 4, 3, 2, 1 };
+    sorted_remove_all_of(&descending, set<int, greater<int>>{ 6, 3, 1 }, greater<int>());
+    REQUIRE(descending == (vector<int>{ 5, 4, 2 }));
+  }
+
+  SECTION("sorted_remove_all_of sorts an unsorted batch first")
+  {
+    sorted_remove_all_of(&collection, vector<int>{ 6, 1, 4 });
+    REQUIRE(collection == (vector<int>{ 2, 3, 5 }));
+  }
+
+  SECTION("cancel_removal keeps an element removed and re-added before the flush listed once")
+  {
+    auto removals = unordered_set<int>{};
+    removals.insert(3);
+    REQUIRE(cancel_removal(&collection, &removals, 3));
+    collection.push_back(3);
+    REQUIRE_FALSE(cancel_removal(&collection, &removals, 4));
+    remove_all_of(&collection, removals);
+
+    REQUIRE(collection == (vector<int>{ 1, 2, 4, 5, 6, 3 }));
+    REQUIRE(removals.empty());
+  }
+}
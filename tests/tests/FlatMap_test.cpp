@@ -0,0 +1,239 @@
+//
+//  FlatMap_test.cpp
+//
+
+#include "catch.hpp"
+#include "pockets/FlatMap.h"
+#include "pockets/CollectionUtilities.hpp"
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+
+using namespace pockets;
+using namespace std;
+
+namespace {
+
+/// Returns the time in milliseconds taken to run \a fn.
+template <typename Fn>
+double time_ms(Fn &&fn)
+{
+  auto start = chrono::high_resolution_clock::now();
+  fn();
+  return chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+}
+
+} // namespace
+
+TEST_CASE("FlatMap_test")
+{
+  SECTION("Bulk construction sorts once and later duplicates win")
+  {
+    auto table = flat_map<string, int>({ { "c", 3 }, { "a", 1 }, { "b", 2 }, { "a", 10 } });
+
+    REQUIRE(table.size() == 3);
+    REQUIRE(table.at("a") == 10);
+    REQUIRE(table.begin()->first == "a");
+    REQUIRE((table.end() - 1)->first == "c");
+    REQUIRE(table.count("d") == 0);
+    REQUIRE_THROWS(table.at("d"));
+    REQUIRE(map_keys(table) == (vector<string>{ "a", "b", "c" }));
+  }
+
+  SECTION("Insertion and erasure keep keys sorted")
+  {
+    auto table = flat_map<int, string>();
+    table[5] = "five";
+    table[1] = "one";
+    REQUIRE_FALSE(table.insert({ 5, "FIVE" }).second);
+    REQUIRE(table.insert_or_assign(3, "three").second);
+    REQUIRE_FALSE(table.insert_or_assign(1, "uno").second);
+
+    REQUIRE(table.values() == (vector<pair<int, string>>{ { 1, "uno" }, { 3, "three" }, { 5, "five" } }));
+    REQUIRE(table.erase(3) == 1);
+    REQUIRE(table.erase(3) == 0);
+    REQUIRE(table.size() == 2);
+  }
+
+  SECTION("Iterators expose keys as const and values as writable")
+  {
+    auto table = flat_map<int, string>({ { 2, "two" }, { 1, "one" } });
+    static_assert(is_const<remove_reference_t<decltype(table.begin()->first)>>::value, "flat_map keys must not be writable through iterators.");
+    static_assert(is_const<remove_reference_t<decltype(table.cbegin()->second)>>::value, "const_iterator values must not be writable.");
+
+    table.begin()->second = "uno";
+    (*next(table.begin())).second += "!";
+    auto keys = vector<int>();
+    for (const auto &element: table) {
+      keys.push_back(element.first);
+    }
+    REQUIRE(keys == (vector<int>{ 1, 2 }));
+    REQUIRE(table.at(1) == "uno");
+    REQUIRE(table.at(2) == "two!");
+
+    flat_map<int, string>::const_iterator iter = table.find(2);
+    REQUIRE(iter != table.end());
+    REQUIRE(iter - table.begin() == 1);
+    auto copy = flat_map<int, string>(table.begin(), table.end());
+    REQUIRE(copy.values() == table.values());
+  }
+
+  SECTION("Elements bind by value, const reference, or forwarding reference")
+  {
+    using Table = flat_map<string, int>;
+    // dereferencing yields a proxy, not a reference, so the iterators don't claim to be forward iterators
+    static_assert(! is_reference<decltype(*declval<Table::iterator>())>::value, "flat_map iterators return a proxy.");
+    static_assert(is_same<iterator_traits<Table::iterator>::iterator_category, input_iterator_tag>::value, "Proxy iterators are input iterators.");
+    static_assert(is_same<iterator_traits<Table::const_iterator>::iterator_category, input_iterator_tag>::value, "Proxy iterators are input iterators.");
+
+    auto table = Table({ { "a", 1 }, { "b", 2 } });
+    for (auto &&element: table) {
+      element.second += 10;
+    }
+    for (auto element: table) {
+      element.second += 100;
+    }
+    auto sum = 0;
+    for (const auto &element: table) {
+      sum += element.second;
+    }
+    const auto &view = table;
+    for (auto &&element: view) {
+      static_assert(is_const<remove_reference_t<decltype(element.second)>>::value, "const maps yield const values.");
+      sum += element.second;
+    }
+    // copying a proxy copies references to the stored element
+    REQUIRE(sum == 2 * (11 + 12 + 200));
+    REQUIRE(table.at("a") == 111);
+
+    Table::value_type first = *table.begin();
+    REQUIRE((first == pair<string, int>("a", 111)));
+    REQUIRE(table.begin()[1].first == "b");
+    REQUIRE((vector<pair<string, int>>(table.begin(), table.end()) == table.values()));
+  }
+
+  SECTION("Eytzinger lookups agree with binary search at every size")
+  {
+    for (auto n = 0; n < 70; n += 1)
+    {
+      auto pairs = vector<pair<int, int>>();
+      for (auto i = 0; i < n; i += 1) {
+        pairs.emplace_back(i * 2, i);
+      }
+      auto table = flat_map<int, int>(pairs);
+      table.use_eytzinger_layout();
+
+      for (auto key = -1; key <= n * 2; key += 1)
+      {
+        auto iter = table.find(key);
+        if (key >= 0 && key % 2 == 0 && key < n * 2) {
+          REQUIRE(iter != table.end());
+          REQUIRE(iter->second == key / 2);
+        }
+        else {
+          REQUIRE(iter == table.end());
+        }
+      }
+    }
+  }
+
+  SECTION("Eytzinger index follows mutation")
+  {
+    auto table = flat_map<int, int>({ { 1, 1 }, { 2, 2 } });
+    table.use_eytzinger_layout();
+    table[0] = 0;
+    table.erase(2);
+
+    REQUIRE(table.at(0) == 0);
+    REQUIRE(table.at(1) == 1);
+    REQUIRE(table.count(2) == 0);
+  }
+
+  SECTION("flat_set keeps unique sorted keys")
+  {
+    auto set = flat_set<int>({ 4, 1, 4, 3 });
+
+    REQUIRE(set.size() == 3);
+    REQUIRE(*set.begin() == 1);
+    REQUIRE(set.count(4) == 1);
+    REQUIRE(set.insert(2).second);
+    REQUIRE_FALSE(set.insert(2).second);
+    REQUIRE(set.erase(1) == 1);
+    REQUIRE(vector<int>(set.begin(), set.end()) == (vector<int>{ 2, 3, 4 }));
+  }
+}
+
+TEST_CASE("FlatMap benchmarks", "[.benchmark]")
+{
+  SECTION("Lookup timing compared with std::map and std::unordered_map")
+  {
+    const auto key_count = 20000;
+    const auto lookup_count = 200000;
+
+    auto rng = mt19937(7);
+    auto pairs = vector<pair<string, int>>();
+    for (auto i = 0; i < key_count; i += 1) {
+      pairs.emplace_back("sprite-" + to_string(rng()), i);
+    }
+    auto queries = vector<string>();
+    for (auto i = 0; i < lookup_count; i += 1) {
+      queries.push_back(pairs[rng() % key_count].first);
+    }
+
+    auto ordered = map<string, int>(pairs.begin(), pairs.end());
+    auto hashed = unordered_map<string, int>(pairs.begin(), pairs.end());
+    auto flat = flat_map<string, int>(pairs);
+    auto eytzinger = flat;
+    eytzinger.use_eytzinger_layout();
+
+    auto sum = 0;
+    auto lookup = [&] (const auto &table) {
+      return time_ms([&] {
+        for (auto &q: queries) {
+          sum += table.find(q)->second;
+        }
+      });
+    };
+
+    cout << "Lookups of " << lookup_count << " keys among " << key_count << " (ms):" << endl;
+    cout << "  std::map            " << lookup(ordered) << endl;
+    cout << "  std::unordered_map  " << lookup(hashed) << endl;
+    cout << "  flat_map            " << lookup(flat) << endl;
+    cout << "  flat_map eytzinger  " << lookup(eytzinger) << endl;
+
+    auto int_pairs = vector<pair<uint32_t, int>>();
+    for (auto i = 0; i < key_count * 50; i += 1) {
+      int_pairs.emplace_back(rng(), i);
+    }
+    auto int_queries = vector<uint32_t>();
+    for (auto i = 0; i < lookup_count; i += 1) {
+      int_queries.push_back(int_pairs[rng() % int_pairs.size()].first);
+    }
+
+    auto int_ordered = map<uint32_t, int>(int_pairs.begin(), int_pairs.end());
+    auto int_hashed = unordered_map<uint32_t, int>(int_pairs.begin(), int_pairs.end());
+    auto int_flat = flat_map<uint32_t, int>(int_pairs);
+    auto int_eytzinger = int_flat;
+    int_eytzinger.use_eytzinger_layout();
+
+    auto int_lookup = [&] (const auto &table) {
+      return time_ms([&] {
+        for (auto &q: int_queries) {
+          sum += table.find(q)->second;
+        }
+      });
+    };
+
+    cout << "Lookups of " << lookup_count << " integer keys among " << int_pairs.size() << " (ms):" << endl;
+    cout << "  std::map            " << int_lookup(int_ordered) << endl;
+    cout << "  std::unordered_map  " << int_lookup(int_hashed) << endl;
+    cout << "  flat_map            " << int_lookup(int_flat) << endl;
+    cout << "  flat_map eytzinger  " << int_lookup(int_eytzinger) << endl;
+
+    REQUIRE(sum != 0);
+  }
+}
@@ -0,0 +1,886 @@
+//
+//  LineGeometry_test.cpp
+//
+
+#include "catch.hpp"
+#include "pockets/gl/LineGeometry.h"
+#include "pockets/gl/PackedLineGeometry.h"
+#include "pockets/gl/LineSegments.h"
+#include "pockets/gl/LineSimplify.h"
+#include "pockets/WeightedSampling.h"
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+using namespace pockets;
+using namespace std;
+
+namespace {
+
+vector<LinePoint> spiral(size_t count)
+{
+  auto points = vector<LinePoint>(count);
+  for (size_t i = 0; i < count; i += 1)
+  {
+    auto t = i * 0.01f;
+    points[i] = LinePoint{ cos(t) * t, sin(t) * t, t * 0.1f };
+  }
+  return points;
+}
+
+/// Every triangle corner drawn by \a ranges of \a indices into the builder's vertices.
+vector<LineVertex> drawnCorners(const LineGeometryBuilder &builder, const vector<uint16_t> &indices, const vector<LineDrawRange> &ranges)
+{
+  auto corners = vector<LineVertex>();
+  for (auto &range: ranges)
+  {
+    for (auto i = range.index_offset; i < range.index_offset + range.index_count; i += 3)
+    {
+      // skip triangles retired to a single vertex
+      if (indices[i] == indices[i + 1] && indices[i] == indices[i + 2]) {
+        continue;
+      }
+      for (auto j = i; j < i + 3; j += 1) {
+        corners.push_back(builder.vertices()[range.base_vertex + indices[j]]);
+      }
+    }
+  }
+  return corners;
+}
+
+/// Every triangle corner drawn, in draw order, as the indexed path expands it.
+vector<LineVertex> drawnCorners(const LineGeometryBuilder &builder)
+{
+  return drawnCorners(builder, builder.indices(), builder.drawRanges());
+}
+
+/// Every triangle corner drawn, in draw order, as the instanced path expands it.
+vector<LineVertex> drawnCorners(const LineSegmentBuilder &builder)
+{
+  auto corners = vector<LineVertex>();
+  LineVertex instance[6];
+  for (size_t i = 0; i < builder.instanceCount(); i += 1)
+  {
+    if (LineSegmentBuilder::expandInstance(builder.points(), i, instance)) {
+      corners.insert(corners.end(), instance, instance + 6);
+    }
+  }
+  return corners;
+}
+
+/// Random walk in the xy plane with steps of about \a step, like a noisy GPS trace.
+vector<LinePoint> trace(size_t count, float step, uint64_t seed)
+{
+  auto points = vector<LinePoint>(count);
+  auto p = LinePoint{ 0, 0, 0 };
+  for (size_t i = 0; i < count; i += 1)
+  {
+    p.x += step * (counter_uniform(seed, 0, i) - 0.3f);
+    p.y += step * (counter_uniform(seed, 1, i) - 0.5f);
+    points[i] = p;
+  }
+  return points;
+}
+
+/// Orthographic projection scaling x and y by \a scale; one unit covers scale * 500 pixels of a 1000 pixel viewport.
+LineSimplification orthographic(float scale, float tolerance)
+{
+  auto settings = LineSimplification();
+  settings.view_projection.m[0] = scale;
+  settings.view_projection.m[5] = scale;
+  settings.viewport_width = 1000.0f;
+  settings.viewport_height = 1000.0f;
+  settings.tolerance = tolerance;
+  return settings;
+}
+
+bool sameCorners(const vector<LineVertex> &a, const vector<LineVertex> &b)
+{
+  return a.size() == b.size() && memcmp(a.data(), b.data(), a.size() * sizeof(LineVertex)) == 0;
+}
+
+/// Mitered red-to-blue lines four units wide.
+LineStyle testStyle()
+{
+  auto style = LineStyle();
+  style.width = 4.0f;
+  style.front_color = LineColor{ 1.0f, 0.0f, 0.0f, 1.0f };
+  style.back_color = LineColor{ 0.0f, 0.0f, 1.0f, 0.0f };
+  style.mitered = true;
+  return style;
+}
+
+} // namespace
+
+TEST_CASE("LineGeometry_test")
+{
+  const auto style = testStyle();
+
+  SECTION("Each point expands to a pair of vertices joined by two triangles")
+  {
+    auto points = vector<LinePoint>{ { 0, 0, 0 }, { 1, 0, 0 }, { 1, 1, 0 } };
+    auto builder = LineGeometryBuilder();
+    builder.addLine(points, style);
+
+    auto &v = builder.vertices();
+    REQUIRE(v.size() == 6);
+    REQUIRE(builder.indices() == (vector<uint16_t>{ 0, 1, 2, 2, 1, 3, 2, 3, 4, 4, 3, 5 }));
+
+    // endpoints are their own missing neighbor
+    REQUIRE(v[0].previous == points[0]);
+    REQUIRE(v[0].next == points[1]);
+    REQUIRE(v[5].previous == points[1]);
+    REQUIRE(v[5].next == points[2]);
+
+    REQUIRE(v[0].offset == 2.0f);
+    REQUIRE(v[1].offset == -2.0f);
+    REQUIRE(v[1].mitered == 1);
+    REQUIRE(v[0].color.r == 1.0f);
+    REQUIRE(v[2].color.r == Approx(2.0f / 3.0f));
+    REQUIRE(v[4].color.b == Approx(2.0f / 3.0f));
+  }
+
+  SECTION("Later lines index their own vertices")
+  {
+    auto builder = LineGeometryBuilder();
+    builder.addLine(vector<LinePoint>{ { 0, 0, 0 }, { 1, 0, 0 } }, style);
+    builder.addLine(vector<LinePoint>{ { 0, 1, 0 }, { 1, 1, 0 } }, style);
+    builder.addLine(vector<LinePoint>{}, style);
+    builder.addLine(vector<LinePoint>{ { 5, 5, 5 } }, style);
+
+    REQUIRE(builder.vertices().size() == 10);
+    REQUIRE(builder.indices() == (vector<uint16_t>{ 0, 1, 2, 2, 1, 3, 4, 5, 6, 6, 5, 7 }));
+  }
+
+  SECTION("Lines can be built into caller-owned memory")
+  {
+    auto points = spiral(100);
+    auto vertices = vector<LineVertex>(LineGeometryBuilder::vertexCount(points.size()));
+    auto indices = vector<uint32_t>(LineGeometryBuilder::indexCount(points.size()));
+    LineGeometryBuilder::build(points, style, 1000, vertices, indices);
+
+    auto builder = LineGeometryBuilder();
+    builder.addLine(points, style);
+    REQUIRE(indices.front() == 1000);
+    REQUIRE(indices.back() == 1000 + builder.indices().back());
+    REQUIRE(memcmp(vertices.data(), builder.vertices().data(), vertices.size() * sizeof(LineVertex)) == 0);
+  }
+
+  SECTION("Half floats round to nearest even and round trip exactly")
+  {
+    REQUIRE(float_to_half(1.0f) == 0x3C00);
+    REQUIRE(float_to_half(-2.0f) == 0xC000);
+    REQUIRE(float_to_half(65504.0f) == 0x7BFF);
+    REQUIRE(float_to_half(65520.0f) == 0x7C00);
+    REQUIRE(float_to_half(ldexp(1.0f, -24)) == 0x0001);
+    REQUIRE(float_to_half(1e-9f) == 0x0000);
+    // halfway cases go to the even neighbor
+    REQUIRE(float_to_half(1.0f + ldexp(1.0f, -11)) == 0x3C00);
+    REQUIRE(float_to_half(1.0f + 3.0f * ldexp(1.0f, -11)) == 0x3C02);
+    REQUIRE(std::isnan(half_to_float(float_to_half(NAN))));
+
+    for (uint32_t h = 0; h < 0x10000; h += 1)
+    {
+      const auto half = static_cast<uint16_t>(h);
+      if ((half & 0x7C00) == 0x7C00 && (half & 0x03FF) != 0) {
+        continue; // NaN payloads
+      }
+      REQUIRE(float_to_half(half_to_float(half)) == half);
+    }
+  }
+
+  SECTION("Packed vertices decode to within half precision of the originals")
+  {
+    auto builder = LineGeometryBuilder();
+    auto plain = style;
+    plain.mitered = false;
+    plain.width = 7.5f;
+    auto far_away = spiral(500);
+    for (auto &p: far_away) {
+      p = LinePoint{ p.x * 20.0f + 1000.0f, p.y * 20.0f - 3000.0f, p.z };
+    }
+    builder.addLine(far_away, style);
+    builder.addLine(spiral(301), plain);
+
+    auto &vertices = builder.vertices();
+    const auto origin = packingOrigin(vertices);
+    auto packed = vector<PackedLineVertex>(vertices.size());
+    packLineVertices(vertices, origin, packed);
+
+    // the largest coordinate relative to the origin bounds the error of every coordinate
+    auto extent = 0.0f;
+    for (auto &v: vertices) {
+      extent = max({ extent, abs(v.position.x - origin.x), abs(v.position.y - origin.y), abs(v.position.z - origin.z) });
+    }
+    const auto tolerance = extent * ldexp(1.0f, -11);
+    auto worst = 0.0f;
+    for (size_t i = 0; i < vertices.size(); i += 1)
+    {
+      auto &a = vertices[i];
+      auto b = unpackLineVertex(packed[i], i, origin);
+      for (auto pair: { make_pair(a.position, b.position), make_pair(a.previous, b.previous), make_pair(a.next, b.next) }) {
+        worst = max({ worst, abs(pair.first.x - pair.second.x), abs(pair.first.y - pair.second.y), abs(pair.first.z - pair.second.z) });
+      }
+      REQUIRE(b.offset == a.offset);
+      REQUIRE(b.mitered == a.mitered);
+      // rounded to the nearest 1/255, give or take float error
+      REQUIRE(abs(b.color.r - a.color.r) <= 0.5f / 255.0f + 1e-6f);
+      REQUIRE(abs(b.color.b - a.color.b) <= 0.5f / 255.0f + 1e-6f);
+      REQUIRE(abs(b.color.a - a.color.a) <= 0.5f / 255.0f + 1e-6f);
+    }
+    REQUIRE(worst <= tolerance);
+  }
+
+  SECTION("Packed vertices take less than half the space")
+  {
+    const auto bytes_per_point = LineGeometryBuilder::vertexCount(1) * sizeof(LineVertex);
+    const auto packed_bytes_per_point = LineGeometryBuilder::vertexCount(1) * sizeof(PackedLineVertex);
+    REQUIRE(bytes_per_point == 120);
+    REQUIRE(packed_bytes_per_point == 48);
+  }
+
+  SECTION("Packed batches keep their own origins through partial updates")
+  {
+    // two clusters too far apart to share an origin, each filling its own batch
+    auto shifted = [] (vector<LinePoint> points, float dx) {
+      for (auto &p: points) {
+        p.x += dx;
+      }
+      return points;
+    };
+    const auto points_per_batch = PackedLineBuffer::BatchStride / 2;
+    auto builder = LineGeometryBuilder();
+    builder.addLine(shifted(spiral(points_per_batch), 100000.0f), style);
+    auto second = builder.addLine(shifted(spiral(1000), -100000.0f), style);
+    auto buffer = PackedLineBuffer();
+
+    auto decodes_within_precision = [&] {
+      auto &vertices = builder.vertices();
+      for (size_t b = 0; b < buffer.batchCount(); b += 1) {
+        const auto first = b * PackedLineBuffer::BatchStride;
+        const auto batch = span<const LineVertex>(vertices).subspan(first, min(size_t(PackedLineBuffer::BatchStride), vertices.size() - first));
+        const auto tolerance = packingExtent(batch, buffer.origin(b)) * ldexp(1.0f, -11);
+        for (size_t i = 0; i < batch.size(); i += 1) {
+          const auto &a = batch[i];
+          const auto decoded = buffer.unpack(first + i);
+          if (abs(decoded.position.x - a.position.x) > tolerance || abs(decoded.position.y - a.position.y) > tolerance || decoded.mitered != a.mitered) {
+            return false;
+          }
+        }
+      }
+      return true;
+    };
+
+    auto ranges = buffer.update(builder.vertices(), builder.dirtyVertexRanges());
+    builder.markClean();
+    REQUIRE(buffer.batchCount() == 2);
+    REQUIRE(buffer.vertices().size() == builder.vertices().size());
+    REQUIRE(ranges.size() == 2);
+    REQUIRE(decodes_within_precision());
+    const auto first_origin = buffer.origin(0);
+    const auto origin = buffer.origin(1);
+
+    // a small move stays within reach: only the line's own bytes are re-encoded, against the same origin
+    builder.updateLine(second, shifted(spiral(1000), -100000.0f + 2.0f));
+    ranges = buffer.update(builder.vertices(), builder.dirtyVertexRanges());
+    builder.markClean();
+    REQUIRE(ranges.size() == 1);
+    REQUIRE(ranges.front().size == LineGeometryBuilder::vertexCount(1000) * sizeof(PackedLineVertex));
+    REQUIRE(buffer.origin(1) == origin);
+    REQUIRE(decodes_within_precision());
+
+    // a move past the half float range from the old origin recenters the batch
+    builder.updateLine(second, shifted(spiral(1000), 0.0f));
+    ranges = buffer.update(builder.vertices(), builder.dirtyVertexRanges());
+    builder.markClean();
+    REQUIRE(ranges.size() == 1);
+    REQUIRE(ranges.front().offset == PackedLineBuffer::BatchStride * sizeof(PackedLineVertex));
+    REQUIRE(abs(buffer.origin(1).x) < 1000.0f);
+    REQUIRE(buffer.origin(0) == first_origin);
+    REQUIRE(decodes_within_precision());
+  }
+
+  SECTION("The packed miter flag is a bit of its own, even at zero width")
+  {
+    auto vertex = LineVertex();
+    vertex.offset = -0.0f;
+    vertex.mitered = 1;
+    const auto packed = packLineVertex(vertex, LinePoint{ 0.0f, 0.0f, 0.0f });
+    REQUIRE(packed.offset == 0x8000u);
+    REQUIRE(unpackLineVertex(packed, 1, LinePoint{ 0.0f, 0.0f, 0.0f }).mitered == 1);
+    vertex.mitered = 0;
+    REQUIRE(packLineVertex(vertex, LinePoint{ 0.0f, 0.0f, 0.0f }).offset == 0u);
+  }
+
+  SECTION("Instanced segments draw the same triangles as indexed vertices")
+  {
+    auto storage = vector<vector<LinePoint>>();
+    auto lines = vector<LinePolyline>();
+    for (auto i = 0; i < 40; i += 1) {
+      // include empty, single point and long lines
+      storage.push_back(spiral((i * 37) % 200));
+    }
+    for (auto i = 0; i < 40; i += 1)
+    {
+      auto line_style = style;
+      line_style.width = 1.0f + i * 0.5f;
+      line_style.mitered = i % 2 == 0;
+      lines.push_back(LinePolyline{ storage[i], line_style });
+    }
+
+    auto indexed = LineGeometryBuilder();
+    auto instanced = LineSegmentBuilder();
+    auto indexed_handles = indexed.addLines(lines, 3);
+    auto instanced_handles = instanced.addLines(lines, 3);
+    REQUIRE(instanced.points().size() == 3860 + 2 * 39);
+    REQUIRE(sameCorners(drawnCorners(instanced), drawnCorners(indexed)));
+
+    // shrink, grow and remove lines on both paths
+    for (auto i = 0; i < 40; i += 3)
+    {
+      auto points = spiral((i * 53) % 250);
+      indexed.updateLine(indexed_handles[i], points);
+      instanced.updateLine(instanced_handles[i], points);
+    }
+    for (auto i = 1; i < 40; i += 4)
+    {
+      indexed.removeLine(indexed_handles[i]);
+      instanced.removeLine(instanced_handles[i]);
+    }
+    REQUIRE(sameCorners(drawnCorners(instanced), drawnCorners(indexed)));
+    instanced.compact();
+    REQUIRE(sameCorners(drawnCorners(instanced), drawnCorners(indexed)));
+  }
+
+  SECTION("Indices split into 16-bit batches")
+  {
+    // lines long enough to cross several batch boundaries, between short ones
+    auto indexed = LineGeometryBuilder();
+    auto instanced = LineSegmentBuilder();
+    auto handles = vector<LineHandle>();
+    auto segment_handles = vector<LineHandle>();
+    for (auto count: { 10, 40000, 3, 100000, 70000, 7 })
+    {
+      auto points = spiral(count);
+      handles.push_back(indexed.addLine(points, style));
+      segment_handles.push_back(instanced.addLine(points, style));
+    }
+    REQUIRE(indexed.vertices().size() > 4 * LineGeometryBuilder::BatchStride);
+    REQUIRE(*max_element(indexed.indices().begin(), indexed.indices().end()) < 0xFFFF);
+
+    auto &ranges = indexed.drawRanges();
+    REQUIRE(ranges.size() == (indexed.vertices().size() - 4) / LineGeometryBuilder::BatchStride + 1);
+    REQUIRE(ranges.front().index_offset == 0);
+    REQUIRE(ranges.back().index_offset + ranges.back().index_count == indexed.indices().size());
+    for (size_t i = 0; i < ranges.size(); i += 1) {
+      REQUIRE(ranges[i].base_vertex == i * LineGeometryBuilder::BatchStride);
+    }
+
+    // the full vertex set, drawn batch by batch, is the same as drawing with 32-bit indices
+    auto whole = vector<LineVertex>();
+    for (auto count: { 10, 40000, 3, 100000, 70000, 7 })
+    {
+      auto points = spiral(count);
+      auto vertices = vector<LineVertex>(LineGeometryBuilder::vertexCount(points.size()));
+      auto indices = vector<uint32_t>(LineGeometryBuilder::indexCount(points.size()));
+      LineGeometryBuilder::build(points, style, 0, vertices, indices);
+      for (auto index: indices) {
+        whole.push_back(vertices[index]);
+      }
+    }
+    REQUIRE(sameCorners(drawnCorners(indexed), whole));
+
+    // shrinking, growing and removing lines keeps the batches drawable
+    indexed.updateLine(handles[3], spiral(30000));
+    instanced.updateLine(segment_handles[3], spiral(30000));
+    indexed.updateLine(handles[0], spiral(20000));
+    instanced.updateLine(segment_handles[0], spiral(20000));
+    indexed.removeLine(handles[4]);
+    instanced.removeLine(segment_handles[4]);
+    REQUIRE(sameCorners(drawnCorners(indexed), drawnCorners(instanced)));
+    indexed.compact();
+    REQUIRE(sameCorners(drawnCorners(indexed), drawnCorners(instanced)));
+    REQUIRE(indexed.drawRanges().size() == (indexed.vertices().size() - 4) / LineGeometryBuilder::BatchStride + 1);
+  }
+
+  SECTION("Instanced segments store each point once")
+  {
+    auto points = spiral(1000);
+    auto indexed = LineGeometryBuilder();
+    indexed.addLine(points, style);
+    auto instanced = LineSegmentBuilder();
+    instanced.addLine(points, style);
+
+    const auto indexed_bytes = indexed.vertices().size() * sizeof(LineVertex) + indexed.indices().size() * sizeof(uint16_t);
+    const auto instanced_bytes = instanced.points().size() * sizeof(LineSegmentPoint);
+    REQUIRE(instanced.instanceCount() == 999);
+    REQUIRE(instanced_bytes * 3 < indexed_bytes);
+  }
+
+  SECTION("Simplified lines stay within tolerance on screen")
+  {
+    auto points = trace(200000, 0.001f, 7);
+    const auto scale = 0.05f;
+    auto simplified = vector<LinePoint>();
+    LineSimplifier(orthographic(scale, 1.0f)).simplify(points, simplified);
+
+    REQUIRE(simplified.front() == points.front());
+    REQUIRE(simplified.back() == points.back());
+    REQUIRE(simplified.size() < points.size() / 10);
+
+    // radial thinning and Douglas–Peucker each allow one tolerance of error
+    auto pixel = [scale] (const LinePoint &p) { return make_pair(p.x * scale * 500.0f, p.y * scale * 500.0f); };
+    auto worst = 0.0f;
+    size_t j = 0;
+    for (auto &p: points)
+    {
+      if (j + 1 < simplified.size() && p == simplified[j + 1]) {
+        j += 1;
+      }
+      const auto a = pixel(simplified[j]);
+      const auto b = pixel(simplified[min(j + 1, simplified.size() - 1)]);
+      const auto q = pixel(p);
+      const auto dx = b.first - a.first;
+      const auto dy = b.second - a.second;
+      const auto length_squared = dx * dx + dy * dy;
+      const auto t = length_squared > 0 ? min(max(((q.first - a.first) * dx + (q.second - a.second) * dy) / length_squared, 0.0f), 1.0f) : 0.0f;
+      worst = max(worst, hypot(a.first + dx * t - q.first, a.second + dy * t - q.second));
+    }
+    REQUIRE(j == simplified.size() - 1);
+    REQUIRE(worst <= 2.0f + 1e-3f);
+  }
+
+  SECTION("Simplified lines keep the colors their points had")
+  {
+    auto points = trace(20000, 0.001f, 5);
+    const auto simplifier = LineSimplifier(orthographic(2.0f, 1.0f));
+    auto kept = vector<uint32_t>();
+    simplifier.simplifiedIndices(points, kept);
+    const auto lines = vector<LinePolyline>{ LinePolyline{ points, style } };
+    const auto simplified = simplifier.simplify(lines);
+    REQUIRE(simplified.points[0].size() == kept.size());
+    REQUIRE(kept.size() < points.size() / 10);
+
+    auto same_color = [] (const LineColor &a, const LineColor &b) {
+      return a.r == b.r && a.g == b.g && a.b == b.b && a.a == b.a;
+    };
+    auto full = LineGeometryBuilder();
+    full.addLine(points, style);
+    auto thinned = LineGeometryBuilder();
+    thinned.addLines(simplified.lines);
+    auto instanced = LineSegmentBuilder();
+    instanced.addLines(simplified.lines);
+    for (size_t j = 0; j < kept.size(); j += 1)
+    {
+      const auto &original = full.vertices()[kept[j] * 2].color;
+      REQUIRE(same_color(thinned.vertices()[j * 2].color, original));
+      REQUIRE(same_color(instanced.points()[j + 1].color, original));
+    }
+
+    // simplifying again keeps the places carried by the first pass
+    const auto again = LineSimplifier(orthographic(0.2f, 1.0f)).simplify(simplified.lines);
+    REQUIRE(again.points[0].size() < kept.size());
+    auto twice = LineGeometryBuilder();
+    twice.addLines(again.lines);
+    for (size_t j = 0, k = 0; j < again.points[0].size(); j += 1)
+    {
+      while (! (simplified.points[0][k] == again.points[0][j])) {
+        k += 1;
+      }
+      REQUIRE(same_color(twice.vertices()[j * 2].color, full.vertices()[kept[k] * 2].color));
+    }
+  }
+
+  SECTION("Simplified point counts follow screen coverage")
+  {
+    auto points = trace(100000, 0.001f, 11);
+    auto counts = vector<size_t>();
+    for (auto scale: { 0.01f, 0.1f, 1.0f, 10.0f })
+    {
+      auto simplified = vector<LinePoint>();
+      LineSimplifier(orthographic(scale, 1.0f)).simplify(points, simplified);
+      counts.push_back(simplified.size());
+    }
+    REQUIRE(counts[0] < 20);
+    REQUIRE(counts[0] < counts[1]);
+    REQUIRE(counts[1] < counts[2]);
+    REQUIRE(counts[2] < counts[3]);
+  }
+
+  SECTION("Points behind the camera are kept")
+  {
+    // w = z, so points with z <= 0 have no screen position
+    auto settings = orthographic(1.0f, 30.0f);
+    settings.view_projection.m[11] = 1.0f;
+    settings.view_projection.m[15] = 0.0f;
+    auto points = vector<LinePoint>();
+    for (auto i = 0; i < 9; i += 1) {
+      points.push_back(LinePoint{ i * 0.01f, 0.0f, i == 4 ? -1.0f : 1.0f });
+    }
+    auto simplified = vector<LinePoint>();
+    LineSimplifier(settings).simplify(points, simplified);
+    // so are their neighbors, since the segments joining them can't be measured
+    REQUIRE(simplified == (vector<LinePoint>{ points[0], points[3], points[4], points[5], points[8] }));
+  }
+
+  SECTION("Lines that cross behind the camera keep their hidden points and simplify the rest")
+  {
+    // w = z; the second half of a long straight trace is behind the camera
+    auto settings = orthographic(1.0f, 1.0f);
+    settings.view_projection.m[11] = 1.0f;
+    settings.view_projection.m[15] = 0.0f;
+    const auto count = 40000;
+    const auto hidden = count / 2;
+    auto points = vector<LinePoint>();
+    for (auto i = 0; i < count; i += 1) {
+      points.push_back(LinePoint{ i * 0.0001f, 0.0f, i < hidden ? 1.0f : -1.0f });
+    }
+    auto simplified = vector<LinePoint>();
+    LineSimplifier(settings).simplify(points, simplified);
+
+    auto expected = vector<LinePoint>{ points[0] };
+    expected.insert(expected.end(), points.begin() + hidden - 1, points.end());
+    REQUIRE(simplified == expected);
+  }
+
+  SECTION("Simplifying many traces in parallel matches simplifying them serially")
+  {
+    auto storage = vector<vector<LinePoint>>();
+    auto lines = vector<LinePolyline>();
+    for (auto i = 0; i < 200; i += 1) {
+      storage.push_back(trace(100 + (i * 7919) % 2000, 0.001f, i));
+    }
+    for (auto &points: storage) {
+      lines.push_back(LinePolyline{ points, style });
+    }
+    const auto simplifier = LineSimplifier(orthographic(1.0f, 1.0f));
+
+    auto serial = simplifier.simplify(lines, 1);
+    auto parallel = simplifier.simplify(lines);
+    REQUIRE(parallel.points == serial.points);
+    REQUIRE(simplifier.simplify(lines, 7).points == serial.points);
+    REQUIRE(parallel.lines[3].style.width == style.width);
+
+    auto output_points = size_t(0);
+    for (auto &line: parallel.lines) {
+      output_points += line.positions.size();
+    }
+    auto builder = LineGeometryBuilder();
+    builder.addLines(parallel.lines);
+    REQUIRE(builder.vertices().size() == 2 * output_points);
+  }
+
+  SECTION("Culling keeps only the lines inside the frustum")
+  {
+    // lines along x at heights -2 to 2; the identity frustum spans -1 to 1 on each axis
+    auto builder = LineGeometryBuilder();
+    auto visible = LineGeometryBuilder();
+    auto handles = vector<LineHandle>();
+    for (auto i = 0; i < 9; i += 1)
+    {
+      const auto y = -2.0f + i * 0.5f;
+      auto points = vector<LinePoint>{ { -0.5f, y, 0 }, { 0, y, 0 }, { 0.5f, y, 0 } };
+      handles.push_back(builder.addLine(points, style));
+      if (y >= -1.0f && y <= 1.0f) {
+        visible.addLine(points, style);
+      }
+    }
+    // straddles the right side of the frustum
+    auto crossing = vector<LinePoint>{ { 0.5f, 0, 0 }, { 3, 0, 0 } };
+    builder.addLine(crossing, style);
+    visible.addLine(crossing, style);
+    // beyond the far plane
+    builder.addLine(vector<LinePoint>{ { 0, 0, 2 }, { 0, 1, 2 } }, style);
+
+    REQUIRE(builder.cull(LineMatrix::identity()) == 6);
+    REQUIRE(builder.culledIndices().size() == visible.indices().size());
+    REQUIRE(sameCorners(drawnCorners(builder, builder.culledIndices(), builder.culledRanges()), drawnCorners(visible)));
+
+    auto bounds = builder.bounds(handles[1]);
+    REQUIRE(bounds.min == (LinePoint{ -0.5f, -1.5f, 0 }));
+    REQUIRE(bounds.max == (LinePoint{ 0.5f, -1.5f, 0 }));
+
+    // bounds follow updates, and removed lines stay out
+    builder.updateLine(handles[1], vector<LinePoint>{ { 0, 0, 0 }, { 0, 0.5f, 0 } });
+    builder.removeLine(handles[4]);
+    REQUIRE(builder.bounds(handles[1]).max == (LinePoint{ 0, 0.5f, 0 }));
+    REQUIRE(builder.bounds(handles[4]).empty());
+    REQUIRE(builder.cull(LineMatrix::identity()) == 6);
+  }
+
+  SECTION("Culled lines split across batches like drawn lines")
+  {
+    auto builder = LineGeometryBuilder();
+    builder.addLine(spiral(20000), style);
+    auto far = spiral(30000);
+    for (auto &p: far) {
+      p.x += 1000.0f;
+    }
+    builder.addLine(far, style);
+    builder.addLine(spiral(40000), style);
+
+    auto scale = LineMatrix::identity();
+    scale.m[0] = scale.m[5] = scale.m[10] = 0.001f;
+    REQUIRE(builder.cull(scale) == 3);
+    REQUIRE(sameCorners(drawnCorners(builder, builder.culledIndices(), builder.culledRanges()), drawnCorners(builder)));
+
+    auto shifted = scale;
+    shifted.m[12] = -1.5f;
+    REQUIRE(builder.cull(shifted) == 1);
+    REQUIRE(builder.culledIndices().size() == LineGeometryBuilder::indexCount(30000));
+    REQUIRE(builder.culledRanges().size() == 2);
+  }
+
+  SECTION("Bulk lines match lines added one at a time")
+  {
+    auto storage = vector<vector<LinePoint>>();
+    auto lines = vector<LinePolyline>();
+    for (auto i = 0; i < 50; i += 1) {
+      // include empty, single point and long lines
+      storage.push_back(spiral((i * 37) % 300));
+    }
+    for (auto i = 0; i < 50; i += 1)
+    {
+      auto line_style = style;
+      line_style.width = i * 0.5f;
+      lines.push_back(LinePolyline{ storage[i], line_style });
+    }
+
+    auto single = LineGeometryBuilder();
+    single.addLine(storage[0], style);
+    for (auto &line: lines) {
+      single.addLine(line.positions, line.style);
+    }
+
+    for (auto threads: { 1, 3, 8 })
+    {
+      auto bulk = LineGeometryBuilder();
+      bulk.addLine(storage[0], style);
+      bulk.addLines(lines, threads);
+      REQUIRE(bulk.indices() == single.indices());
+      REQUIRE(bulk.vertices().size() == single.vertices().size());
+      REQUIRE(memcmp(bulk.vertices().data(), single.vertices().data(), bulk.vertices().size() * sizeof(LineVertex)) == 0);
+    }
+  }
+
+  SECTION("Updated and removed lines keep the rest of the geometry in place")
+  {
+    auto builder = LineGeometryBuilder();
+    auto a = builder.addLine(spiral(10), style);
+    auto b = builder.addLine(spiral(20), style);
+    auto c = builder.addLine(spiral(30), style);
+    builder.markClean();
+    REQUIRE_FALSE(builder.isDirty());
+
+    // same size: only b's vertices change
+    auto moved = spiral(20);
+    for (auto &p: moved) {
+      p.z += 1.0f;
+    }
+    REQUIRE(builder.updateLine(b, moved));
+    auto ranges = builder.dirtyVertexRanges(0);
+    REQUIRE(ranges.size() == 1);
+    REQUIRE(ranges[0].offset == 20 * sizeof(LineVertex));
+    REQUIRE(ranges[0].size == 40 * sizeof(LineVertex));
+    REQUIRE(builder.dirtyIndexRanges(0).empty());
+    REQUIRE(builder.vertices()[20].position == moved[0]);
+    builder.markClean();
+
+    // shrinking fits in place and collapses each leftover segment onto its first vertex
+    REQUIRE(builder.updateLine(b, spiral(5)));
+    auto &indices = builder.indices();
+    REQUIRE(indices[54 + 4 * 6 - 1] == 29);
+    REQUIRE(indices[54 + 4 * 6] == 28);
+    REQUIRE(indices[54 + 4 * 6 + 5] == 28);
+    REQUIRE(indices[54 + 19 * 6 - 1] == 56);
+    builder.markClean();
+
+    // growing moves the line to the end
+    REQUIRE(builder.updateLine(a, spiral(40)));
+    REQUIRE(builder.vertices().size() == 120 + 80);
+    REQUIRE(builder.indices()[0] == 0);
+    REQUIRE(builder.indices()[1] == 0);
+    REQUIRE(builder.indices().back() == 199);
+
+    REQUIRE(builder.removeLine(c));
+    REQUIRE_FALSE(builder.removeLine(c));
+    REQUIRE_FALSE(builder.updateLine(c, spiral(3)));
+    REQUIRE(builder.lineCount() == 2);
+
+    // compacting keeps b before a, as they now sit in the arrays
+    builder.compact();
+    REQUIRE(builder.vertices().size() == 10 + 80);
+    REQUIRE(builder.indices().size() == 4 * 6 + 39 * 6);
+    REQUIRE(builder.vertices()[10].position == spiral(40)[0]);
+    REQUIRE(builder.indices().back() == 89);
+    REQUIRE(builder.dirtyVertexRanges().size() == 1);
+    REQUIRE(builder.dirtyVertexRanges()[0].size == 90 * sizeof(LineVertex));
+
+    // handles survive compaction
+    REQUIRE(builder.updateLine(b, spiral(5)));
+    REQUIRE(builder.contains(a));
+  }
+
+  SECTION("Removing most lines compacts automatically")
+  {
+    auto builder = LineGeometryBuilder();
+    auto handles = vector<LineHandle>();
+    for (auto i = 0; i < 100; i += 1) {
+      handles.push_back(builder.addLine(spiral(50), style));
+    }
+    for (auto i = 0; i < 90; i += 1) {
+      builder.removeLine(handles[i]);
+    }
+    REQUIRE(builder.vertices().size() < 100 * 100);
+    REQUIRE(builder.lineCount() == 10);
+    for (auto i = 90; i < 100; i += 1) {
+      REQUIRE(builder.contains(handles[i]));
+    }
+  }
+}
+
+TEST_CASE("LineGeometry benchmarks", "[.benchmark]")
+{
+  const auto style = testStyle();
+
+  SECTION("Expanding a million-point polyline")
+  {
+    auto points = spiral(1000000);
+    auto builder = LineGeometryBuilder();
+    builder.reserve(points.size(), 1);
+
+    auto start = chrono::high_resolution_clock::now();
+    builder.addLine(points, style);
+    auto ms = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+
+    cout << "Expanded " << points.size() << " points into " << builder.vertices().size() << " vertices and " << builder.indices().size() << " indices in " << ms << "ms" << endl;
+    cout << "  " << builder.vertices().size() * sizeof(LineVertex) / (1024 * 1024) << " MiB of vertices, " << sizeof(LineVertex) << " bytes each" << endl;
+    REQUIRE(builder.vertices().size() == 2000000);
+  }
+
+  SECTION("Adding ten thousand lines")
+  {
+    auto points = spiral(100);
+    auto lines = vector<LinePolyline>(10000, LinePolyline{ points, style });
+
+    auto time = [] (auto fn) {
+      auto start = chrono::high_resolution_clock::now();
+      fn();
+      return chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+    };
+    auto one_at_a_time = LineGeometryBuilder();
+    auto single_ms = time([&] {
+      for (auto &line: lines) {
+        one_at_a_time.addLine(line.positions, line.style);
+      }
+    });
+    auto bulk = LineGeometryBuilder();
+    auto bulk_ms = time([&] { bulk.addLines(lines, 1); });
+    auto parallel = LineGeometryBuilder();
+    auto parallel_ms = time([&] { parallel.addLines(lines); });
+
+    cout << "10k lines of 100 points: addLine " << single_ms << "ms, addLines " << bulk_ms << "ms, addLines on " << resolve_thread_count(0) << " threads " << parallel_ms << "ms" << endl;
+    REQUIRE(parallel.indices() == one_at_a_time.indices());
+  }
+
+  SECTION("Animating a few lines among thousands")
+  {
+    auto points = spiral(100);
+    auto lines = vector<LinePolyline>(10000, LinePolyline{ points, style });
+    auto builder = LineGeometryBuilder();
+    auto handles = builder.addLines(lines);
+    builder.markClean();
+
+    auto moved = points;
+    auto start = chrono::high_resolution_clock::now();
+    auto dirty_bytes = size_t(0);
+    for (auto frame = 0; frame < 100; frame += 1)
+    {
+      for (auto &p: moved) {
+        p.y += 0.01f;
+      }
+      for (auto i = 0; i < 5; i += 1) {
+        builder.updateLine(handles[i * 2000 + frame], moved);
+      }
+      for (auto &r: builder.dirtyVertexRanges()) {
+        dirty_bytes += r.size;
+      }
+      for (auto &r: builder.dirtyIndexRanges()) {
+        dirty_bytes += r.size;
+      }
+      builder.markClean();
+    }
+    auto ms = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+
+    const auto total_bytes = builder.vertices().size() * sizeof(LineVertex) + builder.indices().size() * sizeof(uint16_t);
+    cout << "5 of 10k lines changing per frame: " << ms / 100 << "ms and " << dirty_bytes / 100 / 1024 << " KiB to upload per frame, against " << total_bytes / 1024 << " KiB for a full rebuild" << endl;
+    REQUIRE(dirty_bytes / 100 < total_bytes / 100);
+  }
+
+  SECTION("Simplifying many traces in parallel")
+  {
+    auto storage = vector<vector<LinePoint>>();
+    auto lines = vector<LinePolyline>();
+    for (auto i = 0; i < 200; i += 1) {
+      storage.push_back(trace(100 + (i * 7919) % 20000, 0.001f, i));
+    }
+    for (auto &points: storage) {
+      lines.push_back(LinePolyline{ points, style });
+    }
+    const auto simplifier = LineSimplifier(orthographic(1.0f, 1.0f));
+
+    auto time = [] (auto fn) {
+      auto start = chrono::high_resolution_clock::now();
+      fn();
+      return chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+    };
+    auto serial = SimplifiedLines();
+    auto serial_ms = time([&] { serial = simplifier.simplify(lines, 1); });
+    auto parallel = SimplifiedLines();
+    auto parallel_ms = time([&] { parallel = simplifier.simplify(lines); });
+    REQUIRE(parallel.points == serial.points);
+    REQUIRE(simplifier.simplify(lines, 7).points == serial.points);
+    REQUIRE(parallel.lines[3].style.width == style.width);
+
+    auto input_points = size_t(0);
+    auto output_points = size_t(0);
+    for (size_t i = 0; i < lines.size(); i += 1)
+    {
+      input_points += lines[i].positions.size();
+      output_points += parallel.lines[i].positions.size();
+    }
+    auto builder = LineGeometryBuilder();
+    builder.addLines(parallel.lines);
+    cout << "Simplified " << input_points << " points to " << output_points << " in " << serial_ms << "ms, " << parallel_ms << "ms on " << resolve_thread_count(0) << " threads" << endl;
+    REQUIRE(builder.vertices().size() == 2 * output_points);
+  }
+
+  SECTION("Culling ten thousand lines, most of them offscreen")
+  {
+    auto points = spiral(100);
+    auto offscreen = points;
+    for (auto &p: offscreen) {
+      p.x += 200.0f;
+    }
+    auto lines = vector<LinePolyline>();
+    for (auto i = 0; i < 10000; i += 1) {
+      lines.push_back(LinePolyline{ i % 10 == 0 ? points : offscreen, style });
+    }
+    auto builder = LineGeometryBuilder();
+    builder.addLines(lines);
+
+    auto view_projection = LineMatrix::identity();
+    view_projection.m[0] = view_projection.m[5] = view_projection.m[10] = 0.01f;
+    auto visible = size_t(0);
+    auto start = chrono::high_resolution_clock::now();
+    for (auto frame = 0; frame < 100; frame += 1) {
+      visible = builder.cull(view_projection);
+    }
+    auto ms = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+
+    cout << "Culled 10k lines to " << visible << " in " << ms / 100 << "ms per frame, drawing " << builder.culledIndices().size() << " of " << builder.indices().size() << " indices" << endl;
+    REQUIRE(visible == 1000);
+    REQUIRE(builder.culledIndices().size() * 10 == builder.indices().size());
+  }
+}
@@ -7,7 +7,14 @@
 
 #include "catch.hpp"
 #include "SimpleMarkov.h"
+#include "MarkovTrainer.h"
+#include "MappedMarkov.h"
+#include "MarkovAnalysis.h"
+#include <cstdio>
+#include <sstream>
+#include <chrono>
 #include <iostream>
+#include <map>
 
 using namespace pockets;
 using namespace std;
@@ -69,4 +76,811 @@ TEST_CASE("Markov_test")
     cout << string_graph.nextNode("Hello", 1.0f) << endl;
     cout << string_graph.nextNode("Goodbye", 0.4f) << endl;
   }
+
+  SECTION("Alias tables sample each index in proportion to its weight")
+  {
+    auto table = AliasTable({ 1.0f, 0.0f, 3.0f, 4.0f });
+    auto counts = vector<int>(table.size(), 0);
+    const auto samples = 8000;
+    for (auto i = 0; i < samples; i += 1)
+    {
+      counts[table.sample((i + 0.5f) / samples)] += 1;
+    }
+
+    REQUIRE(counts[0] == 1000);
+    REQUIRE(counts[1] == 0);
+    REQUIRE(counts[2] == 3000);
+    REQUIRE(counts[3] == 4000);
+    REQUIRE(AliasTable({ 0.0f, 0.0f }).empty());
+  }
+
+  SECTION("Compiled markov graphs sample in proportion to pathway weights")
+  {
+    MarkovGraph<string> graph;
+    graph.addPathway("a", "b", 1.0f);
+    graph.addPathway("a", "c", 3.0f);
+    graph.compile();
+
+    REQUIRE(graph.isCompiled());
+    REQUIRE(graph.nextNode("missing", 0.5f) == "missing");
+
+    auto counts = map<string, int>();
+    const auto samples = 4000;
+    for (auto i = 0; i < samples; i += 1)
+    {
+      counts[graph.nextNode("a", (i + 0.5f) / samples)] += 1;
+    }
+    REQUIRE(counts["b"] == 1000);
+    REQUIRE(counts["c"] == 3000);
+
+    // changing weights after compiling rebuilds that node's table on next use
+    graph.addPathway("a", "b", 0.0f);
+    for (auto i = 0; i < 100; i += 1)
+    {
+      REQUIRE(graph.nextNode("a", i / 100.0f) == "c");
+    }
+  }
+
+  SECTION("Fenwick trees track running totals through updates")
+  {
+    auto tree = FenwickTree({ 1.0f, 2.0f, 3.0f });
+    tree.push_back(4.0f);
+    tree.push_back(5.0f);
+
+    REQUIRE(tree.total() == Approx(15.0));
+    REQUIRE(tree.prefix_sum(3) == Approx(6.0));
+    REQUIRE(tree.lower_bound(0.5) == 0);
+    REQUIRE(tree.lower_bound(3.5) == 2);
+    REQUIRE(tree.lower_bound(15.5) == 5);
+
+    tree.set(2, 0.0f);
+    REQUIRE(tree.total() == Approx(12.0));
+    REQUIRE(tree.lower_bound(3.5) == 3);
+
+    // building in bulk and appending one at a time agree
+    auto appended = FenwickTree();
+    auto weights = vector<float>();
+    for (auto i = 0; i < 37; i += 1)
+    {
+      weights.push_back(i % 5);
+      appended.push_back(i % 5);
+    }
+    auto built = FenwickTree(weights);
+    for (size_t i = 0; i <= weights.size(); i += 1)
+    {
+      REQUIRE(appended.prefix_sum(i) == Approx(built.prefix_sum(i)));
+    }
+  }
+
+  SECTION("Markov nodes can be reweighted after exits are added")
+  {
+    auto thing = createNode(make_shared<Thing>("Base"));
+    thing->addExit(createNode(make_shared<Thing>("Exit One")), 1.0f);
+    thing->addExit(createNode(make_shared<Thing>("Exit Two")), 9.0f);
+    thing->setWeight(0, 9.0f);
+    thing->setWeight(1, 1.0f);
+
+    REQUIRE(thing->findExit(0.05f)->thing->name == "Exit One");
+    REQUIRE(thing->findExit(0.85f)->thing->name == "Exit One");
+    REQUIRE(thing->findExit(0.95f)->thing->name == "Exit Two");
+    REQUIRE(thing->exits[0].weight == 9.0f);
+    REQUIRE(thing->exits.size() == 2);
+
+    auto copy = *thing;
+    copy.setWeight(0, 2.0f);
+    REQUIRE(&copy.exits != &thing->exits);
+    REQUIRE(copy.exits[0].weight == 2.0f);
+    REQUIRE(thing->exits[0].weight == 9.0f);
+  }
+
+  SECTION("Negative markov node weights count as zero")
+  {
+    auto thing = createNode(make_shared<Thing>("Base"));
+    thing->addExit(createNode(make_shared<Thing>("Exit One")), -5.0f);
+    thing->addExit(createNode(make_shared<Thing>("Exit Two")), 1.0f);
+    thing->addExit(createNode(make_shared<Thing>("Exit Three")), 1.0f);
+
+    REQUIRE(thing->exits[0].weight == 0.0f);
+    REQUIRE(thing->findExit(0.0f)->thing->name == "Exit Two");
+    REQUIRE(thing->findExit(0.25f)->thing->name == "Exit Two");
+    REQUIRE(thing->findExit(0.75f)->thing->name == "Exit Three");
+
+    thing->setWeight(2, -1.0f);
+    REQUIRE(thing->findExit(1.0f)->thing->name == "Exit Two");
+    thing->setWeight(1, -1.0f);
+    REQUIRE(thing->findExit(0.5f) == nullptr);
+  }
+
+  SECTION("Dynamic markov graphs sample from weights updated in place")
+  {
+    DynamicMarkovGraph<string> graph;
+    graph.addPathway("a", "b", 1.0f);
+    graph.addPathway("a", "c", 1.0f);
+
+    REQUIRE(graph.nextNode("a", 0.25f) == "b");
+    REQUIRE(graph.nextNode("a", 0.75f) == "c");
+    REQUIRE(graph.nextNode("missing", 0.5f) == "missing");
+
+    graph.reinforcePathway("a", "b", 2.0f);
+    REQUIRE(graph.pathwayWeight("a", "b") == 3.0f);
+    REQUIRE(graph.nextNode("a", 0.7f) == "b");
+
+    graph.addPathway("a", "b", 0.0f);
+    graph.addPathway("a", "c", 0.0f);
+    REQUIRE(graph.nextNode("a", 0.5f) == "a");
+  }
+
+  SECTION("Frozen markov graphs match the weights of the graph they came from")
+  {
+    MarkovGraph<string> graph;
+    graph.addPathway("a", "b", 1.0f);
+    graph.addPathway("a", "c", 3.0f);
+    graph.addPathway("a", "d", 0.0f);
+    graph.addPathway("c", "a", 1.0f);
+    auto frozen = graph.freeze();
+
+    REQUIRE(frozen.nodeCount() == 4);
+    REQUIRE(frozen.edgeCount() == 3);
+    REQUIRE(frozen.nextNode("b", 0.5f) == "b");
+    REQUIRE(frozen.nextNode("missing", 0.5f) == "missing");
+    REQUIRE(frozen.nextNode("c", 0.0f) == "a");
+    REQUIRE(frozen.nextNode("c", 1.0f) == "a");
+
+    auto counts = map<string, int>();
+    const auto samples = 4000;
+    for (auto i = 0; i < samples; i += 1)
+    {
+      counts[frozen.nextNode("a", (i + 0.5f) / samples)] += 1;
+    }
+    REQUIRE(counts["b"] == 1000);
+    REQUIRE(counts["c"] == 3000);
+    REQUIRE(counts["d"] == 0);
+  }
+
+  SECTION("Frozen markov graphs use a fraction of the memory")
+  {
+    const auto nodes = 10000;
+    const auto exits = 8;
+    MarkovGraph<int> graph;
+    for (auto n = 0; n < nodes; n += 1)
+    {
+      for (auto e = 1; e <= exits; e += 1)
+      {
+        graph.addPathway(n, (n * 31 + e * 7919) % nodes, 1.0f + e);
+      }
+    }
+    auto frozen = graph.freeze();
+
+    REQUIRE(frozen.edgeCount() == size_t(nodes * exits));
+    REQUIRE(frozen.memoryUsage() < graph.memoryUsage() / 2);
+  }
+
+  SECTION("Batch walks are deterministic regardless of thread count")
+  {
+    MarkovGraph<int> graph;
+    for (auto n = 0; n < 100; n += 1)
+    {
+      graph.addPathway(n, (n + 1) % 100, 1.0f);
+      graph.addPathway(n, (n * 7) % 100, 2.0f);
+      graph.addPathway(n, (n + 50) % 100, 0.5f);
+    }
+    auto frozen = graph.freeze();
+
+    auto starts = vector<uint32_t>();
+    for (auto i = 0; i < 1000; i += 1)
+    {
+      starts.push_back(frozen.nodeId(i % 100));
+    }
+    const auto length = 32;
+    auto single = frozen.generateWalks(starts, length, 1234, 1);
+    auto many = frozen.generateWalks(starts, length, 1234, 7);
+    auto reseeded = frozen.generateWalks(starts, length, 4321, 7);
+
+    REQUIRE(single.size() == starts.size() * length);
+    REQUIRE(single == many);
+    REQUIRE(single != reseeded);
+    for (size_t w = 0; w < starts.size(); w += 1)
+    {
+      REQUIRE(single[w * length] == starts[w]);
+    }
+
+    auto values = graph.generateWalks({ 3, -1 }, 4, 1234);
+    REQUIRE(values.size() == 8);
+    REQUIRE(values[0] == 3);
+    REQUIRE(values[4] == -1);
+    REQUIRE(values[7] == -1);
+  }
+
+  SECTION("Order-k training counts each context's next tokens")
+  {
+    MarkovTrainer<char> trainer(2);
+    auto text = string("abcabdabc");
+    trainer.addSequence(vector<char>(text.begin(), text.end()));
+    auto chain = trainer.build();
+
+    // ab -> c twice, ab -> d once
+    REQUIRE(chain.contextCount() == 5);
+    REQUIRE(chain.probability("ab", 'c') == Approx(2.0f / 3.0f));
+    REQUIRE(chain.probability("ab", 'd') == Approx(1.0f / 3.0f));
+    REQUIRE(*chain.nextToken("bc", 0.5f) == 'a');
+    REQUIRE(chain.nextToken("zz", 0.5f) == nullptr);
+
+    auto generated = chain.generate({ 'b', 'd' }, 8, 99);
+    REQUIRE(generated.size() == 8);
+    REQUIRE(generated[2] == 'a');
+    REQUIRE(generated[3] == 'b');
+  }
+
+  SECTION("Contexts never span separate sequences")
+  {
+    MarkovTrainer<int> trainer(1);
+    trainer.addSequences({ { 1, 2 }, { 3, 4 }, { 5 } });
+    auto chain = trainer.build();
+    auto two = 2;
+
+    REQUIRE(trainer.pairCount() == 2);
+    REQUIRE(chain.nextToken(&two, 0.5f) == nullptr);
+  }
+
+  SECTION("Training gives the same chain on any number of threads and staging budgets")
+  {
+    auto tokens = vector<int>(200000);
+    for (size_t i = 0; i < tokens.size(); i += 1)
+    {
+      tokens[i] = static_cast<int>(counter_uniform(7, 0, i) * 40);
+    }
+
+    MarkovTrainer<int> serial(3);
+    serial.addSequence(tokens, 1);
+    // a tiny budget forces many merges into the shared table
+    MarkovTrainer<int> parallel(3, 4096);
+    parallel.addSequence(tokens, 6);
+    MarkovTrainer<int> split(3);
+    split.addSequence(tokens.data(), 100003, 3);
+    split.addSequence(tokens.data() + 100000, tokens.size() - 100000, 3);
+
+    auto a = serial.build();
+    auto b = parallel.build();
+    auto c = split.build();
+    REQUIRE(serial.pairCount() == parallel.pairCount());
+    REQUIRE(serial.pairCount() == split.pairCount());
+    REQUIRE(a.contextCount() == b.contextCount());
+    for (size_t i = 0; i < 1000; i += 1)
+    {
+      REQUIRE(a.probability(&tokens[i], tokens[i + 3]) == b.probability(&tokens[i], tokens[i + 3]));
+      REQUIRE(a.probability(&tokens[i], tokens[i + 3]) == c.probability(&tokens[i], tokens[i + 3]));
+    }
+    REQUIRE(a.generate({ 1, 2, 3 }, 64, 5) == b.generate({ 1, 2, 3 }, 64, 5));
+  }
+
+  SECTION("Arena markov nodes can form cycles and sample by weight")
+  {
+    MarkovArena<Thing> arena;
+    auto a = arena.createNode(Thing("a"));
+    auto b = arena.createNode(Thing("b"));
+    auto c = arena.createNode(Thing("c"));
+    arena.addExit(a, b, 1.0f);
+    arena.addExit(b, c, 1.0f);
+    arena.addExit(c, a, 1.0f);
+    // grows a's block after others have been allocated, moving it
+    arena.addExit(a, c, 9.0f);
+    arena.addExit(a, a, 0.0f);
+
+    REQUIRE(arena.findExit(a, 0.05f) == b);
+    REQUIRE(arena.findExit(a, 0.15f) == c);
+    REQUIRE(arena.findExit(a, 1.0f) == c);
+    REQUIRE(arena.thing(arena.findExit(c, 0.5f)).name == "a");
+
+    auto before = arena.memoryUsage();
+    arena.compact();
+    REQUIRE(arena.memoryUsage() < before);
+    REQUIRE(arena.exitCount(a) == 3);
+    REQUIRE(arena.findExit(a, 0.05f) == b);
+
+    arena.setExitWeight(a, 0, 0.0f);
+    REQUIRE(arena.findExit(a, 0.05f) == c);
+    arena.setExitWeight(a, 1, 0.0f);
+    REQUIRE(arena.findExit(a, 0.5f) == MarkovArena<Thing>::InvalidNode);
+
+    arena.clear();
+    REQUIRE(arena.nodeCount() == 0);
+  }
+
+  SECTION("Negative arena exit weights count as zero")
+  {
+    MarkovArena<int> arena;
+    auto a = arena.createNode(0);
+    auto b = arena.createNode(1);
+    auto c = arena.createNode(2);
+    arena.addExit(a, b, -5.0f);
+    arena.addExit(a, c, 1.0f);
+    // a negative weight in the total would shrink it, so high t would run off the end and return the last exit early
+    REQUIRE(arena.findExit(a, 0.0f) == c);
+    REQUIRE(arena.findExit(a, 0.5f) == c);
+    REQUIRE(arena.findExit(a, 1.0f) == c);
+
+    arena.setExitWeight(a, 0, 1.0f);
+    arena.setExitWeight(a, 1, -3.0f);
+    REQUIRE(arena.findExit(a, 0.5f) == b);
+    REQUIRE(arena.findExit(a, 1.0f) == b);
+    arena.setExitWeight(a, 0, -1.0f);
+    REQUIRE(arena.findExit(a, 0.5f) == MarkovArena<int>::InvalidNode);
+  }
+
+  SECTION("Saved markov graphs sample identically in place")
+  {
+    MarkovGraph<string> graph;
+    graph.addPathway("Hello", "Goodbye", 1.0f);
+    graph.addPathway("Hello", "Hello", 0.5f);
+    graph.addPathway("Goodbye", "Hello", 0.5f);
+    graph.addPathway("Goodbye", "Later", 2.0f);
+    auto frozen = graph.freeze();
+
+    auto stream = stringstream();
+    writeMarkovGraph(frozen, stream);
+    auto text = stream.str();
+    // copy into 8-byte aligned storage, as a mapping would be
+    auto storage = vector<uint64_t>((text.size() + 7) / 8);
+    memcpy(storage.data(), text.data(), text.size());
+    MappedMarkovGraph<string> mapped(storage.data(), text.size());
+
+    REQUIRE(mapped.nodeCount() == frozen.nodeCount());
+    REQUIRE(mapped.edgeCount() == frozen.edgeCount());
+    REQUIRE(mapped.nodeId("Nope") == MappedMarkovGraph<string>::InvalidNode);
+    for (auto &value: frozen.values())
+    {
+      auto id = mapped.nodeId(value);
+      REQUIRE(id == frozen.nodeId(value));
+      REQUIRE(mapped.value(id) == value);
+      for (auto t = 0.0f; t <= 1.0f; t += 0.125f) {
+        REQUIRE(mapped.nextNode(id, t) == frozen.nextNode(id, t));
+      }
+    }
+    auto starts = vector<uint32_t>{ 0, 1, 2 };
+    REQUIRE(mapped.generateWalks(starts, 16, 3) == frozen.generateWalks(starts, 16, 3));
+  }
+
+  SECTION("Saved markov graphs find non-ASCII keys")
+  {
+    MarkovGraph<string> graph;
+    auto keys = vector<string>{ "apple", "\xC3\xA9t\xC3\xA9", "\xE4\xB8\xAD", "zebra", "\xF0\x9F\x98\x80" };
+    for (size_t i = 0; i < keys.size(); i += 1) {
+      graph.addPathway(keys[i], keys[(i + 1) % keys.size()], 1.0f);
+    }
+    auto frozen = graph.freeze();
+
+    auto stream = stringstream();
+    writeMarkovGraph(frozen, stream);
+    auto text = stream.str();
+    auto storage = vector<uint64_t>((text.size() + 7) / 8);
+    memcpy(storage.data(), text.data(), text.size());
+    MappedMarkovGraph<string> mapped(storage.data(), text.size());
+
+    for (auto &key: keys)
+    {
+      auto id = mapped.nodeId(key);
+      REQUIRE(id != MappedMarkovGraph<string>::InvalidNode);
+      REQUIRE(id == frozen.nodeId(key));
+      REQUIRE(mapped.value(id) == key);
+    }
+    REQUIRE(mapped.nodeId("\xC3\xA9") == MappedMarkovGraph<string>::InvalidNode);
+  }
+
+  SECTION("Markov files are checked before they are sampled")
+  {
+    MarkovGraph<int> graph;
+    graph.addPathway(1, 2, 1.0f);
+    auto stream = stringstream();
+    writeMarkovGraph(graph.freeze(), stream);
+    auto text = stream.str();
+    auto storage = vector<uint64_t>((text.size() + 7) / 8);
+
+    memcpy(storage.data(), text.data(), text.size());
+    REQUIRE_NOTHROW(MappedMarkovGraph<int>(storage.data(), text.size()));
+    REQUIRE_THROWS(MappedMarkovGraph<int>(storage.data(), text.size() - 1));
+    REQUIRE_THROWS(MappedMarkovGraph<float>(storage.data(), text.size()));
+    REQUIRE_THROWS(MappedMarkovGraph<string>(storage.data(), text.size()));
+
+    auto header = reinterpret_cast<MarkovFileHeader*>(storage.data());
+    header->version += 1;
+    REQUIRE_THROWS(MappedMarkovGraph<int>(storage.data(), text.size()));
+    header->version -= 1;
+    header->magic[0] = 'X';
+    REQUIRE_THROWS(MappedMarkovGraph<int>(storage.data(), text.size()));
+
+    REQUIRE_THROWS(MappedMarkovGraph<int>("no/such/file.pkmarkov"));
+  }
+
+  SECTION("Corrupt markov files are rejected")
+  {
+    MarkovGraph<string> graph;
+    graph.addPathway("a", "bb", 1.0f);
+    graph.addPathway("bb", "a", 1.0f);
+    graph.addPathway("bb", "ccc", 1.0f);
+    auto stream = stringstream();
+    writeMarkovGraph(graph.freeze(), stream);
+    const auto text = stream.str();
+    const auto original = vector<uint64_t>((text.size() + 7) / 8);
+    memcpy(const_cast<uint64_t*>(original.data()), text.data(), text.size());
+    const auto layout = detail::MarkovFileLayout(*reinterpret_cast<const MarkovFileHeader*>(original.data()));
+
+    auto storage = original;
+    auto bytes = reinterpret_cast<char*>(storage.data());
+    auto header = reinterpret_cast<MarkovFileHeader*>(storage.data());
+    auto offsets = reinterpret_cast<uint64_t*>(bytes + layout.offsets);
+    auto targets = reinterpret_cast<uint32_t*>(bytes + layout.targets);
+    auto sorted_ids = reinterpret_cast<uint32_t*>(bytes + layout.sorted_ids);
+    auto string_offsets = reinterpret_cast<uint64_t*>(bytes + layout.values);
+    auto mapped = [&] { return MappedMarkovGraph<string>(storage.data(), text.size()); };
+    REQUIRE_NOTHROW(mapped());
+
+    // counts large enough to wrap the section math around to the real file size
+    header->edge_count = uint64_t(1) << 62;
+    REQUIRE_THROWS(mapped());
+    storage = original;
+    header->value_bytes = ~uint64_t(0) - 100;
+    REQUIRE_THROWS(mapped());
+    storage = original;
+    header->node_count = ~uint64_t(0) / 8;
+    REQUIRE_THROWS(mapped());
+
+    storage = original;
+    targets[1] = 3;
+    REQUIRE_THROWS(mapped());
+    storage = original;
+    sorted_ids[0] = 7;
+    REQUIRE_THROWS(mapped());
+    storage = original;
+    offsets[1] = header->edge_count;
+    offsets[2] = 0;
+    REQUIRE_THROWS(mapped());
+    storage = original;
+    offsets[0] = 1;
+    REQUIRE_THROWS(mapped());
+
+    storage = original;
+    string_offsets[3] += 1;
+    REQUIRE_THROWS(mapped());
+    storage = original;
+    swap(string_offsets[1], string_offsets[2]);
+    REQUIRE_THROWS(mapped());
+    storage = original;
+    REQUIRE_NOTHROW(mapped());
+  }
+
+  SECTION("Stationary distributions match the analytic solution")
+  {
+    MarkovGraph<char> graph;
+    graph.addPathway('a', 'a', 0.7f);
+    graph.addPathway('a', 'b', 0.3f);
+    graph.addPathway('b', 'a', 0.6f);
+    graph.addPathway('b', 'b', 0.4f);
+    auto frozen = graph.freeze();
+    MarkovTransitionMatrix matrix(frozen);
+
+    auto stationary = matrix.stationaryDistribution();
+    REQUIRE(stationary.converged);
+    REQUIRE(stationary.probabilities[frozen.nodeId('a')] == Approx(2.0 / 3.0));
+    REQUIRE(stationary.probabilities[frozen.nodeId('b')] == Approx(1.0 / 3.0));
+
+    // one step from a is just a's exits
+    auto one = matrix.transitionsFrom(frozen.nodeId('a'), 1);
+    REQUIRE(one[frozen.nodeId('a')] == Approx(0.7));
+    REQUIRE(one[frozen.nodeId('b')] == Approx(0.3));
+  }
+
+  SECTION("Periodic chains and dead ends still settle")
+  {
+    // a -> b -> c -> a cycles with period 3; d leads into the cycle; e has no exits and stays put
+    MarkovGraph<char> graph;
+    graph.addPathway('a', 'b', 1.0f);
+    graph.addPathway('b', 'c', 1.0f);
+    graph.addPathway('c', 'a', 1.0f);
+    graph.addPathway('d', 'a', 1.0f);
+    graph.addPathway('d', 'e', 1.0f);
+    auto frozen = graph.freeze();
+    MarkovTransitionMatrix matrix(frozen);
+
+    auto stationary = matrix.stationaryDistribution(1e-12);
+    REQUIRE(stationary.converged);
+    auto &p = stationary.probabilities;
+    REQUIRE(p[frozen.nodeId('d')] == Approx(0.0));
+    REQUIRE(p[frozen.nodeId('a')] == Approx(p[frozen.nodeId('b')]));
+    REQUIRE(p[frozen.nodeId('b')] == Approx(p[frozen.nodeId('c')]));
+    // e starts with 1/5 and collects half of d's 1/5
+    REQUIRE(p[frozen.nodeId('e')] == Approx(0.3));
+  }
+
+  SECTION("k-step transitions match dense matrix powers on any number of threads")
+  {
+    const auto n = 40;
+    auto pathways = vector<CompactMarkovGraph<int>::Pathway>();
+    for (auto i = 0; i < n; i += 1)
+    {
+      for (auto e = 0; e < 5; e += 1) {
+        pathways.push_back({ i, static_cast<int>(counter_uniform(3, i, e) * n), 0.1f + counter_uniform(4, i, e) });
+      }
+    }
+    CompactMarkovGraph<int> graph(pathways);
+    MarkovTransitionMatrix matrix(graph);
+
+    auto dense = vector<double>(n * n, 0.0);
+    for (uint32_t i = 0; i < graph.nodeCount(); i += 1)
+    {
+      auto previous = 0.0f;
+      for (auto e = graph.offsets()[i]; e < graph.offsets()[i + 1]; e += 1)
+      {
+        dense[i * n + graph.targets()[e]] += graph.cumulativeWeights()[e] - previous;
+        previous = graph.cumulativeWeights()[e];
+      }
+    }
+    auto x = vector<double>(n, 0.0);
+    x[0] = 1.0;
+    for (auto s = 0; s < 7; s += 1)
+    {
+      auto y = vector<double>(n, 0.0);
+      for (auto i = 0; i < n; i += 1)
+      {
+        for (auto j = 0; j < n; j += 1) {
+          y[j] += x[i] * dense[i * n + j];
+        }
+      }
+      x = y;
+    }
+
+    auto serial = matrix.transitionsFrom(0, 7, 1);
+    auto parallel = matrix.transitionsFrom(0, 7, 4);
+    REQUIRE(serial == parallel);
+    for (auto j = 0; j < n; j += 1) {
+      REQUIRE(serial[j] == Approx(x[j]));
+    }
+  }
+
+  SECTION("Matrices large enough to split across threads iterate in lockstep")
+  {
+    // enough entries that stepThreads uses several chunks, each iterating on a thread started once
+    const auto n = 40000;
+    auto pathways = vector<CompactMarkovGraph<int>::Pathway>();
+    for (auto i = 0; i < n; i += 1)
+    {
+      for (auto e = 0; e < 4; e += 1) {
+        pathways.push_back({ i, static_cast<int>(counter_uniform(5, i, e) * n), 0.1f + counter_uniform(6, i, e) });
+      }
+      pathways.push_back({ i, i / 2, 2.0f });
+    }
+    CompactMarkovGraph<int> graph(pathways);
+    MarkovTransitionMatrix matrix(graph);
+
+    REQUIRE(matrix.transitionsFrom(0, 9, 1) == matrix.transitionsFrom(0, 9, 4));
+    auto evens = matrix.transitionsFrom(0, 8, 3);
+    auto one = vector<double>(n);
+    matrix.step(evens.data(), one.data(), 1);
+    REQUIRE(one == matrix.transitionsFrom(0, 9, 3));
+
+    auto serial = matrix.stationaryDistribution(1e-9, 10000, 1);
+    auto parallel = matrix.stationaryDistribution(1e-9, 10000, 4);
+    REQUIRE(serial.converged);
+    REQUIRE(parallel.converged);
+    REQUIRE(parallel.iterations == serial.iterations);
+    for (auto j = 0; j < n; j += 1) {
+      REQUIRE(parallel.probabilities[j] == Approx(serial.probabilities[j]));
+    }
+    auto capped = matrix.stationaryDistribution(1e-30, 3, 4);
+    REQUIRE_FALSE(capped.converged);
+    REQUIRE(capped.iterations == 3);
+  }
+}
+
+TEST_CASE("Markov benchmarks", "[.benchmark]")
+{
+  SECTION("Compiled sampling cost is flat in the number of exits")
+  {
+    for (auto exits: { 10, 100, 1000, 10000 })
+    {
+      MarkovGraph<int> linear;
+      for (auto i = 0; i < exits; i += 1)
+      {
+        linear.addPathway(0, i, 1.0f + (i % 7));
+      }
+      auto compiled = linear;
+      compiled.compile();
+
+      const auto steps = 2000;
+      auto sum = 0;
+      auto time = [&] (MarkovGraph<int> &graph) {
+        auto start = chrono::high_resolution_clock::now();
+        for (auto i = 0; i < steps; i += 1)
+        {
+          sum += graph.nextNode(0, (i % 997) / 997.0f);
+        }
+        return chrono::duration<double, micro>(chrono::high_resolution_clock::now() - start).count() / steps;
+      };
+
+      cout << exits << " exits: linear " << time(linear) << "us, alias " << time(compiled) << "us per step" << endl;
+      REQUIRE(sum >= 0);
+    }
+  }
+
+  SECTION("Frozen markov graph traversal compared to hashed nodes")
+  {
+    const auto nodes = 100000;
+    const auto exits = 8;
+    MarkovGraph<int> graph;
+    for (auto n = 0; n < nodes; n += 1)
+    {
+      for (auto e = 1; e <= exits; e += 1)
+      {
+        graph.addPathway(n, (n * 31 + e * 7919) % nodes, 1.0f + e);
+      }
+    }
+    auto frozen = graph.freeze();
+
+    auto end_nodes = 0;
+    auto walk = [&end_nodes] (auto step) {
+      auto start = chrono::high_resolution_clock::now();
+      auto node = 0;
+      for (auto i = 0; i < 1000000; i += 1)
+      {
+        node = step(node, (i % 1009) / 1009.0f);
+      }
+      end_nodes += node;
+      return chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+    };
+
+    auto hashed_ms = walk([&] (int node, float t) { return graph.nextNode(node, t); });
+    auto compact_ms = walk([&] (int node, float t) { return static_cast<int>(frozen.nextNode(static_cast<uint32_t>(node), t)); });
+
+    cout << nodes << " nodes, " << frozen.edgeCount() << " edges" << endl;
+    cout << "  MarkovGraph        " << graph.memoryUsage() / 1024 << " KiB, 1M steps in " << hashed_ms << "ms" << endl;
+    cout << "  CompactMarkovGraph " << frozen.memoryUsage() / 1024 << " KiB, 1M steps in " << compact_ms << "ms" << endl;
+
+    REQUIRE(end_nodes >= 0);
+  }
+
+  SECTION("Training throughput")
+  {
+    auto tokens = vector<uint32_t>(4000000);
+    for (size_t i = 0; i < tokens.size(); i += 1)
+    {
+      tokens[i] = static_cast<uint32_t>(counter_uniform(11, 0, i) * counter_uniform(11, 1, i) * 200);
+    }
+
+    auto train = [&tokens] (size_t threads) {
+      MarkovTrainer<uint32_t> trainer(2);
+      auto start = chrono::high_resolution_clock::now();
+      trainer.addSequence(tokens, threads);
+      auto ms = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+      cout << "  " << threads << " thread(s): " << ms << "ms, " << trainer.pairCount() << " pairs" << endl;
+      return trainer.pairCount();
+    };
+
+    cout << "Order-2 training on " << tokens.size() << " tokens" << endl;
+    auto single = train(1);
+    auto all = train(resolve_thread_count(0));
+    REQUIRE(single == all);
+  }
+
+  SECTION("Arena traversal compared to shared_ptr nodes")
+  {
+    const auto nodes = 100000;
+    const auto exits = 4;
+    using Node = MarkovNode<int>;
+    auto shared = vector<shared_ptr<Node>>();
+    MarkovArena<int> arena;
+    arena.reserve(nodes, nodes * exits);
+    for (auto n = 0; n < nodes; n += 1)
+    {
+      shared.push_back(createNode(make_shared<int>(n)));
+      arena.createNode(n);
+    }
+    for (auto n = 0; n < nodes; n += 1)
+    {
+      for (auto e = 1; e <= exits; e += 1)
+      {
+        auto to = (n * 31 + e * 7919) % nodes;
+        shared[n]->addExit(shared[to], 1.0f + e);
+        arena.addExit(n, to, 1.0f + e);
+      }
+    }
+
+    auto time = [] (auto fn) {
+      auto start = chrono::high_resolution_clock::now();
+      fn();
+      return chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+    };
+    auto shared_end = 0;
+    auto arena_end = 0u;
+    auto shared_ms = time([&] {
+      auto node = shared[0];
+      for (auto i = 0; i < 1000000; i += 1) {
+        node = node->findExit((i % 1009) / 1009.0f);
+      }
+      shared_end = *node->thing;
+    });
+    auto arena_ms = time([&] {
+      auto node = 0u;
+      for (auto i = 0; i < 1000000; i += 1) {
+        node = arena.findExit(node, (i % 1009) / 1009.0f);
+      }
+      arena_end = node;
+    });
+
+    cout << "1M steps over " << nodes << " nodes: shared_ptr nodes " << shared_ms << "ms, arena " << arena_ms << "ms" << endl;
+    REQUIRE(shared_end >= 0);
+    REQUIRE(arena_end < static_cast<unsigned>(nodes));
+
+    // nodes exit into each other, so break the cycles before letting go
+    for (auto &node: shared) {
+      node->clearExits();
+    }
+  }
+
+  SECTION("Mapping a saved graph is faster than rebuilding it")
+  {
+    const auto nodes = 100000;
+    const auto exits = 8;
+    auto pathways = vector<CompactMarkovGraph<int>::Pathway>();
+    for (auto n = 0; n < nodes; n += 1)
+    {
+      for (auto e = 1; e <= exits; e += 1) {
+        pathways.push_back({ n, (n * 31 + e * 7919) % nodes, 1.0f + e });
+      }
+    }
+
+    auto time = [] (auto fn) {
+      auto start = chrono::high_resolution_clock::now();
+      fn();
+      return chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+    };
+    auto path = string("Markov_test.pkmarkov");
+    auto rebuilt = CompactMarkovGraph<int>();
+    auto build_ms = time([&] {
+      MarkovGraph<int> graph;
+      for (auto &p: pathways) {
+        graph.addPathway(p.from, p.to, p.weight);
+      }
+      rebuilt = graph.freeze();
+    });
+    saveMarkovGraph(rebuilt, path);
+
+    auto node = 0u;
+    auto map_ms = time([&] {
+      MappedMarkovGraph<int> mapped(path);
+      node = mapped.nextNode(mapped.nodeId(12345), 0.5f);
+    });
+    MappedMarkovGraph<int> mapped(path);
+
+    cout << nodes * exits << " pathways: replaying addPathway and freezing " << build_ms << "ms, mapping saved file " << map_ms << "ms" << endl;
+    REQUIRE(node == rebuilt.nextNode(rebuilt.nodeId(12345), 0.5f));
+    REQUIRE(mapped.generateWalks({ 0, 1, 2, 3 }, 64, 9) == rebuilt.generateWalks({ 0, 1, 2, 3 }, 64, 9));
+    remove(path.c_str());
+  }
+
+  SECTION("Stationary distribution of a large graph")
+  {
+    const auto nodes = 100000;
+    auto pathways = vector<CompactMarkovGraph<int>::Pathway>();
+    for (auto n = 0; n < nodes; n += 1)
+    {
+      for (auto e = 1; e <= 7; e += 1) {
+        pathways.push_back({ n, (n * 31 + e * 7919) % nodes, 1.0f + e });
+      }
+      // drift toward low ids so the answer isn't uniform
+      pathways.push_back({ n, n / 2, 10.0f });
+    }
+    CompactMarkovGraph<int> graph(pathways);
+
+    auto start = chrono::high_resolution_clock::now();
+    MarkovTransitionMatrix matrix(graph);
+    auto stationary = matrix.stationaryDistribution(1e-9);
+    auto ms = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+
+    cout << "Stationary distribution of " << nodes << " nodes: " << stationary.iterations << " iterations in " << ms << "ms" << endl;
+    REQUIRE(stationary.converged);
+    auto total = 0.0;
+    for (auto p: stationary.probabilities) {
+      total += p;
+    }
+    REQUIRE(total == Approx(1.0));
+  }
 }
@@ -0,0 +1,161 @@
+//
+//  PixelKernels_test.cpp
+//
+
+#include "catch.hpp"
+#include "pockets/PixelKernels.h"
+#include "pockets/WeightedSampling.h"
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+using namespace pockets;
+using namespace std;
+
+namespace {
+
+/// Bounds of nonzero alpha, one pixel at a time.
+PixelBounds reference_bounds(const vector<uint8_t> &pixels, int width, int height, int alpha_offset)
+{
+  auto bounds = PixelBounds{ width, height, 0, 0 };
+  for (auto y = 0; y < height; y += 1)
+  {
+    for (auto x = 0; x < width; x += 1)
+    {
+      if (pixels[(y * width + x) * 4 + alpha_offset] != 0)
+      {
+        bounds.x1 = min(bounds.x1, x);
+        bounds.y1 = min(bounds.y1, y);
+        bounds.x2 = max(bounds.x2, x + 1);
+        bounds.y2 = max(bounds.y2, y + 1);
+      }
+    }
+  }
+  return bounds.empty() ? PixelBounds() : bounds;
+}
+
+bool same_bounds(const PixelBounds &a, const PixelBounds &b)
+{
+  return a.x1 == b.x1 && a.y1 == b.y1 && a.x2 == b.x2 && a.y2 == b.y2;
+}
+
+/// A transparent image with a few opaque specks, whose colors are nonzero everywhere so only alpha counts.
+vector<uint8_t> specks(int width, int height, int alpha_offset, uint64_t seed)
+{
+  auto pixels = vector<uint8_t>(width * height * 4, 200);
+  for (auto i = 0; i < width * height; i += 1) {
+    pixels[i * 4 + alpha_offset] = 0;
+  }
+  const auto count = int(counter_uniform(seed, 0, 0) * 4);
+  for (auto i = 0; i < count; i += 1)
+  {
+    const auto x = int(counter_uniform(seed, 1, i) * width);
+    const auto y = int(counter_uniform(seed, 2, i) * height);
+    pixels[(y * width + x) * 4 + alpha_offset] = 1 + int(counter_uniform(seed, 3, i) * 254);
+  }
+  return pixels;
+}
+
+} // namespace
+
+TEST_CASE("PixelKernels_test")
+{
+  SECTION("Premultiplying rounds every channel and alpha exactly")
+  {
+    for (auto width: { 256, 7 })
+    {
+      // every color value against every alpha
+      auto pixels = vector<uint8_t>();
+      for (auto a = 0; a < 256; a += 1)
+      {
+        for (auto c = 0; c < 256; c += 1)
+        {
+          pixels.insert(pixels.end(), { uint8_t(c), uint8_t(255 - c), uint8_t(c / 2), uint8_t(a) });
+        }
+      }
+      const auto original = pixels;
+      const auto height = int(pixels.size() / 4 / width);
+      premultiply_rgba8(pixels.data(), width, height, width * 4);
+
+      auto mismatches = 0;
+      for (size_t i = 0; i < size_t(width * height); i += 1)
+      {
+        const auto a = original[i * 4 + 3];
+        for (auto channel = 0; channel < 3; channel += 1)
+        {
+          const auto expected = lround(original[i * 4 + channel] * a / 255.0);
+          mismatches += pixels[i * 4 + channel] != expected;
+        }
+        mismatches += pixels[i * 4 + 3] != a;
+      }
+      REQUIRE(mismatches == 0);
+    }
+  }
+
+  SECTION("Alpha bounds match a pixel-by-pixel scan")
+  {
+    for (auto alpha_offset: { 3, 0 })
+    {
+      for (uint64_t seed = 0; seed < 300; seed += 1)
+      {
+        const auto width = 1 + int(counter_uniform(seed, 4, 0) * 40);
+        const auto height = 1 + int(counter_uniform(seed, 5, 0) * 40);
+        auto pixels = specks(width, height, alpha_offset, seed);
+        auto bounds = alpha_bounds_rgba8(pixels.data(), width, height, width * 4, alpha_offset);
+        REQUIRE(same_bounds(bounds, reference_bounds(pixels, width, height, alpha_offset)));
+      }
+    }
+
+    // a row stride wider than the image ignores the padding
+    auto padded = vector<uint8_t>(8 * 4 * 3, 0);
+    padded[(1 * 8 + 2) * 4 + 3] = 255;
+    padded[(2 * 8 + 6) * 4 + 3] = 255;
+    REQUIRE(same_bounds(alpha_bounds_rgba8(padded.data(), 4, 3, 8 * 4), PixelBounds{ 2, 1, 3, 2 }));
+    REQUIRE(alpha_bounds_rgba8(padded.data(), 2, 3, 8 * 4).empty());
+  }
+}
+
+TEST_CASE("PixelKernels benchmarks", "[.benchmark]")
+{
+  SECTION("Trimming and premultiplying animation frames")
+  {
+    // a sprite in the middle of a mostly transparent frame, as exported animations tend to be
+    const auto size = 256;
+    auto frame = vector<uint8_t>(size * size * 4, 0);
+    for (auto y = 90; y < 170; y += 1)
+    {
+      for (auto x = 70; x < 200; x += 1) {
+        frame[(y * size + x) * 4 + 3] = uint8_t(x + y);
+      }
+    }
+
+    const auto frames = 2000;
+    auto time = [] (auto fn) {
+      auto start = chrono::high_resolution_clock::now();
+      fn();
+      return chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+    };
+    auto bounds = PixelBounds();
+    auto kernel_ms = time([&] {
+      for (auto i = 0; i < frames; i += 1) {
+        bounds = alpha_bounds_rgba8(frame.data(), size, size, size * 4);
+      }
+    });
+    auto reference = PixelBounds();
+    auto reference_ms = time([&] {
+      for (auto i = 0; i < frames / 10; i += 1) {
+        reference = reference_bounds(frame, size, size, 3);
+      }
+    }) * 10;
+    auto premultiply_ms = time([&] {
+      for (auto i = 0; i < frames; i += 1) {
+        premultiply_rgba8(frame.data(), size, size, size * 4);
+      }
+    });
+
+    cout << "Alpha bounds of " << frames << " 256x256 frames: " << kernel_ms << "ms, " << reference_ms << "ms one pixel at a time; premultiplied in " << premultiply_ms << "ms" << endl;
+    REQUIRE(same_bounds(bounds, PixelBounds{ 70, 90, 200, 170 }));
+    REQUIRE(same_bounds(bounds, reference));
+  }
+}
@@ -0,0 +1,253 @@
+//
+//  RectPacking_test.cpp
+//
+
+#include "catch.hpp"
+#include "pockets/RectPacking.h"
+#include "pockets/WeightedSampling.h"
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <string>
+
+using namespace pockets;
+using namespace std;
+
+namespace {
+
+/// \a count sizes drawn from \a distribution, given a pair of uniform values.
+vector<PackSize> random_sizes(size_t count, uint64_t seed, const function<PackSize (float, float)> &distribution)
+{
+  auto sizes = vector<PackSize>(count);
+  for (size_t i = 0; i < count; i += 1) {
+    sizes[i] = distribution(counter_uniform(seed, 0, i), counter_uniform(seed, 1, i));
+  }
+  return sizes;
+}
+
+/// True if every placed rectangle lies within \a width and no two overlap.
+bool valid_packing(const vector<PackSize> &sizes, const vector<PackPlacement> &placements, int width, int height)
+{
+  for (size_t i = 0; i < sizes.size(); i += 1)
+  {
+    const auto &a = placements[i];
+    if (! a.placed) {
+      continue;
+    }
+    if (a.x < 0 || a.y < 0 || a.x + sizes[i].width > width || a.y + sizes[i].height > height) {
+      return false;
+    }
+    for (size_t j = i + 1; j < sizes.size(); j += 1)
+    {
+      const auto &b = placements[j];
+      if (b.placed && a.x < b.x + sizes[j].width && b.x < a.x + sizes[i].width && a.y < b.y + sizes[j].height && b.y < a.y + sizes[i].height) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+int packed_height(const vector<PackSize> &sizes, const vector<PackPlacement> &placements)
+{
+  auto height = 0;
+  for (size_t i = 0; i < sizes.size(); i += 1) {
+    height = max(height, placements[i].y + sizes[i].height);
+  }
+  return height;
+}
+
+/// Rectangles fed one at a time to a skyline packer, with the time taken by each block of 10k.
+struct OnlinePacking
+{
+  vector<PackSize>      sizes;
+  vector<PackPlacement> placements;
+  vector<double>        block_ms;
+  size_t                most_segments = 0;
+};
+
+/// Inserts \a count glyph and thumbnail sized rectangles into a 4096 wide skyline, as a runtime atlas sees them.
+OnlinePacking pack_online(size_t count)
+{
+  auto result = OnlinePacking();
+  result.sizes = random_sizes(count, 3, [] (float a, float b) {
+    return b < 0.9f ? PackSize{ 4 + int(a * 28), 12 + int(b * 20) } : PackSize{ 64 + int(a * 64), 64 + int(a * 64) };
+  });
+  auto packer = SkylinePacker(4096);
+  result.placements.reserve(count);
+  for (size_t block = 0; block < count; block += 10000)
+  {
+    auto start = chrono::high_resolution_clock::now();
+    for (auto i = block; i < min(block + 10000, count); i += 1) {
+      result.placements.push_back(packer.insert(result.sizes[i].width, result.sizes[i].height));
+    }
+    result.block_ms.push_back(chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count());
+    result.most_segments = max(result.most_segments, packer.skyline().size());
+  }
+  return result;
+}
+
+const auto AllAlgorithms = { PackingAlgorithm::Shelf, PackingAlgorithm::Skyline, PackingAlgorithm::MaxRects };
+
+} // namespace
+
+TEST_CASE("RectPacking_test")
+{
+  SECTION("Packed rectangles stay in bounds and never overlap")
+  {
+    auto sizes = random_sizes(500, 7, [] (float a, float b) {
+      return PackSize{ 1 + int(a * 60), 1 + int(b * b * 120) };
+    });
+    for (auto algorithm: AllAlgorithms)
+    {
+      auto placements = pack_rects(sizes, 512, UnboundedPackHeight, algorithm);
+      REQUIRE(valid_packing(sizes, placements, 512, UnboundedPackHeight));
+      REQUIRE(all_of(placements.begin(), placements.end(), [] (const PackPlacement &p) { return p.placed; }));
+
+      // bounded pages fill up and leave the rest unplaced
+      auto bounded = pack_rects(sizes, 256, 256, algorithm);
+      REQUIRE(valid_packing(sizes, bounded, 256, 256));
+      REQUIRE(any_of(bounded.begin(), bounded.end(), [] (const PackPlacement &p) { return p.placed; }));
+      REQUIRE(any_of(bounded.begin(), bounded.end(), [] (const PackPlacement &p) { return ! p.placed; }));
+    }
+  }
+
+  SECTION("Pages spill over once the first is full")
+  {
+    auto sizes = random_sizes(400, 5, [] (float a, float b) {
+      return PackSize{ 8 + int(a * 56), 8 + int(b * 56) };
+    });
+    sizes.push_back(PackSize{ 300, 10 });
+    for (auto algorithm: AllAlgorithms)
+    {
+      auto placements = pack_pages(sizes, 256, 256, algorithm);
+      auto pages = 0;
+      for (auto &p: placements) {
+        pages = max(pages, p.page + 1);
+      }
+      REQUIRE(pages > 1);
+      REQUIRE_FALSE(placements.back().placed);
+      for (auto page = 0; page < pages; page += 1)
+      {
+        auto on_page = placements;
+        for (auto &p: on_page) {
+          p.placed = p.placed && p.page == page;
+        }
+        REQUIRE(valid_packing(sizes, on_page, 256, 256));
+      }
+      REQUIRE(count_if(placements.begin(), placements.end(), [] (const PackPlacement &p) { return p.placed; }) == 400);
+    }
+  }
+
+  SECTION("Skyline rests rectangles on the lowest segment that fits")
+  {
+    auto packer = SkylinePacker(10);
+    auto a = packer.insert(4, 3);
+    auto b = packer.insert(6, 1);
+    auto c = packer.insert(5, 2);
+    REQUIRE((a.x == 0 && a.y == 0));
+    REQUIRE((b.x == 4 && b.y == 0));
+    // the step at x = 4 is lower than the top of a, so c hangs over it
+    REQUIRE((c.x == 4 && c.y == 1));
+    REQUIRE(packer.usedHeight() == 3);
+    REQUIRE(packer.skyline().size() == 2);
+    REQUIRE(packer.insert(11, 1).placed == false);
+  }
+
+  SECTION("MaxRects fills a page exactly when the pieces allow it")
+  {
+    auto packer = MaxRectsPacker(16, 16);
+    REQUIRE(packer.insert(8, 16).placed);
+    REQUIRE(packer.insert(8, 4).placed);
+    REQUIRE(packer.insert(4, 12).placed);
+    REQUIRE(packer.insert(4, 12).placed);
+    REQUIRE(packer.freeRects().empty());
+    REQUIRE(packer.insert(1, 1).placed == false);
+
+    packer.clear();
+    REQUIRE(packer.freeRects().size() == 1);
+    REQUIRE(packer.insert(16, 16).placed);
+  }
+
+  SECTION("Empty rectangles are placed without using space, and negative ones are rejected")
+  {
+    auto packer = SkylinePacker(4, 4);
+    REQUIRE(packer.insert(0, 10).placed);
+    REQUIRE(packer.usedHeight() == 0);
+    REQUIRE_THROWS(packer.insert(-1, 2));
+    REQUIRE_THROWS(MaxRectsPacker(-4));
+  }
+
+  SECTION("Online skyline outlines stay bounded by the width, not the count")
+  {
+    auto online = pack_online(20000);
+
+    REQUIRE(all_of(online.placements.begin(), online.placements.end(), [] (const PackPlacement &p) { return p.placed; }));
+    auto early = vector<PackSize>(online.sizes.begin(), online.sizes.begin() + 2000);
+    REQUIRE(valid_packing(early, vector<PackPlacement>(online.placements.begin(), online.placements.begin() + 2000), 4096, UnboundedPackHeight));
+    REQUIRE(online.most_segments < 4096 / 4);
+  }
+}
+
+TEST_CASE("RectPacking benchmarks", "[.benchmark]")
+{
+  SECTION("Packing time and occupancy across sprite counts and sizes")
+  {
+    struct Distribution
+    {
+      string                              name;
+      function<PackSize (float, float)>   size;
+    };
+    const auto distributions = vector<Distribution>{
+      { "uniform 8-64", [] (float a, float b) { return PackSize{ 8 + int(a * 56), 8 + int(b * 56) }; } },
+      { "mixed 4-256", [] (float a, float b) { return PackSize{ 4 + int(a * a * a * 252), 4 + int(b * b * b * 252) }; } },
+      { "glyphs", [] (float a, float b) { return PackSize{ 6 + int(a * 20), 24 + int(b * 4) }; } }
+    };
+    const auto names = vector<string>{ "shelf", "skyline", "maxrects" };
+
+    for (auto &distribution: distributions)
+    {
+      for (auto count: { 100, 1000, 5000 })
+      {
+        auto sizes = random_sizes(count, count, distribution.size);
+        auto area = int64_t(0);
+        for (auto &s: sizes) {
+          area += s.width * s.height;
+        }
+        // a power-of-two sheet about as wide as the square the sprites would fill
+        auto width = 64;
+        while (int64_t(width) * width < area) {
+          width *= 2;
+        }
+        cout << "Packing " << count << " " << distribution.name << ":";
+        for (auto algorithm: AllAlgorithms)
+        {
+          auto start = chrono::high_resolution_clock::now();
+          auto placements = pack_rects(sizes, width, UnboundedPackHeight, algorithm);
+          auto ms = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+          const auto occupancy = double(area) / (double(width) * packed_height(sizes, placements));
+          cout << " " << names[int(algorithm)] << " " << ms << "ms " << int(occupancy * 100) << "%,";
+          if (count <= 1000) {
+            REQUIRE(valid_packing(sizes, placements, width, UnboundedPackHeight));
+          }
+        }
+        cout << endl;
+      }
+    }
+  }
+
+  SECTION("Online skyline insertion cost stays flat up to 100k rectangles")
+  {
+    auto online = pack_online(100000);
+
+    cout << "Skyline insertion per 10k rectangles:";
+    for (auto ms: online.block_ms) {
+      cout << " " << ms << "ms";
+    }
+    cout << ", at most " << online.most_segments << " segments" << endl;
+
+    // the outline is bounded by the width, not the count, so later blocks cost about what the first did
+    const auto fastest = *min_element(online.block_ms.begin(), online.block_ms.end());
+    REQUIRE(online.block_ms.back() < fastest * 4 + 5.0);
+  }
+}
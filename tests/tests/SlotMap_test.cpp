@@ -0,0 +1,94 @@
+//
+//  SlotMap_test.cpp
+//
+
+#include "catch.hpp"
+#include "pockets/SlotMap.h"
+#include <string>
+
+using namespace pockets;
+using namespace std;
+
+TEST_CASE("SlotMap_test")
+{
+  SECTION("Handles find their elements after other elements are erased")
+  {
+    auto names = slot_map<string>();
+    auto a = names.insert("a");
+    auto b = names.insert("b");
+    auto c = names.insert("c");
+
+    REQUIRE(names.erase(a));
+    REQUIRE(names.size() == 2);
+    REQUIRE(*names.get(b) == "b");
+    REQUIRE(names[c] == "c");
+
+    // iteration is over the packed elements
+    REQUIRE(vector<string>(names.begin(), names.end()) == (vector<string>{ "c", "b" }));
+    REQUIRE(names.handle_at(0) == c);
+  }
+
+  SECTION("Stale handles are rejected even when their slot is reused")
+  {
+    auto values = slot_map<int>();
+    auto first = values.insert(1);
+    values.erase(first);
+    auto second = values.insert(2);
+
+    REQUIRE(second.index == first.index);
+    REQUIRE_FALSE(values.contains(first));
+    REQUIRE(values.get(first) == nullptr);
+    REQUIRE_FALSE(values.erase(first));
+    REQUIRE(values[second] == 2);
+  }
+
+  SECTION("Default handles are never valid")
+  {
+    auto values = slot_map<int>();
+    values.insert(1);
+
+    REQUIRE_FALSE(values.contains(slot_handle()));
+  }
+
+  SECTION("Clearing invalidates every handle")
+  {
+    auto values = slot_map<int>();
+    auto handles = vector<slot_handle>();
+    for (auto i = 0; i < 10; i += 1) {
+      handles.push_back(values.emplace(i));
+    }
+    values.clear();
+
+    REQUIRE(values.empty());
+    for (auto &h: handles) {
+      REQUIRE_FALSE(values.contains(h));
+    }
+    values.insert(5);
+    REQUIRE(values.size() == 1);
+  }
+
+  SECTION("Sparse sets track membership of small integers")
+  {
+    auto set = sparse_set();
+    REQUIRE(set.insert(40));
+    REQUIRE(set.insert(3));
+    REQUIRE(set.insert(7));
+    REQUIRE_FALSE(set.insert(3));
+    REQUIRE_FALSE(set.insert(numeric_limits<uint32_t>::max()));
+    REQUIRE_FALSE(set.contains(numeric_limits<uint32_t>::max()));
+    REQUIRE(set.size() == 3);
+
+    REQUIRE(set.contains(40));
+    REQUIRE_FALSE(set.contains(4));
+    REQUIRE_FALSE(set.contains(1000));
+
+    REQUIRE(set.erase(40));
+    REQUIRE_FALSE(set.erase(40));
+    REQUIRE_FALSE(set.contains(40));
+    REQUIRE(vector<uint32_t>(set.begin(), set.end()) == (vector<uint32_t>{ 7, 3 }));
+
+    set.clear();
+    REQUIRE_FALSE(set.contains(7));
+    REQUIRE(set.insert(7));
+  }
+}
@@ -70,4 +70,36 @@ TEST_CASE("Strings_test")
     cout << "G dot: " << fancy << "a" << endl;
     cout << "G dot: " << trim_right(fancy) << "a" << endl;
   }
+
+  SECTION("UTF-8 decoding yields one code point per character")
+  {
+    const auto text = string(u8"a\u00E9\u4E2D\U0001F600z");
+    const auto decoded = utf8_decode(text);
+
+    REQUIRE(decoded == (u32string{ U'a', 0x00E9, 0x4E2D, 0x1F600, U'z' }));
+    REQUIRE(utf8_encode(decoded) == text);
+  }
+
+  SECTION("Long ASCII runs take the fast path and decode unchanged")
+  {
+    const auto ascii = string("The quick brown fox jumps over the lazy dog, again and again.");
+    const auto mixed = ascii + u8"\u00FC" + ascii;
+
+    REQUIRE(is_ascii(ascii));
+    REQUIRE_FALSE(is_ascii(mixed));
+    REQUIRE(utf8_decode(ascii) == u32string(ascii.begin(), ascii.end()));
+    REQUIRE(utf8_decode(mixed).size() == ascii.size() * 2 + 1);
+    REQUIRE(utf8_decode(mixed).at(ascii.size()) == 0x00FC);
+  }
+
+  SECTION("Malformed UTF-8 is replaced rather than skipped")
+  {
+    const auto truncated = string("ab\xE4\xB8");
+    const auto overlong = string("\xC0\xAF");
+    const auto surrogate = string("\xED\xA0\x80");
+
+    REQUIRE(utf8_decode(truncated) == (u32string{ U'a', U'b', 0xFFFD, 0xFFFD }));
+    REQUIRE(utf8_decode(overlong) == (u32string{ 0xFFFD, 0xFFFD }));
+    REQUIRE(utf8_decode(surrogate) == (u32string{ 0xFFFD, 0xFFFD, 0xFFFD }));
+  }
 }